@@ -0,0 +1,126 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BUF_SIZE   (64 * 1024)
+#define TOTAL_SIZE (64 * 1024 * 1024) /* bytes processed per benchmark */
+
+static unsigned char src[BUF_SIZE + 64];
+static unsigned char dst[BUF_SIZE + 64];
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void report(const char *name, size_t size, uint64_t ns)
+{
+    uint64_t us = ns / 1000 ? ns / 1000 : 1;
+    printf("%-8s %6lu bytes: %lu us, %lu MB/s\n", name, size, us, TOTAL_SIZE / us);
+}
+
+/* Checks the routines against byte-by-byte references, with all alignments
+ * and small sizes. */
+static int check(void)
+{
+    for (size_t i = 0; i < sizeof(src); i++) src[i] = (i * 7 + 1) % 251 + 1;
+    for (size_t so = 0; so < 32; so++) {
+        for (size_t doff = 0; doff < 32; doff++) {
+            for (size_t n = 0; n < 300; n += (n < 80 ? 1 : 37)) {
+                size_t end = doff + n + 32; /* also check bytes around */
+                memset(dst, 0, end);
+                memcpy(dst + doff, src + so, n);
+                for (size_t i = 0; i < end; i++) {
+                    unsigned char expect = i >= doff && i < doff + n ? src[so + i - doff] : 0;
+                    if (dst[i] != expect) {
+                        printf("memcpy(%lu, %lu, %lu) failed\n", doff, so, n);
+                        return -1;
+                    }
+                }
+
+                memcpy(dst, src, end + so);
+                memmove(dst + doff, dst + so, n);
+                if (memcmp(dst + doff, src + so, n) != 0) {
+                    printf("memmove(%lu, %lu, %lu) failed\n", doff, so, n);
+                    return -1;
+                }
+
+                memset(dst, 0, end);
+                memset(dst + doff, 0xa5, n);
+                for (size_t i = 0; i < end; i++) {
+                    unsigned char expect = i >= doff && i < doff + n ? 0xa5 : 0;
+                    if (dst[i] != expect) {
+                        printf("memset(%lu, %lu) failed\n", doff, n);
+                        return -1;
+                    }
+                }
+
+                memcpy(dst, src, end + so);
+                dst[so + n] = 0;
+                if (strlen((char *)dst + so) != n) {
+                    printf("strlen(%lu, %lu) failed\n", so, n);
+                    return -1;
+                }
+                dst[so + n] = 0xff;
+                if (memchr(dst + so, 0xff, n + 1) != dst + so + n ||
+                    memchr(dst + so, 0xff, n) != NULL) {
+                    printf("memchr(%lu, %lu) failed\n", so, n);
+                    return -1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+static void bench(size_t size)
+{
+    size_t rounds = TOTAL_SIZE / size;
+    uint64_t t;
+
+    t = now_ns();
+    for (size_t i = 0; i < rounds; i++) memcpy(dst, src, size);
+    report("memcpy", size, now_ns() - t);
+
+    t = now_ns();
+    for (size_t i = 0; i < rounds; i++) memmove(dst + 1, dst, size);
+    report("memmove", size, now_ns() - t);
+
+    t = now_ns();
+    for (size_t i = 0; i < rounds; i++) memset(dst, (int)i, size);
+    report("memset", size, now_ns() - t);
+
+    memset(dst, 'a', size);
+    dst[size - 1] = 0;
+    t = now_ns();
+    for (size_t i = 0; i < rounds; i++) {
+        if (strlen((char *)dst) != size - 1)
+            abort();
+    }
+    report("strlen", size, now_ns() - t);
+
+    t = now_ns();
+    for (size_t i = 0; i < rounds; i++) {
+        if (memchr(dst, 0, size) != dst + size - 1)
+            abort();
+    }
+    report("memchr", size, now_ns() - t);
+}
+
+int main()
+{
+    puts("Running memory routine benchmarks...");
+    if (check() != 0)
+        return 1;
+    puts("Memory routines check OK!");
+
+    size_t sizes[] = {16, 64, 256, 4096, BUF_SIZE};
+    for (int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) bench(sizes[i]);
+
+    puts("Memory routine benchmarks run OK!");
+    return 0;
+}
@@ -1,6 +1,8 @@
+#include <malloc.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/mman.h>
 
 int main()
 {
@@ -23,5 +25,76 @@ int main()
     }
     free(p);
     puts("Memory tests run OK!");
+
+    puts("Running realloc tests...");
+    unsigned char *r = malloc(100);
+    for (i = 0; i < 100; i++) r[i] = (unsigned char)i;
+    size_t usable = malloc_usable_size(r);
+    if (usable < 100 || realloc(r, usable) != r) {
+        puts("realloc not in place");
+        return 1;
+    }
+    for (size_t size = 256; size <= 0x40000; size *= 4) {
+        r = realloc(r, size);
+        if (!r || malloc_usable_size(r) < size) {
+            puts("realloc failed");
+            return 1;
+        }
+        for (i = 0; i < 100; i++) {
+            if (r[i] != (unsigned char)i) {
+                puts("realloc lost data");
+                return 1;
+            }
+        }
+    }
+    free(r);
+    void *a;
+    for (size_t align = 16; align <= 0x10000; align *= 16) {
+        if (posix_memalign(&a, align, 1000) || (uintptr_t)a % align) {
+            puts("posix_memalign failed");
+            return 1;
+        }
+        a = realloc(a, 0x3000);
+        if (!a || (uintptr_t)a % align) {
+            puts("realloc lost alignment");
+            return 1;
+        }
+        printf("posix_memalign(%#lx): p=%p\n", align, a);
+        free(a);
+    }
+    if (posix_memalign(&a, 12, 8) == 0) {
+        puts("posix_memalign accepted a bad alignment");
+        return 1;
+    }
+    puts("realloc tests run OK!");
+
+    puts("Running mmap tests...");
+    size_t len = 0x10000;
+    unsigned char *m = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (m == MAP_FAILED) {
+        puts("mmap failed");
+        return 1;
+    }
+    for (i = 0; i < len; i++) {
+        if (m[i] != 0) {
+            puts("mmap not zeroed");
+            return 1;
+        }
+        m[i] = (unsigned char)i;
+    }
+    m = mremap(m, len, len * 4, MREMAP_MAYMOVE);
+    if (m == MAP_FAILED) {
+        puts("mremap failed");
+        return 1;
+    }
+    printf("mremap to %#lx bytes: p=%p\n", len * 4, m);
+    for (i = 0; i < len * 4; i++) {
+        if (m[i] != (i < len ? (unsigned char)i : 0)) {
+            puts("mremap lost data");
+            return 1;
+        }
+    }
+    munmap(m, len * 4);
+    puts("mmap tests run OK!");
     return 0;
 }
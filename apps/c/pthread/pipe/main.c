@@ -1,10 +1,16 @@
+#include <errno.h>
 #include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 const int ROUND = 5;
 
+#define BENCH_CHUNK_SIZE 4096
+#define BENCH_TOTAL_SIZE (64 * 1024 * 1024)
+
 void *ChildFunc(void *arg)
 {
     int *fd = (int *)arg;
@@ -20,6 +26,61 @@ void *ChildFunc(void *arg)
     close(fd[1]);
 }
 
+void *BenchWriter(void *arg)
+{
+    int fd = *(int *)arg;
+    static char buf[BENCH_CHUNK_SIZE];
+    memset(buf, 'x', sizeof(buf));
+    for (size_t sent = 0; sent < BENCH_TOTAL_SIZE; sent += sizeof(buf)) {
+        if (write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+            puts("Fail to write pipe");
+            break;
+        }
+    }
+    close(fd);
+    return NULL;
+}
+
+/* Measures the throughput of a pipe between two threads. */
+int bench_pipe()
+{
+    int fd[2];
+    if (pipe(fd) != 0)
+        return -1;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    pthread_t t;
+    pthread_create(&t, NULL, BenchWriter, (void *)&fd[1]);
+
+    static char buf[BENCH_CHUNK_SIZE];
+    size_t total = 0;
+    ssize_t n;
+    while ((n = read(fd[0], buf, sizeof(buf))) > 0) total += n;
+    pthread_join(t, NULL);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    uint64_t us = (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000;
+    if (n < 0 || total != BENCH_TOTAL_SIZE) {
+        puts("Pipe benchmark: unexpected EOF");
+        return -1;
+    }
+    printf("Pipe throughput: %lu bytes in %lu us, %lu MB/s\n", total, us, total / (us ? us : 1));
+
+    /* writing to a pipe without readers fails with EPIPE */
+    close(fd[0]);
+    if (pipe(fd) != 0)
+        return -1;
+    close(fd[0]);
+    if (write(fd[1], buf, 1) != -1 || errno != EPIPE) {
+        puts("Pipe benchmark: write to closed pipe succeeded");
+        return -1;
+    }
+    close(fd[1]);
+    return 0;
+}
+
 void main()
 {
     int fd[2];
@@ -42,5 +103,8 @@ void main()
     }
 
     puts("(C)Pipe tests run OK");
+
+    if (bench_pipe() == 0)
+        puts("(C)Pipe benchmark run OK");
     return;
 }
@@ -0,0 +1,181 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define NUM_TASKS 8
+#define NUM_ITERS 10000
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static int queue_len = 0;
+
+static pthread_rwlock_t rwlock;
+static long rw_data[2];
+
+static pthread_barrier_t barrier;
+static int arrived = 0;
+static int num_serial = 0;
+
+static pthread_spinlock_t spin;
+static long spin_count = 0;
+
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static int once_count = 0;
+
+static void fail(const char *msg)
+{
+    printf("(C)Pthread %s FAIL!\n", msg);
+    exit(1);
+}
+
+static void run_tasks(void *(*entry)(void *))
+{
+    pthread_t tasks[NUM_TASKS];
+    for (long i = 0; i < NUM_TASKS; i++) pthread_create(&tasks[i], NULL, entry, (void *)i);
+    for (int i = 0; i < NUM_TASKS; i++) pthread_join(tasks[i], NULL);
+}
+
+static void *cond_entry(void *arg)
+{
+    long id = (long)arg;
+    for (int i = 0; i < NUM_ITERS; i++) {
+        pthread_mutex_lock(&mutex);
+        if (id % 2 == 0) {
+            queue_len++;
+            pthread_cond_signal(&cond);
+        } else {
+            while (queue_len == 0) pthread_cond_wait(&cond, &mutex);
+            queue_len--;
+        }
+        pthread_mutex_unlock(&mutex);
+    }
+    return NULL;
+}
+
+static void test_cond(void)
+{
+    run_tasks(cond_entry);
+    if (queue_len != 0)
+        fail("cond");
+    puts("(C)Pthread cond OK");
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_nsec += 50 * 1000000;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    pthread_mutex_lock(&mutex);
+    int ret = pthread_cond_timedwait(&cond, &mutex, &ts);
+    pthread_mutex_unlock(&mutex);
+    if (ret != ETIMEDOUT)
+        fail("cond timedwait");
+    puts("(C)Pthread cond timedwait OK");
+}
+
+static void *rwlock_entry(void *arg)
+{
+    long id = (long)arg;
+    for (int i = 0; i < NUM_ITERS; i++) {
+        if (id % 4 == 0) {
+            pthread_rwlock_wrlock(&rwlock);
+            rw_data[0]++;
+            rw_data[1]++;
+        } else {
+            pthread_rwlock_rdlock(&rwlock);
+            if (rw_data[0] != rw_data[1])
+                fail("rwlock");
+        }
+        pthread_rwlock_unlock(&rwlock);
+    }
+    return NULL;
+}
+
+static void test_rwlock(int kind, const char *name)
+{
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+    pthread_rwlockattr_setkind_np(&attr, kind);
+    pthread_rwlock_init(&rwlock, &attr);
+    rw_data[0] = rw_data[1] = 0;
+    run_tasks(rwlock_entry);
+    if (rw_data[0] != NUM_ITERS * NUM_TASKS / 4 || pthread_rwlock_destroy(&rwlock) != 0)
+        fail("rwlock");
+    printf("(C)Pthread rwlock (%s) OK\n", name);
+}
+
+static void *barrier_entry(void *arg)
+{
+    for (int i = 0; i < 100; i++) {
+        __atomic_fetch_add(&arrived, 1, __ATOMIC_SEQ_CST);
+        if (pthread_barrier_wait(&barrier) == PTHREAD_BARRIER_SERIAL_THREAD)
+            __atomic_fetch_add(&num_serial, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&arrived, __ATOMIC_SEQ_CST) < NUM_TASKS * (i + 1))
+            fail("barrier");
+        pthread_barrier_wait(&barrier);
+    }
+    return NULL;
+}
+
+static void test_barrier(void)
+{
+    pthread_barrier_init(&barrier, NULL, NUM_TASKS);
+    run_tasks(barrier_entry);
+    if (num_serial != 100 || pthread_barrier_destroy(&barrier) != 0)
+        fail("barrier");
+    puts("(C)Pthread barrier OK");
+}
+
+static void *spin_entry(void *arg)
+{
+    for (int i = 0; i < NUM_ITERS; i++) {
+        pthread_spin_lock(&spin);
+        spin_count++;
+        pthread_spin_unlock(&spin);
+    }
+    return NULL;
+}
+
+static void test_spin(void)
+{
+    pthread_spin_init(&spin, PTHREAD_PROCESS_PRIVATE);
+    run_tasks(spin_entry);
+    if (spin_count != NUM_ITERS * NUM_TASKS)
+        fail("spin");
+    pthread_spin_destroy(&spin);
+    puts("(C)Pthread spin OK");
+}
+
+static void once_routine(void)
+{
+    once_count++;
+}
+
+static void *once_entry(void *arg)
+{
+    pthread_once(&once, once_routine);
+    return NULL;
+}
+
+static void test_once(void)
+{
+    run_tasks(once_entry);
+    if (once_count != 1)
+        fail("once");
+    puts("(C)Pthread once OK");
+}
+
+int main()
+{
+    test_cond();
+    test_rwlock(PTHREAD_RWLOCK_PREFER_READER_NP, "prefer reader");
+    test_rwlock(PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP, "prefer writer");
+    test_barrier();
+    test_spin();
+    test_once();
+    puts("(C)Pthread sync tests run OK!");
+    return 0;
+}
@@ -5,9 +5,10 @@
 extern crate libax;
 extern crate alloc;
 
+use alloc::boxed::Box;
 use alloc::collections::BTreeMap;
 use alloc::vec::Vec;
-use libax::rand;
+use libax::{rand, thread};
 
 fn test_vec() {
     const N: usize = 1_000_000;
@@ -38,10 +39,57 @@ fn test_btree_map() {
     println!("test_btree_map() OK!");
 }
 
+/// Measures the throughput of small allocations and deallocations with 1 and
+/// `NUM_TASKS` tasks. It should scale with the number of CPUs, as each CPU
+/// allocates from its own magazines.
+fn bench_alloc_free() {
+    const NUM_TASKS: usize = 4;
+    const NUM_ROUNDS: usize = 10_000;
+    const BATCH: usize = 64;
+
+    fn alloc_free() {
+        let mut boxes = Vec::with_capacity(BATCH);
+        for _ in 0..NUM_ROUNDS {
+            for i in 0..BATCH {
+                // sizes from 64 to 4096 bytes
+                boxes.push(match i % 4 {
+                    0 => Box::new([0u8; 64]) as Box<[u8]>,
+                    1 => Box::new([0u8; 256]),
+                    2 => Box::new([0u8; 1024]),
+                    _ => Box::new([0u8; 4096]),
+                });
+            }
+            boxes.clear();
+        }
+    }
+
+    for num_tasks in [1, NUM_TASKS] {
+        let start_time = libax::time::Instant::now();
+        let tasks = (0..num_tasks)
+            .map(|_| thread::spawn(alloc_free))
+            .collect::<Vec<_>>();
+        for t in tasks {
+            t.join().unwrap();
+        }
+
+        let elapsed_us = start_time.elapsed().as_micros().max(1) as u64;
+        let ops = (num_tasks * NUM_ROUNDS * BATCH) as u64;
+        println!(
+            "alloc bench: {} tasks, {} allocs + frees in {} us, {} ops/s",
+            num_tasks,
+            ops,
+            elapsed_us,
+            ops * 1_000_000 / elapsed_us
+        );
+    }
+}
+
 #[no_mangle]
 fn main() {
     println!("Running memory tests...");
     test_vec();
     test_btree_map();
     println!("Memory tests run OK!");
+
+    bench_alloc_free();
 }
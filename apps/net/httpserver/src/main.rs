@@ -13,9 +13,10 @@
 extern crate libax;
 extern crate alloc;
 
+use alloc::boxed::Box;
 use core::str::FromStr;
 
-use libax::io::{self, prelude::*};
+use libax::io;
 use libax::net::{IpAddr, TcpListener, TcpStream};
 use libax::thread;
 
@@ -50,12 +51,21 @@ const CONTENT: &str = r#"<html>
 </html>
 "#;
 
-fn http_server(mut stream: TcpStream) -> io::Result {
-    let mut buf = [0u8; 1024];
-    stream.read(&mut buf)?;
+fn http_server(mut stream: TcpStream, response: &[u8]) -> io::Result {
+    // The request is not parsed, consume it in the socket buffer in place.
+    stream.read_with(|req| Ok(req.len()))?;
 
-    let reponse = alloc::format!(header!(), CONTENT.len(), CONTENT);
-    stream.write_all(reponse.as_bytes())?;
+    // Copy the response into the socket buffer in place, which may take
+    // several writes if the free space wraps around the ring buffer.
+    let mut written = 0;
+    while written < response.len() {
+        let len = stream.write_with(|buf| {
+            let len = buf.len().min(response.len() - written);
+            buf[..len].copy_from_slice(&response[written..written + len]);
+            Ok(len)
+        })?;
+        written += len;
+    }
 
     Ok(())
 }
@@ -65,12 +75,16 @@ fn accept_loop() -> io::Result {
     let mut listener = TcpListener::bind((addr, port).into())?;
     println!("listen on: http://{}/", listener.local_addr().unwrap());
 
+    // The response is the same for all requests, so it's only formatted once.
+    let response: &'static str =
+        Box::leak(alloc::format!(header!(), CONTENT.len(), CONTENT).into_boxed_str());
+
     let mut i = 0;
     loop {
         match listener.accept() {
             Ok((stream, addr)) => {
                 info!("new client {}: {}", i, addr);
-                thread::spawn(move || match http_server(stream) {
+                thread::spawn(move || match http_server(stream, response.as_bytes()) {
                     Err(e) => error!("client connection error: {:?}", e),
                     Ok(()) => info!("client {} closed successfully", i),
                 });
@@ -0,0 +1,82 @@
+#![no_std]
+#![no_main]
+
+extern crate alloc;
+#[macro_use]
+extern crate libax;
+
+use alloc::vec::Vec;
+use core::hint::black_box;
+
+use libax::sync::{mutex_stats, Mutex};
+use libax::thread;
+
+const NUM_TASKS: usize = 8;
+const NUM_ITERS: usize = 20_000;
+
+static COUNTER: Mutex<usize> = Mutex::new(0);
+
+/// Spins for a while to simulate some work, inside or outside the lock.
+fn work(n: usize) {
+    for i in 0..n {
+        black_box(i);
+    }
+}
+
+/// Measures the throughput of a mutex contended by [`NUM_TASKS`] tasks, each
+/// holding it for `hold` units of work and doing `think` units of work
+/// between two locks. A task yields the CPU while holding the lock every
+/// `yield_every` iterations, so that others have to sleep on it.
+fn bench_mutex(name: &str, hold: usize, think: usize, yield_every: usize) {
+    let start_stats = mutex_stats();
+    let start_count = *COUNTER.lock();
+    let start_time = libax::time::Instant::now();
+
+    let tasks = (0..NUM_TASKS)
+        .map(|_| {
+            thread::spawn(move || {
+                for i in 0..NUM_ITERS {
+                    let mut count = COUNTER.lock();
+                    *count += 1;
+                    work(hold);
+                    if yield_every != 0 && i % yield_every == 0 {
+                        thread::yield_now();
+                    }
+                    drop(count);
+                    work(think);
+                }
+            })
+        })
+        .collect::<Vec<_>>();
+    for t in tasks {
+        t.join().unwrap();
+    }
+
+    let elapsed_us = start_time.elapsed().as_micros().max(1) as u64;
+    let locks = (NUM_TASKS * NUM_ITERS) as u64;
+    assert_eq!(*COUNTER.lock() - start_count, locks as usize);
+
+    let stats = mutex_stats();
+    println!(
+        "mutex bench ({}): {} locks in {} us, {} locks/s",
+        name,
+        locks,
+        elapsed_us,
+        locks * 1_000_000 / elapsed_us
+    );
+    println!(
+        "  contended: {}, spin acquired: {}, parked: {}, handoffs: {}",
+        stats.contended - start_stats.contended,
+        stats.spin_acquired - start_stats.spin_acquired,
+        stats.parked - start_stats.parked,
+        stats.handoffs - start_stats.handoffs,
+    );
+}
+
+#[no_mangle]
+fn main() {
+    bench_mutex("short", 10, 100, 0);
+    bench_mutex("long", 1000, 100, 0);
+    bench_mutex("sleep", 10, 100, 64);
+    println!("Mutex tests run OK!");
+}
@@ -24,6 +24,40 @@ fn barrier() {
     BARRIER_WQ.notify_all(true);
 }
 
+/// Measures the scheduler throughput: every task yields the CPU and spawns
+/// short-lived tasks repeatedly. It should scale with the number of CPUs, as
+/// each CPU schedules tasks from its own run queue.
+fn bench_sched() {
+    const NUM_YIELDS: usize = 10_000;
+    const NUM_SPAWNS: usize = 1_000;
+
+    let start_time = libax::time::Instant::now();
+    let tasks = (0..NUM_TASKS)
+        .map(|_| {
+            thread::spawn(|| {
+                for _ in 0..NUM_YIELDS {
+                    thread::yield_now();
+                }
+                for _ in 0..NUM_SPAWNS {
+                    thread::spawn(|| {}).join().unwrap();
+                }
+            })
+        })
+        .collect::<Vec<_>>();
+    for t in tasks {
+        t.join().unwrap();
+    }
+
+    let elapsed_us = start_time.elapsed().as_micros().max(1) as u64;
+    let ops = (NUM_TASKS * (NUM_YIELDS + NUM_SPAWNS)) as u64;
+    println!(
+        "sched bench: {} yields + spawns in {} us, {} ops/s",
+        ops,
+        elapsed_us,
+        ops * 1_000_000 / elapsed_us
+    );
+}
+
 fn sqrt(n: &u64) -> u64 {
     let mut x = *n;
     loop {
@@ -76,4 +110,6 @@ fn main() {
 
     println!("Parallel summation tests run OK!");
     println!("{} ms elapsed", start_time.elapsed().as_millis());
+
+    bench_sched();
 }
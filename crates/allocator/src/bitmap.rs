@@ -73,7 +73,24 @@ impl<const PAGE_SIZE: usize> PageAllocator for BitmapPageAllocator<PAGE_SIZE> {
     fn dealloc_pages(&mut self, pos: usize, num_pages: usize) {
         // TODO: not decrease `used_pages` if deallocation failed
         self.used_pages -= num_pages;
-        self.inner.dealloc((pos - self.base) / PAGE_SIZE)
+        let start = (pos - self.base) / PAGE_SIZE;
+        self.inner.insert(start..start + num_pages)
+    }
+
+    fn alloc_pages_at(&mut self, pos: usize, num_pages: usize) -> AllocResult {
+        if pos % PAGE_SIZE != 0 || pos < self.base {
+            return Err(AllocError::InvalidParam);
+        }
+        let start = (pos - self.base) / PAGE_SIZE;
+        if start + num_pages > self.total_pages {
+            return Err(AllocError::NoMemory);
+        }
+        if !(start..start + num_pages).all(|idx| self.inner.test(idx)) {
+            return Err(AllocError::NoMemory);
+        }
+        self.inner.remove(start..start + num_pages);
+        self.used_pages += num_pages;
+        Ok(())
     }
 
     fn total_pages(&self) -> usize {
@@ -73,6 +73,10 @@ pub trait PageAllocator: BaseAllocator {
     /// Deallocate contiguous memory pages with given position and count.
     fn dealloc_pages(&mut self, pos: usize, num_pages: usize);
 
+    /// Allocate contiguous memory pages at the given position, fails if any
+    /// of them is not free.
+    fn alloc_pages_at(&mut self, pos: usize, num_pages: usize) -> AllocResult;
+
     /// Returns the total number of memory pages.
     fn total_pages(&self) -> usize;
 
@@ -19,6 +19,13 @@ impl SlabByteAllocator {
         Self { inner: None }
     }
 
+    /// Returns the number of bytes that can be used in a region allocated
+    /// with the given size and alignment, which is at least `size`.
+    pub fn usable_size(&self, size: usize, align_pow2: usize) -> usize {
+        let layout = Layout::from_size_align(size, align_pow2).unwrap();
+        self.inner().usable_size(layout).1
+    }
+
     fn inner_mut(&mut self) -> &mut Heap {
         self.inner.as_mut().unwrap()
     }
@@ -31,6 +31,125 @@ pub trait BlockDriverOps: BaseDriverOps {
     /// contiguous blocks will be written.
     fn write_block(&mut self, block_id: u64, buf: &[u8]) -> DevResult;
 
+    /// Reads contiguous blocks starting from `start_block`.
+    ///
+    /// The size of the buffer must be a multiple of the block size. The default
+    /// implementation reads the blocks one by one, drivers that can transfer
+    /// several blocks in one request should override it.
+    fn read_blocks(&mut self, start_block: u64, buf: &mut [u8]) -> DevResult {
+        let block_size = self.block_size();
+        if buf.len() % block_size != 0 {
+            return Err(DevError::InvalidParam);
+        }
+        for (i, chunk) in buf.chunks_exact_mut(block_size).enumerate() {
+            self.read_block(start_block + i as u64, chunk)?;
+        }
+        Ok(())
+    }
+
+    /// Writes contiguous blocks starting from `start_block`.
+    ///
+    /// The size of the buffer must be a multiple of the block size. The default
+    /// implementation writes the blocks one by one, drivers that can transfer
+    /// several blocks in one request should override it.
+    fn write_blocks(&mut self, start_block: u64, buf: &[u8]) -> DevResult {
+        let block_size = self.block_size();
+        if buf.len() % block_size != 0 {
+            return Err(DevError::InvalidParam);
+        }
+        for (i, chunk) in buf.chunks_exact(block_size).enumerate() {
+            self.write_block(start_block + i as u64, chunk)?;
+        }
+        Ok(())
+    }
+
+    /// Reads contiguous blocks starting from `start_block`, scattering them into
+    /// the buffers in order.
+    ///
+    /// The size of each buffer must be a multiple of the block size. The default
+    /// implementation calls [`read_blocks`](Self::read_blocks) for each buffer.
+    fn read_blocks_vectored(&mut self, start_block: u64, bufs: &mut [&mut [u8]]) -> DevResult {
+        let mut block_id = start_block;
+        for buf in bufs.iter_mut() {
+            self.read_blocks(block_id, buf)?;
+            block_id += (buf.len() / self.block_size()) as u64;
+        }
+        Ok(())
+    }
+
+    /// Writes contiguous blocks starting from `start_block`, gathering them from
+    /// the buffers in order.
+    ///
+    /// The size of each buffer must be a multiple of the block size. The default
+    /// implementation calls [`write_blocks`](Self::write_blocks) for each
+    /// buffer.
+    fn write_blocks_vectored(&mut self, start_block: u64, bufs: &[&[u8]]) -> DevResult {
+        let mut block_id = start_block;
+        for buf in bufs {
+            self.write_blocks(block_id, buf)?;
+            block_id += (buf.len() / self.block_size()) as u64;
+        }
+        Ok(())
+    }
+
     /// Flushes the device to write all pending data to the storage.
     fn flush(&mut self) -> DevResult;
+
+    /// Acknowledges an interrupt from the device, returns `true` if there was
+    /// an interrupt pending.
+    fn ack_interrupt(&mut self) -> bool {
+        false
+    }
+
+    /// Submits a request to read contiguous blocks starting from
+    /// `start_block` into `buf`, and returns the request ID immediately
+    /// without waiting for it to complete.
+    ///
+    /// Completed requests are retrieved by [`poll_request`]. Returns an error
+    /// with type [`DevError::Again`] if the request queue is full, or
+    /// [`DevError::Unsupported`] if the device only supports synchronous
+    /// requests, which is the default. Some devices (e.g., virtio-blk) only
+    /// transfer one block per request, and return [`DevError::InvalidParam`]
+    /// if `buf` is larger.
+    ///
+    /// Synchronous requests (e.g., [`read_blocks`]) should not be issued while
+    /// there are asynchronous requests in flight.
+    ///
+    /// # Safety
+    ///
+    /// `buf` must stay valid and must not be accessed until the request is
+    /// retrieved by [`poll_request`].
+    ///
+    /// [`poll_request`]: BlockDriverOps::poll_request
+    /// [`read_blocks`]: BlockDriverOps::read_blocks
+    unsafe fn submit_read_blocks(
+        &mut self,
+        _start_block: u64,
+        _buf: &mut [u8],
+    ) -> DevResult<usize> {
+        Err(DevError::Unsupported)
+    }
+
+    /// Submits a request to write contiguous blocks starting from
+    /// `start_block` from `buf`, and returns the request ID immediately
+    /// without waiting for it to complete.
+    ///
+    /// See [`submit_read_blocks`] for details.
+    ///
+    /// # Safety
+    ///
+    /// `buf` must stay valid and must not be modified until the request is
+    /// retrieved by [`poll_request`].
+    ///
+    /// [`submit_read_blocks`]: BlockDriverOps::submit_read_blocks
+    /// [`poll_request`]: BlockDriverOps::poll_request
+    unsafe fn submit_write_blocks(&mut self, _start_block: u64, _buf: &[u8]) -> DevResult<usize> {
+        Err(DevError::Unsupported)
+    }
+
+    /// Retrieves a completed asynchronous request, returns its ID and result,
+    /// or [`None`] if no request has completed yet. It does not block.
+    fn poll_request(&mut self) -> Option<(usize, DevResult)> {
+        None
+    }
 }
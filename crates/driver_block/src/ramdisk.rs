@@ -3,16 +3,29 @@
 extern crate alloc;
 
 use crate::BlockDriverOps;
-use alloc::{vec, vec::Vec};
+use alloc::{collections::VecDeque, vec, vec::Vec};
+use core::ops::Range;
 use driver_common::{BaseDriverOps, DevError, DevResult, DeviceType};
 
 const BLOCK_SIZE: usize = 512;
 
+/// Maximum number of asynchronous requests in flight.
+const MAX_IN_FLIGHT: usize = 4;
+
 /// A RAM disk that stores data in a vector.
+///
+/// Asynchronous requests are done at once, and retrieved in order by
+/// [`poll_request`]. Like virtio-blk, each of them transfers only one block,
+/// and at most [`MAX_IN_FLIGHT`] of them can be in flight.
+///
+/// [`poll_request`]: BlockDriverOps::poll_request
 #[derive(Default)]
 pub struct RamDisk {
     size: usize,
     data: Vec<u8>,
+    /// Asynchronous requests done but not retrieved, with their IDs.
+    done: VecDeque<(usize, DevResult)>,
+    next_id: usize,
 }
 
 impl RamDisk {
@@ -25,6 +38,7 @@ impl RamDisk {
         Self {
             size,
             data: vec![0; size],
+            ..Default::default()
         }
     }
 
@@ -36,13 +50,45 @@ impl RamDisk {
         let size = align_up(buf.len());
         let mut data = vec![0; size];
         data[..buf.len()].copy_from_slice(buf);
-        Self { size, data }
+        Self {
+            size,
+            data,
+            ..Default::default()
+        }
     }
 
     /// Returns the size of the RAM disk in bytes.
     pub const fn size(&self) -> usize {
         self.size
     }
+
+    /// Returns the byte range of `len` bytes from `start_block`, or an error if
+    /// it's out of bounds or not block-aligned.
+    fn byte_range(&self, start_block: u64, len: usize) -> DevResult<Range<usize>> {
+        let offset = start_block as usize * BLOCK_SIZE;
+        if offset + len > self.size {
+            return Err(DevError::Io);
+        }
+        if len % BLOCK_SIZE != 0 {
+            return Err(DevError::InvalidParam);
+        }
+        Ok(offset..offset + len)
+    }
+
+    /// Does an asynchronous request of one block by `f`, and queues its result.
+    fn submit(&mut self, len: usize, f: impl FnOnce(&mut Self) -> DevResult) -> DevResult<usize> {
+        if len != BLOCK_SIZE {
+            return Err(DevError::InvalidParam);
+        }
+        if self.done.len() >= MAX_IN_FLIGHT {
+            return Err(DevError::Again);
+        }
+        let id = self.next_id;
+        self.next_id = self.next_id.wrapping_add(1);
+        let res = f(self);
+        self.done.push_back((id, res));
+        Ok(id)
+    }
 }
 
 impl const BaseDriverOps for RamDisk {
@@ -67,32 +113,66 @@ impl BlockDriverOps for RamDisk {
     }
 
     fn read_block(&mut self, block_id: u64, buf: &mut [u8]) -> DevResult {
-        let offset = block_id as usize * BLOCK_SIZE;
-        if offset + buf.len() > self.size {
-            return Err(DevError::Io);
-        }
-        if buf.len() % BLOCK_SIZE != 0 {
+        self.read_blocks(block_id, buf)
+    }
+
+    fn write_block(&mut self, block_id: u64, buf: &[u8]) -> DevResult {
+        self.write_blocks(block_id, buf)
+    }
+
+    fn read_blocks(&mut self, start_block: u64, buf: &mut [u8]) -> DevResult {
+        let range = self.byte_range(start_block, buf.len())?;
+        buf.copy_from_slice(&self.data[range]);
+        Ok(())
+    }
+
+    fn write_blocks(&mut self, start_block: u64, buf: &[u8]) -> DevResult {
+        let range = self.byte_range(start_block, buf.len())?;
+        self.data[range].copy_from_slice(buf);
+        Ok(())
+    }
+
+    fn read_blocks_vectored(&mut self, start_block: u64, bufs: &mut [&mut [u8]]) -> DevResult {
+        if bufs.iter().any(|buf| buf.len() % BLOCK_SIZE != 0) {
             return Err(DevError::InvalidParam);
         }
-        buf.copy_from_slice(&self.data[offset..offset + buf.len()]);
+        let total_len = bufs.iter().map(|buf| buf.len()).sum();
+        let mut offset = self.byte_range(start_block, total_len)?.start;
+        for buf in bufs.iter_mut() {
+            buf.copy_from_slice(&self.data[offset..offset + buf.len()]);
+            offset += buf.len();
+        }
         Ok(())
     }
 
-    fn write_block(&mut self, block_id: u64, buf: &[u8]) -> DevResult {
-        let offset = block_id as usize * BLOCK_SIZE;
-        if offset + buf.len() > self.size {
-            return Err(DevError::Io);
-        }
-        if buf.len() % BLOCK_SIZE != 0 {
+    fn write_blocks_vectored(&mut self, start_block: u64, bufs: &[&[u8]]) -> DevResult {
+        if bufs.iter().any(|buf| buf.len() % BLOCK_SIZE != 0) {
             return Err(DevError::InvalidParam);
         }
-        self.data[offset..offset + buf.len()].copy_from_slice(buf);
+        let total_len = bufs.iter().map(|buf| buf.len()).sum();
+        let mut offset = self.byte_range(start_block, total_len)?.start;
+        for buf in bufs {
+            self.data[offset..offset + buf.len()].copy_from_slice(buf);
+            offset += buf.len();
+        }
         Ok(())
     }
 
     fn flush(&mut self) -> DevResult {
         Ok(())
     }
+
+    unsafe fn submit_read_blocks(&mut self, start_block: u64, buf: &mut [u8]) -> DevResult<usize> {
+        self.submit(buf.len(), |disk| disk.read_blocks(start_block, buf))
+    }
+
+    unsafe fn submit_write_blocks(&mut self, start_block: u64, buf: &[u8]) -> DevResult<usize> {
+        self.submit(buf.len(), |disk| disk.write_blocks(start_block, buf))
+    }
+
+    fn poll_request(&mut self) -> Option<(usize, DevResult)> {
+        self.done.pop_front()
+    }
 }
 
 const fn align_up(val: usize) -> usize {
@@ -61,4 +61,10 @@ pub trait BaseDriverOps: Send + Sync {
 
     /// The type of the device.
     fn device_type(&self) -> DeviceType;
+
+    /// The IRQ number of the device, or [`None`] if the device does not
+    /// support interrupts (or its IRQ is unknown).
+    fn irq_num(&self) -> Option<usize> {
+        None
+    }
 }
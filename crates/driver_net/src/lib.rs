@@ -9,11 +9,34 @@ mod net_buf;
 #[doc(no_inline)]
 pub use driver_common::{BaseDriverOps, DevError, DevResult, DeviceType};
 
-pub use self::net_buf::{NetBuffer, NetBufferBox, NetBufferPool};
+pub use self::net_buf::{NetBuffer, NetBufferBox, NetBufferPool, NetBufferPoolStats};
 
 /// The ethernet address of the NIC (MAC address).
 pub struct EthernetAddress(pub [u8; 6]);
 
+/// Work that a NIC can do in place of the network stack.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct NetOffloads {
+    /// Whether the NIC verifies the IPv4, TCP and UDP checksums of received
+    /// packets, and drops the bad ones.
+    pub rx_checksum: bool,
+    /// Whether the NIC fills the IPv4, TCP and UDP checksums of transmitted
+    /// packets, which are left zero by the stack.
+    pub tx_checksum: bool,
+    /// The maximum length of an Ethernet frame (without the FCS) that can be
+    /// transmitted or received in one buffer.
+    pub max_frame_len: usize,
+}
+
+impl NetOffloads {
+    /// No offloads, with the standard Ethernet MTU of 1500 bytes.
+    pub const NONE: Self = Self {
+        rx_checksum: false,
+        tx_checksum: false,
+        max_frame_len: 1514,
+    };
+}
+
 /// Operations that require a network device (NIC) driver to implement.
 ///
 /// `'a` indicates the lifetime of the network buffers.
@@ -33,6 +56,16 @@ pub trait NetDriverOps<'a>: BaseDriverOps {
     /// Size of the transmit queue.
     fn tx_queue_size(&self) -> usize;
 
+    /// Acknowledges an interrupt from the device, returns `true` if there was
+    /// an interrupt pending.
+    fn ack_interrupt(&mut self) -> bool;
+
+    /// The offloads enabled on the device, which the network stack can rely
+    /// on. The default implementation reports [`NetOffloads::NONE`].
+    fn offloads(&self) -> NetOffloads {
+        NetOffloads::NONE
+    }
+
     /// Fills the receive queue with buffers.
     ///
     /// It should be called once when the driver is initialized.
@@ -49,11 +82,23 @@ pub trait NetDriverOps<'a>: BaseDriverOps {
     /// [`NetDriverOps::receive`].
     fn recycle_rx_buffer(&mut self, rx_buf: NetBufferBox<'a>) -> DevResult;
 
-    /// Transmits a packet in the buffer to the network, and blocks until the
-    /// request completed.
+    /// Reclaims the buffers of the completed transmit requests, and releases
+    /// them back to their pool.
+    ///
+    /// It does not block, and should be called periodically (e.g., before
+    /// transmitting) to keep the transmit queue from being full.
+    fn recycle_tx_buffers(&mut self) -> DevResult;
+
+    /// Submits a packet in the buffer to the transmit queue, and returns
+    /// immediately without waiting for the request to complete.
+    ///
+    /// The driver takes the ownership of `tx_buf` until the device has
+    /// consumed it, after which it is released by
+    /// [`NetDriverOps::recycle_tx_buffers`]. If the transmit queue is full,
+    /// returns an error with type [`DevError::Again`].
     ///
     /// `tx_buf` should be initialized by [`NetDriverOps::prepare_tx_buffer`].
-    fn transmit(&mut self, tx_buf: &NetBuffer) -> DevResult;
+    fn transmit(&mut self, tx_buf: NetBuffer<'a>) -> DevResult;
 
     /// Receives a packet from the network and store it in the [`NetBuffer`],
     /// returns the buffer.
@@ -3,7 +3,7 @@ extern crate alloc;
 use crate::{DevError, DevResult};
 use alloc::{boxed::Box, vec, vec::Vec};
 use core::ptr::NonNull;
-use spin::Mutex;
+use core::sync::atomic::{AtomicU32, AtomicU64, AtomicUsize, Ordering};
 
 const MIN_BUFFER_LEN: usize = 1526;
 const MAX_BUFFER_LEN: usize = 65535;
@@ -104,21 +104,106 @@ impl Drop for NetBuffer<'_> {
     }
 }
 
+/// A lock-free stack of the free buffers in a [`NetBufferPool`], linked by
+/// their indexes.
+struct FreeList {
+    /// The index of the top buffer in the low 32 bits, and a tag in the high
+    /// 32 bits that is bumped by every pop, so that a pop racing with others
+    /// that pop and push back the same top buffer fails (the ABA problem).
+    head: AtomicU64,
+    /// The index of the buffer below each free buffer.
+    next: Box<[AtomicU32]>,
+}
+
+impl FreeList {
+    const NIL: u32 = u32::MAX;
+    const INDEX_MASK: u64 = 0xffff_ffff;
+    const TAG_ONE: u64 = 1 << 32;
+
+    /// Creates a list with buffers `0..len` free, the lowest on top.
+    fn new(len: usize) -> Self {
+        let next = (0..len)
+            .map(|i| AtomicU32::new(if i + 1 < len { i as u32 + 1 } else { Self::NIL }))
+            .collect();
+        Self {
+            head: AtomicU64::new(if len > 0 { 0 } else { Self::NIL as u64 }),
+            next,
+        }
+    }
+
+    fn pop(&self) -> Option<usize> {
+        let mut head = self.head.load(Ordering::Acquire);
+        loop {
+            let idx = (head & Self::INDEX_MASK) as u32;
+            if idx == Self::NIL {
+                return None;
+            }
+            // May be stale if `idx` is taken by others, then the CAS fails.
+            let next = self.next[idx as usize].load(Ordering::Relaxed);
+            let new_head = ((head & !Self::INDEX_MASK).wrapping_add(Self::TAG_ONE)) | next as u64;
+            match self.head.compare_exchange_weak(
+                head,
+                new_head,
+                Ordering::Acquire,
+                Ordering::Acquire,
+            ) {
+                Ok(_) => return Some(idx as usize),
+                Err(h) => head = h,
+            }
+        }
+    }
+
+    fn push(&self, idx: usize) {
+        let mut head = self.head.load(Ordering::Relaxed);
+        loop {
+            self.next[idx].store((head & Self::INDEX_MASK) as u32, Ordering::Relaxed);
+            let new_head = (head & !Self::INDEX_MASK) | idx as u64;
+            match self.head.compare_exchange_weak(
+                head,
+                new_head,
+                Ordering::Release,
+                Ordering::Relaxed,
+            ) {
+                Ok(_) => return,
+                Err(h) => head = h,
+            }
+        }
+    }
+}
+
+/// Statistics of a [`NetBufferPool`].
+#[derive(Debug, Clone, Copy, Default)]
+pub struct NetBufferPoolStats {
+    /// Total number of buffers.
+    pub capacity: usize,
+    /// Number of buffers allocated now.
+    pub in_use: usize,
+    /// Maximum number of buffers that have been allocated at the same time.
+    pub high_water: usize,
+    /// Number of allocations failed because all buffers were in use.
+    pub alloc_failures: usize,
+}
+
 /// A pool of [`NetBuffer`]s to speed up buffer allocation.
 ///
-/// It divides a large memory into several equal parts for each buffer.
+/// It divides a large memory into several equal parts for each buffer. The
+/// free buffers are kept in a lock-free list, so that buffers can be
+/// allocated and released on all CPUs without contending for a lock.
 pub struct NetBufferPool {
     capacity: usize,
     buf_len: usize,
     pool: Vec<u8>,
-    free_list: Mutex<Vec<usize>>,
+    free_list: FreeList,
+    in_use: AtomicUsize,
+    high_water: AtomicUsize,
+    alloc_failures: AtomicUsize,
 }
 
 impl NetBufferPool {
     /// Creates a new pool with the given `capacity`, and all buffer lengths are
     /// set to `buf_len`.
     pub fn new(capacity: usize, buf_len: usize) -> DevResult<Self> {
-        if capacity == 0 {
+        if capacity == 0 || capacity >= FreeList::NIL as usize {
             return Err(DevError::InvalidParam);
         }
         if !(MIN_BUFFER_LEN..=MAX_BUFFER_LEN).contains(&buf_len) {
@@ -126,15 +211,14 @@ impl NetBufferPool {
         }
 
         let pool = vec![0; capacity * buf_len];
-        let mut free_list = Vec::with_capacity(capacity);
-        for i in 0..capacity {
-            free_list.push(i * buf_len);
-        }
         Ok(Self {
             capacity,
             buf_len,
             pool,
-            free_list: Mutex::new(free_list),
+            free_list: FreeList::new(capacity),
+            in_use: AtomicUsize::new(0),
+            high_water: AtomicUsize::new(0),
+            alloc_failures: AtomicUsize::new(0),
         })
     }
 
@@ -148,11 +232,27 @@ impl NetBufferPool {
         self.buf_len
     }
 
+    /// Returns the statistics of the pool.
+    pub fn stats(&self) -> NetBufferPoolStats {
+        NetBufferPoolStats {
+            capacity: self.capacity,
+            in_use: self.in_use.load(Ordering::Relaxed),
+            high_water: self.high_water.load(Ordering::Relaxed),
+            alloc_failures: self.alloc_failures.load(Ordering::Relaxed),
+        }
+    }
+
     /// Allocates a buffer from the pool.
     ///
     /// Returns `None` if no buffer is available.
     pub fn alloc(&self) -> Option<NetBuffer> {
-        let pool_offset = self.free_list.lock().pop()?;
+        let Some(idx) = self.free_list.pop() else {
+            self.alloc_failures.fetch_add(1, Ordering::Relaxed);
+            return None;
+        };
+        let in_use = self.in_use.fetch_add(1, Ordering::Relaxed) + 1;
+        self.high_water.fetch_max(in_use, Ordering::Relaxed);
+        let pool_offset = idx * self.buf_len;
         let buf_ptr =
             unsafe { NonNull::new(self.pool.as_ptr().add(pool_offset) as *mut u8).unwrap() };
         Some(NetBuffer {
@@ -177,6 +277,7 @@ impl NetBufferPool {
     /// `pool_offset` must be a multiple of `buf_len`.
     fn dealloc(&self, pool_offset: usize) {
         debug_assert_eq!(pool_offset % self.buf_len, 0);
-        self.free_list.lock().push(pool_offset);
+        self.in_use.fetch_sub(1, Ordering::Relaxed);
+        self.free_list.push(pool_offset / self.buf_len);
     }
 }
@@ -1,11 +1,27 @@
+extern crate alloc;
+
 use crate::as_dev_err;
+use alloc::{boxed::Box, collections::BTreeMap};
 use driver_block::BlockDriverOps;
-use driver_common::{BaseDriverOps, DevResult, DeviceType};
-use virtio_drivers::{device::blk::VirtIOBlk as InnerDev, transport::Transport, Hal};
+use driver_common::{BaseDriverOps, DevError, DevResult, DeviceType};
+use virtio_drivers::device::blk::{BlkReq, BlkResp, VirtIOBlk as InnerDev, SECTOR_SIZE};
+use virtio_drivers::{transport::Transport, Hal};
 
 /// The VirtIO block device driver.
 pub struct VirtIoBlkDev<H: Hal, T: Transport> {
     inner: InnerDev<H, T>,
+    irq_num: Option<usize>,
+    /// Asynchronous requests in flight, indexed by their tokens.
+    in_flight: BTreeMap<u16, InFlightRequest>,
+}
+
+/// An asynchronous request in flight. The request header and the response are
+/// boxed, so they stay at the same addresses until the request completes.
+struct InFlightRequest {
+    req: Box<BlkReq>,
+    resp: Box<BlkResp>,
+    buf: *mut [u8],
+    write: bool,
 }
 
 unsafe impl<H: Hal, T: Transport> Send for VirtIoBlkDev<H, T> {}
@@ -14,13 +30,25 @@ unsafe impl<H: Hal, T: Transport> Sync for VirtIoBlkDev<H, T> {}
 impl<H: Hal, T: Transport> VirtIoBlkDev<H, T> {
     /// Creates a new driver instance and initializes the device, or returns
     /// an error if any step fails.
-    pub fn try_new(transport: T) -> DevResult<Self> {
+    ///
+    /// `irq_num` is the IRQ number of the device, if its interrupts are wired.
+    pub fn try_new(transport: T, irq_num: Option<usize>) -> DevResult<Self> {
         Ok(Self {
             inner: InnerDev::new(transport).map_err(as_dev_err)?,
+            irq_num,
+            in_flight: BTreeMap::new(),
         })
     }
 }
 
+/// Like [`as_dev_err`], but reports a full queue as [`DevError::Again`].
+const fn as_submit_err(e: virtio_drivers::Error) -> DevError {
+    match e {
+        virtio_drivers::Error::QueueFull => DevError::Again,
+        e => as_dev_err(e),
+    }
+}
+
 impl<H: Hal, T: Transport> const BaseDriverOps for VirtIoBlkDev<H, T> {
     fn device_name(&self) -> &str {
         "virtio-blk"
@@ -29,6 +57,10 @@ impl<H: Hal, T: Transport> const BaseDriverOps for VirtIoBlkDev<H, T> {
     fn device_type(&self) -> DeviceType {
         DeviceType::Block
     }
+
+    fn irq_num(&self) -> Option<usize> {
+        self.irq_num
+    }
 }
 
 impl<H: Hal, T: Transport> BlockDriverOps for VirtIoBlkDev<H, T> {
@@ -39,9 +71,12 @@ impl<H: Hal, T: Transport> BlockDriverOps for VirtIoBlkDev<H, T> {
 
     #[inline]
     fn block_size(&self) -> usize {
-        virtio_drivers::device::blk::SECTOR_SIZE
+        SECTOR_SIZE
     }
 
+    // `read_blocks` and `write_blocks` are left to the default one request
+    // per block, as a request of `virtio-drivers` reads or writes a sector.
+
     fn read_block(&mut self, block_id: u64, buf: &mut [u8]) -> DevResult {
         self.inner
             .read_block(block_id as _, buf)
@@ -57,4 +92,72 @@ impl<H: Hal, T: Transport> BlockDriverOps for VirtIoBlkDev<H, T> {
     fn flush(&mut self) -> DevResult {
         Ok(())
     }
+
+    fn ack_interrupt(&mut self) -> bool {
+        self.inner.ack_interrupt()
+    }
+
+    unsafe fn submit_read_blocks(&mut self, start_block: u64, buf: &mut [u8]) -> DevResult<usize> {
+        // a request of `virtio-drivers` reads a sector
+        if buf.len() != SECTOR_SIZE {
+            return Err(DevError::InvalidParam);
+        }
+        let mut req = Box::<BlkReq>::default();
+        let mut resp = Box::<BlkResp>::default();
+        let token = self
+            .inner
+            .read_block_nb(start_block as _, &mut req, buf, &mut resp)
+            .map_err(as_submit_err)?;
+        self.in_flight.insert(
+            token,
+            InFlightRequest {
+                req,
+                resp,
+                buf,
+                write: false,
+            },
+        );
+        Ok(token as usize)
+    }
+
+    unsafe fn submit_write_blocks(&mut self, start_block: u64, buf: &[u8]) -> DevResult<usize> {
+        if buf.len() != SECTOR_SIZE {
+            return Err(DevError::InvalidParam);
+        }
+        let mut req = Box::<BlkReq>::default();
+        let mut resp = Box::<BlkResp>::default();
+        let token = self
+            .inner
+            .write_block_nb(start_block as _, &mut req, buf, &mut resp)
+            .map_err(as_submit_err)?;
+        self.in_flight.insert(
+            token,
+            InFlightRequest {
+                req,
+                resp,
+                buf: buf as *const [u8] as *mut [u8],
+                write: true,
+            },
+        );
+        Ok(token as usize)
+    }
+
+    fn poll_request(&mut self) -> Option<(usize, DevResult)> {
+        let token = self.inner.peek_used()?;
+        let Some(mut r) = self.in_flight.remove(&token) else {
+            return Some((token as usize, Err(DevError::BadState)));
+        };
+        // Safe because the request, response and buffer are the same ones
+        // passed on submission, and are still valid as the caller promised.
+        let res = unsafe {
+            if r.write {
+                self.inner
+                    .complete_write_block(token, &r.req, &*r.buf, &mut r.resp)
+            } else {
+                self.inner
+                    .complete_read_block(token, &r.req, &mut *r.buf, &mut r.resp)
+            }
+        };
+        Some((token as usize, res.map_err(as_dev_err)))
+    }
 }
@@ -8,7 +8,9 @@ use virtio_drivers::{device::net::VirtIONetRaw as InnerDev, transport::Transport
 /// `QS` is the VirtIO queue size.
 pub struct VirtIoNetDev<'a, H: Hal, T: Transport, const QS: usize> {
     rx_buffers: [Option<NetBufferBox<'a>>; QS],
+    tx_buffers: [Option<NetBuffer<'a>>; QS],
     inner: InnerDev<H, T, QS>,
+    irq_num: Option<usize>,
 }
 
 unsafe impl<H: Hal, T: Transport, const QS: usize> Send for VirtIoNetDev<'_, H, T, QS> {}
@@ -17,11 +19,20 @@ unsafe impl<H: Hal, T: Transport, const QS: usize> Sync for VirtIoNetDev<'_, H,
 impl<'a, H: Hal, T: Transport, const QS: usize> VirtIoNetDev<'a, H, T, QS> {
     /// Creates a new driver instance and initializes the device, or returns
     /// an error if any step fails.
-    pub fn try_new(transport: T) -> DevResult<Self> {
-        const NONE_BUF: Option<NetBufferBox> = None;
+    ///
+    /// `irq_num` is the IRQ number of the device, if its interrupts are wired.
+    pub fn try_new(transport: T, irq_num: Option<usize>) -> DevResult<Self> {
+        const NONE_RX_BUF: Option<NetBufferBox> = None;
+        const NONE_TX_BUF: Option<NetBuffer> = None;
         let inner = InnerDev::new(transport).map_err(as_dev_err)?;
-        let rx_buffers = [NONE_BUF; QS];
-        Ok(Self { rx_buffers, inner })
+        let rx_buffers = [NONE_RX_BUF; QS];
+        let tx_buffers = [NONE_TX_BUF; QS];
+        Ok(Self {
+            rx_buffers,
+            tx_buffers,
+            inner,
+            irq_num,
+        })
     }
 }
 
@@ -33,6 +44,10 @@ impl<H: Hal, T: Transport, const QS: usize> const BaseDriverOps for VirtIoNetDev
     fn device_type(&self) -> DeviceType {
         DeviceType::Net
     }
+
+    fn irq_num(&self) -> Option<usize> {
+        self.irq_num
+    }
 }
 
 impl<'a, H: Hal, T: Transport, const QS: usize> NetDriverOps<'a> for VirtIoNetDev<'a, H, T, QS> {
@@ -61,6 +76,11 @@ impl<'a, H: Hal, T: Transport, const QS: usize> NetDriverOps<'a> for VirtIoNetDe
         QS
     }
 
+    #[inline]
+    fn ack_interrupt(&mut self) -> bool {
+        self.inner.ack_interrupt()
+    }
+
     fn fill_rx_buffers(&mut self, buf_pool: &'a NetBufferPool) -> DevResult {
         for (i, rx_buf_place) in self.rx_buffers.iter_mut().enumerate() {
             let mut rx_buf = buf_pool.alloc_boxed().ok_or(DevError::NoMemory)?;
@@ -98,18 +118,52 @@ impl<'a, H: Hal, T: Transport, const QS: usize> NetDriverOps<'a> for VirtIoNetDe
                 .map_err(as_dev_err)?
         };
         // `rx_buffers[new_token]` is expected to be `None` since it was taken
-        // away at `Self::receive()` and has not been added back.
-        if self.rx_buffers[new_token as usize].is_some() {
+        // away at `Self::receive()` and has not been added back. Either way,
+        // the device owns `rx_buf` now, so it must be kept in the slot; the
+        // stale buffer's token has been reused, so the device is done with it.
+        let stale = self.rx_buffers[new_token as usize].replace(rx_buf);
+        if stale.is_some() {
             return Err(DevError::BadState);
         }
-        self.rx_buffers[new_token as usize] = Some(rx_buf);
         Ok(())
     }
 
-    fn transmit(&mut self, tx_buf: &NetBuffer) -> DevResult {
-        self.inner
-            .transmit_wait(tx_buf.packet_with_header())
-            .map_err(as_dev_err)?;
+    fn recycle_tx_buffers(&mut self) -> DevResult {
+        while let Some(token) = self.inner.poll_transmit() {
+            let tx_buf = self.tx_buffers[token as usize]
+                .take()
+                .ok_or(DevError::BadState)?;
+            // Safe because the buffer is the same one passed to `transmit_begin`.
+            unsafe {
+                self.inner
+                    .transmit_complete(token, tx_buf.packet_with_header())
+                    .map_err(as_dev_err)?;
+            }
+            // `tx_buf` is dropped here and goes back to its pool.
+        }
+        Ok(())
+    }
+
+    fn transmit(&mut self, tx_buf: NetBuffer<'a>) -> DevResult {
+        if !self.inner.can_transmit() {
+            return Err(DevError::Again);
+        }
+        // Safe because we keep the ownership of `tx_buf` in `tx_buffers`
+        // until the device has consumed it in `Self::recycle_tx_buffers()`.
+        let token = unsafe {
+            self.inner
+                .transmit_begin(tx_buf.packet_with_header())
+                .map_err(as_dev_err)?
+        };
+        // `tx_buffers[token]` is expected to be `None` since it was taken
+        // away when the previous request on it completed. Either way, the
+        // device may be reading `tx_buf` now, so it must be kept in the slot;
+        // the stale buffer's token has been reused, so the device is done
+        // with it.
+        let stale = self.tx_buffers[token as usize].replace(tx_buf);
+        if stale.is_some() {
+            return Err(DevError::BadState);
+        }
         Ok(())
     }
 
@@ -1,16 +1,29 @@
-use alloc::{collections::BTreeMap, sync::Arc};
+use alloc::sync::Arc;
+use core::marker::PhantomData;
 use core::ops::Deref;
-use core::sync::atomic::{AtomicIsize, Ordering};
+use core::sync::atomic::{AtomicIsize, AtomicU64, Ordering};
 
+use crate::rbtree::{RbAdapter, RbLinks, RbTree};
 use crate::BaseScheduler;
 
+/// The clock used by the [`CFScheduler`] to measure the running time of
+/// tasks.
+pub trait SchedClock {
+    /// Returns the current time in nanoseconds, which must be monotonic.
+    fn now_ns() -> u64;
+}
+
 /// task for CFS
 pub struct CFSTask<T> {
     inner: T,
-    init_vruntime: AtomicIsize,
-    delta: AtomicIsize,
+    /// Virtual running time in nanoseconds, i.e., the running time weighted
+    /// by the nice value.
+    vruntime: AtomicU64,
+    /// Time when the task started running, or its running time was last
+    /// accounted.
+    exec_start: AtomicU64,
     nice: AtomicIsize,
-    id: AtomicIsize,
+    links: RbLinks<Self>,
 }
 
 // https://elixir.bootlin.com/linux/latest/source/include/linux/sched/prio.h
@@ -28,15 +41,30 @@ const NICE2WEIGHT_NEG: [isize; NICE_RANGE_NEG + 1] = [
     29154, 36291, 46273, 56483, 71755, 88761,
 ];
 
+/// Weight of nice 0 (`NICE_0_LOAD` in Linux).
+const NICE_0_WEIGHT: u64 = 1024;
+
+// https://elixir.bootlin.com/linux/latest/source/kernel/sched/fair.c
+
+/// Minimum time a task runs before it is preempted by the tick
+/// (`sysctl_sched_min_granularity` in Linux).
+const MIN_GRANULARITY_NS: u64 = 3_000_000;
+/// How much less vruntime a woken task must have to preempt the current one
+/// (`sysctl_sched_wakeup_granularity` in Linux).
+const WAKEUP_GRANULARITY_NS: u64 = 1_000_000;
+/// Maximum vruntime credit of a task woken up after sleeping, so that it runs
+/// soon without starving the others (`GENTLE_FAIR_SLEEPERS` in Linux).
+const SLEEPER_CREDIT_NS: u64 = 3_000_000;
+
 impl<T> CFSTask<T> {
     /// new with default values
     pub const fn new(inner: T) -> Self {
         Self {
             inner,
-            init_vruntime: AtomicIsize::new(0_isize),
-            delta: AtomicIsize::new(0_isize),
+            vruntime: AtomicU64::new(0),
+            exec_start: AtomicU64::new(0),
             nice: AtomicIsize::new(0_isize),
-            id: AtomicIsize::new(0_isize),
+            links: RbLinks::new(),
         }
     }
 
@@ -49,39 +77,29 @@ impl<T> CFSTask<T> {
         }
     }
 
-    fn get_id(&self) -> isize {
-        self.id.load(Ordering::Acquire)
-    }
-
-    fn get_vruntime(&self) -> isize {
-        if self.nice.load(Ordering::Acquire) == 0 {
-            self.init_vruntime.load(Ordering::Acquire) + self.delta.load(Ordering::Acquire)
-        } else {
-            self.init_vruntime.load(Ordering::Acquire)
-                + self.delta.load(Ordering::Acquire) * 1024 / self.get_weight()
-        }
-    }
-
-    fn set_vruntime(&self, v: isize) {
-        self.init_vruntime.store(v, Ordering::Release);
+    fn get_vruntime(&self) -> u64 {
+        self.vruntime.load(Ordering::Acquire)
     }
 
-    // Simple Implementation: no change in vruntime.
-    // Only modifying priority of current process is supported currently.
-    fn set_priority(&self, nice: isize) {
-        let current_init_vruntime = self.get_vruntime();
-        self.init_vruntime
-            .store(current_init_vruntime, Ordering::Release);
-        self.delta.store(0, Ordering::Release);
-        self.nice.store(nice, Ordering::Release);
+    fn set_vruntime(&self, v: u64) {
+        self.vruntime.store(v, Ordering::Release);
     }
 
-    fn set_id(&self, id: isize) {
-        self.id.store(id, Ordering::Release);
+    /// Starts accounting the running time from `now`.
+    fn set_exec_start(&self, now: u64) {
+        self.exec_start.store(now, Ordering::Release);
     }
 
-    fn task_tick(&self) {
-        self.delta.fetch_add(1, Ordering::Release);
+    /// Charges the time since the last accounting to the vruntime.
+    fn update_curr(&self, now: u64) {
+        let delta = now.saturating_sub(self.exec_start.swap(now, Ordering::AcqRel));
+        let weight = self.get_weight() as u64;
+        let delta = if weight == NICE_0_WEIGHT {
+            delta
+        } else {
+            (delta as u128 * NICE_0_WEIGHT as u128 / weight as u128) as u64
+        };
+        self.vruntime.fetch_add(delta, Ordering::AcqRel);
     }
 
     /// Returns a reference to the inner task struct.
@@ -97,94 +115,161 @@ impl<T> Deref for CFSTask<T> {
     }
 }
 
+unsafe impl<T> RbAdapter for CFSTask<T> {
+    fn to_links(obj: &Self) -> &RbLinks<Self> {
+        &obj.links
+    }
+}
+
 /// A simple [Completely Fair Scheduler][1] (CFS).
 ///
+/// The runnable tasks are kept in an intrusive red-black tree ordered by
+/// vruntime, so adding, removing and picking tasks take O(log n) time without
+/// memory allocation. The running time is measured with the clock `C` in
+/// nanoseconds.
+///
 /// [1]: https://en.wikipedia.org/wiki/Completely_Fair_Scheduler
-pub struct CFScheduler<T> {
-    ready_queue: BTreeMap<(isize, isize), Arc<CFSTask<T>>>, // (vruntime, taskid)
-    min_vruntime: Option<AtomicIsize>,
-    id_pool: AtomicIsize,
+pub struct CFScheduler<T, C: SchedClock> {
+    /// Holds a reference count of each task in it.
+    ready_queue: RbTree<CFSTask<T>>,
+    /// A monotonic lower bound of the vruntime of runnable tasks.
+    min_vruntime: u64,
+    _marker: PhantomData<(Arc<CFSTask<T>>, C)>,
 }
 
-impl<T> CFScheduler<T> {
+impl<T, C: SchedClock> CFScheduler<T, C> {
     /// Creates a new empty [`CFScheduler`].
     pub const fn new() -> Self {
         Self {
-            ready_queue: BTreeMap::new(),
-            min_vruntime: None,
-            id_pool: AtomicIsize::new(0_isize),
+            ready_queue: RbTree::new(),
+            min_vruntime: 0,
+            _marker: PhantomData,
         }
     }
     /// get the name of scheduler
     pub fn scheduler_name() -> &'static str {
         "Completely Fair"
     }
+
+    fn enqueue(&mut self, task: Arc<CFSTask<T>>) {
+        let task = Arc::into_raw(task);
+        // SAFETY: the task is not in the tree (otherwise it would have two
+        // owners), and is kept alive by the reference count held by the tree.
+        unsafe {
+            self.ready_queue
+                .insert(&*task, |a, b| a.get_vruntime() < b.get_vruntime())
+        };
+    }
+
+    fn dequeue(&mut self, task: &CFSTask<T>) -> Arc<CFSTask<T>> {
+        // SAFETY: the task is in the tree, which holds a reference count of it.
+        unsafe {
+            self.ready_queue.remove(task);
+            Arc::from_raw(task)
+        }
+    }
+
+    fn first_vruntime(&self) -> Option<u64> {
+        // SAFETY: the tasks in the tree are alive.
+        self.ready_queue
+            .first()
+            .map(|first| unsafe { first.as_ref() }.get_vruntime())
+    }
 }
 
-impl<T> BaseScheduler for CFScheduler<T> {
+impl<T, C: SchedClock> BaseScheduler for CFScheduler<T, C> {
     type SchedItem = Arc<CFSTask<T>>;
 
     fn init(&mut self) {}
 
     fn add_task(&mut self, task: Self::SchedItem) {
-        if self.min_vruntime.is_none() {
-            self.min_vruntime = Some(AtomicIsize::new(0_isize));
-        }
-        let vruntime = self.min_vruntime.as_mut().unwrap().load(Ordering::Acquire);
-        let taskid = self.id_pool.fetch_add(1, Ordering::Release);
+        // A new or woken up task is placed near `min_vruntime`: it neither
+        // monopolizes the CPU with a vruntime left behind by sleeping, nor
+        // loses the little credit for sleeping.
+        let vruntime = task
+            .get_vruntime()
+            .max(self.min_vruntime.saturating_sub(SLEEPER_CREDIT_NS));
         task.set_vruntime(vruntime);
-        task.set_id(taskid);
-        self.ready_queue.insert((vruntime, taskid), task);
-        if let Some(((min_vruntime, _), _)) = self.ready_queue.first_key_value() {
-            self.min_vruntime = Some(AtomicIsize::new(*min_vruntime));
-        } else {
-            self.min_vruntime = None;
-        }
+        self.enqueue(task);
     }
 
     fn remove_task(&mut self, task: &Self::SchedItem) -> Option<Self::SchedItem> {
-        if let Some((_, tmp)) = self
-            .ready_queue
-            .remove_entry(&(task.clone().get_vruntime(), task.clone().get_id()))
-        {
-            if let Some(((min_vruntime, _), _)) = self.ready_queue.first_key_value() {
-                self.min_vruntime = Some(AtomicIsize::new(*min_vruntime));
-            } else {
-                self.min_vruntime = None;
-            }
-            Some(tmp)
+        if RbTree::is_linked(task.as_ref()) {
+            Some(self.dequeue(task))
         } else {
             None
         }
     }
 
+    fn is_empty(&self) -> bool {
+        self.ready_queue.first().is_none()
+    }
+
     fn pick_next_task(&mut self) -> Option<Self::SchedItem> {
-        if let Some((_, v)) = self.ready_queue.pop_first() {
-            Some(v)
-        } else {
-            None
-        }
+        let first = self.ready_queue.first()?;
+        // SAFETY: the tasks in the tree are alive.
+        let task = self.dequeue(unsafe { first.as_ref() });
+        self.min_vruntime = self.min_vruntime.max(task.get_vruntime());
+        task.set_exec_start(C::now_ns());
+        Some(task)
     }
 
     fn put_prev_task(&mut self, prev: Self::SchedItem, _preempt: bool) {
-        let taskid = self.id_pool.fetch_add(1, Ordering::Release);
-        prev.set_id(taskid);
-        self.ready_queue
-            .insert((prev.clone().get_vruntime(), taskid), prev);
+        prev.update_curr(C::now_ns());
+        self.enqueue(prev);
+        if let Some(v) = self.first_vruntime() {
+            self.min_vruntime = self.min_vruntime.max(v);
+        }
+    }
+
+    fn task_blocked(&mut self, current: &Self::SchedItem) {
+        // Charge the running time now, as the task may sleep for long before
+        // it's put back, or never be.
+        current.update_curr(C::now_ns());
+    }
+
+    fn migrate_task_out(&mut self, task: &Self::SchedItem) {
+        // Keep the vruntime relative to `min_vruntime` of this run queue, like
+        // `migrate_task_rq_fair` in Linux. It may be less than `min_vruntime`,
+        // so the wrapping arithmetic is used.
+        task.set_vruntime(task.get_vruntime().wrapping_sub(self.min_vruntime));
+    }
+
+    fn migrate_task_in(&mut self, task: &Self::SchedItem) {
+        task.set_vruntime(task.get_vruntime().wrapping_add(self.min_vruntime));
     }
 
     fn task_tick(&mut self, current: &Self::SchedItem) -> bool {
-        current.task_tick();
-        self.min_vruntime.is_none()
-            || current.get_vruntime() > self.min_vruntime.as_mut().unwrap().load(Ordering::Acquire)
+        current.update_curr(C::now_ns());
+        self.first_vruntime()
+            .map_or(false, |v| current.get_vruntime() > v + MIN_GRANULARITY_NS)
+    }
+
+    fn check_preempt(&mut self, current: &Self::SchedItem, woken: &Self::SchedItem) -> bool {
+        current.update_curr(C::now_ns());
+        current.get_vruntime() > woken.get_vruntime() + WAKEUP_GRANULARITY_NS
     }
 
     fn set_priority(&mut self, task: &Self::SchedItem, prio: isize) -> bool {
         if (-20..=19).contains(&prio) {
-            task.set_priority(prio);
+            // Only the running task (i.e., not in the ready queue) has running
+            // time to account with the old weight.
+            if !RbTree::is_linked(task.as_ref()) {
+                task.update_curr(C::now_ns());
+            }
+            task.nice.store(prio, Ordering::Release);
             true
         } else {
             false
         }
     }
 }
+
+impl<T, C: SchedClock> Drop for CFScheduler<T, C> {
+    fn drop(&mut self) {
+        while let Some(first) = self.ready_queue.first() {
+            // SAFETY: the tasks in the tree are alive.
+            self.dequeue(unsafe { first.as_ref() });
+        }
+    }
+}
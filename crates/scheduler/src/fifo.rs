@@ -84,6 +84,10 @@ impl<T> BaseScheduler for FifoScheduler<T> {
         unsafe { self.ready_queue.remove(task) }
     }
 
+    fn is_empty(&self) -> bool {
+        self.ready_queue.is_empty()
+    }
+
     fn pick_next_task(&mut self) -> Option<Self::SchedItem> {
         self.ready_queue.pop_front()
     }
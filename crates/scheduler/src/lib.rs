@@ -11,6 +11,7 @@
 
 mod cfs;
 mod fifo;
+mod rbtree;
 mod round_robin;
 
 #[cfg(test)]
@@ -18,7 +19,7 @@ mod tests;
 
 extern crate alloc;
 
-pub use cfs::{CFSTask, CFScheduler};
+pub use cfs::{CFSTask, CFScheduler, SchedClock};
 pub use fifo::{FifoScheduler, FifoTask};
 pub use round_robin::{RRScheduler, RRTask};
 
@@ -45,6 +46,9 @@ pub trait BaseScheduler {
     /// the behavior is undefined.
     fn remove_task(&mut self, task: &Self::SchedItem) -> Option<Self::SchedItem>;
 
+    /// Returns `true` if there are no runnable tasks in the scheduler.
+    fn is_empty(&self) -> bool;
+
     /// Picks the next task to run, it will be removed from the scheduler.
     /// Returns [`None`] if there is not runnable task.
     fn pick_next_task(&mut self) -> Option<Self::SchedItem>;
@@ -58,12 +62,49 @@ pub trait BaseScheduler {
     /// ready queue.
     fn put_prev_task(&mut self, prev: Self::SchedItem, preempt: bool);
 
+    /// Notifies the scheduler that `current`, the running task, is switched
+    /// out without being put back, i.e., it's blocked or exited.
+    ///
+    /// Does nothing by default.
+    fn task_blocked(&mut self, _current: &Self::SchedItem) {}
+
+    /// Prepares a task to be moved to the scheduler of another CPU. It's called
+    /// on this (the source) scheduler, after the task is removed from it (e.g.,
+    /// by [`pick_next_task`]), or when the task is woken up on another CPU
+    /// after it last ran on this one.
+    ///
+    /// Does nothing by default.
+    ///
+    /// [`pick_next_task`]: BaseScheduler::pick_next_task
+    fn migrate_task_out(&mut self, _task: &Self::SchedItem) {}
+
+    /// Receives a task moved from the scheduler of another CPU, after
+    /// [`migrate_task_out`] is called there. The task is then added by
+    /// [`add_task`], or run directly.
+    ///
+    /// Does nothing by default.
+    ///
+    /// [`migrate_task_out`]: BaseScheduler::migrate_task_out
+    /// [`add_task`]: BaseScheduler::add_task
+    fn migrate_task_in(&mut self, _task: &Self::SchedItem) {}
+
     /// Advances the scheduler state at each timer tick. Returns `true` if
     /// re-scheduling is required.
     ///
     /// `current` is the current running task.
     fn task_tick(&mut self, current: &Self::SchedItem) -> bool;
 
+    /// Checks whether a task just added by [`add_task`] after waking up should
+    /// preempt `current`, the running task on the same CPU.
+    ///
+    /// Returns `false` by default, i.e., the woken task waits for the next
+    /// re-scheduling.
+    ///
+    /// [`add_task`]: BaseScheduler::add_task
+    fn check_preempt(&mut self, _current: &Self::SchedItem, _woken: &Self::SchedItem) -> bool {
+        false
+    }
+
     /// set priority for a task
     fn set_priority(&mut self, task: &Self::SchedItem, prio: isize) -> bool;
 }
@@ -0,0 +1,408 @@
+//! An intrusive red-black tree.
+//!
+//! Like [`linked_list::unsafe_list`], the tree does not allocate: the links of
+//! an entry are embedded in the entry itself, and the owner of the tree is
+//! responsible for keeping the entries alive while they are in the tree.
+
+use core::{cell::UnsafeCell, ptr::NonNull};
+
+type Link<T> = Option<NonNull<T>>;
+
+/// Gets the links of an entry, for the entry to be put in a [`RbTree`].
+///
+/// # Safety
+///
+/// Implementers must ensure that `to_links` returns the same links for the
+/// same entry, and the links are not used by other trees.
+pub unsafe trait RbAdapter: Sized {
+    /// Retrieves the tree links for the given entry.
+    fn to_links(obj: &Self) -> &RbLinks<Self>;
+}
+
+struct RbNode<T> {
+    parent: Link<T>,
+    left: Link<T>,
+    right: Link<T>,
+    red: bool,
+    linked: bool,
+}
+
+/// The links of an entry in a [`RbTree`].
+///
+/// They are only accessed through the tree, which is accessed exclusively
+/// (by `&mut`) when they are modified.
+pub struct RbLinks<T>(UnsafeCell<RbNode<T>>);
+
+// SAFETY: The links are only accessed through the tree, see `RbLinks`.
+unsafe impl<T> Send for RbLinks<T> {}
+
+// SAFETY: The links are only accessed through the tree, see `RbLinks`.
+unsafe impl<T> Sync for RbLinks<T> {}
+
+impl<T> RbLinks<T> {
+    /// Constructs the links of an entry that is not in any tree.
+    pub const fn new() -> Self {
+        Self(UnsafeCell::new(RbNode {
+            parent: None,
+            left: None,
+            right: None,
+            red: false,
+            linked: false,
+        }))
+    }
+}
+
+/// An intrusive red-black tree, whose entries are ordered by a `less`
+/// function given on insertion. Entries that are equal are kept in the order
+/// of insertion.
+///
+/// The leftmost (i.e., the least) entry is cached, so [`first`] is O(1). So
+/// is the rightmost one, to append entries not less than all the others
+/// without walking down the tree.
+///
+/// [`first`]: RbTree::first
+pub struct RbTree<T: RbAdapter> {
+    root: Link<T>,
+    first: Link<T>,
+    last: Link<T>,
+}
+
+// SAFETY: The tree can be sent to other threads as long as its entries can.
+unsafe impl<T: RbAdapter + Send> Send for RbTree<T> {}
+
+// SAFETY: The tree is usable from other threads as long as its entries are.
+unsafe impl<T: RbAdapter + Sync> Sync for RbTree<T> {}
+
+/// Accessors of the links, which are only called with `&mut RbTree`.
+fn node<'a, T: RbAdapter>(p: NonNull<T>) -> &'a mut RbNode<T> {
+    // SAFETY: the entries in the tree are alive, and their links are only
+    // accessed by the tree, which is borrowed mutably.
+    unsafe { &mut *T::to_links(p.as_ref()).0.get() }
+}
+
+fn parent<T: RbAdapter>(p: NonNull<T>) -> Link<T> {
+    node(p).parent
+}
+
+fn left<T: RbAdapter>(p: NonNull<T>) -> Link<T> {
+    node(p).left
+}
+
+fn right<T: RbAdapter>(p: NonNull<T>) -> Link<T> {
+    node(p).right
+}
+
+fn is_red<T: RbAdapter>(p: Link<T>) -> bool {
+    p.map_or(false, |p| node(p).red)
+}
+
+fn set_red<T: RbAdapter>(p: NonNull<T>, red: bool) {
+    node(p).red = red;
+}
+
+fn set_parent<T: RbAdapter>(p: Link<T>, parent: Link<T>) {
+    if let Some(p) = p {
+        node(p).parent = parent;
+    }
+}
+
+fn leftmost<T: RbAdapter>(mut p: NonNull<T>) -> NonNull<T> {
+    while let Some(l) = left(p) {
+        p = l;
+    }
+    p
+}
+
+fn rightmost<T: RbAdapter>(mut p: NonNull<T>) -> NonNull<T> {
+    while let Some(r) = right(p) {
+        p = r;
+    }
+    p
+}
+
+impl<T: RbAdapter> RbTree<T> {
+    /// Constructs a new empty tree.
+    pub const fn new() -> Self {
+        Self {
+            root: None,
+            first: None,
+            last: None,
+        }
+    }
+
+    /// Returns the least entry.
+    pub fn first(&self) -> Option<NonNull<T>> {
+        self.first
+    }
+
+    /// Returns whether the entry is in a tree.
+    pub fn is_linked(obj: &T) -> bool {
+        // SAFETY: only reads a flag, which is written with `&mut RbTree`.
+        unsafe { (*T::to_links(obj).0.get()).linked }
+    }
+
+    /// Inserts an entry, after all entries that are not greater than it.
+    ///
+    /// # Safety
+    ///
+    /// The entry must not be in any tree, must not be moved, and must outlive
+    /// the tree or be removed before it's dropped. `less` must be consistent
+    /// with the order of the entries in the tree.
+    pub unsafe fn insert(&mut self, obj: &T, less: impl Fn(&T, &T) -> bool) {
+        let new = NonNull::from(obj);
+        let mut parent = None;
+        let mut is_left = false;
+        let mut is_first = true;
+        let is_last = match self.last {
+            // the rightmost entry has no right child
+            Some(last) if !less(obj, unsafe { last.as_ref() }) => {
+                parent = Some(last);
+                is_first = false;
+                true
+            }
+            _ => {
+                let mut cur = self.root;
+                while let Some(c) = cur {
+                    parent = cur;
+                    if less(obj, unsafe { c.as_ref() }) {
+                        cur = left(c);
+                        is_left = true;
+                    } else {
+                        cur = right(c);
+                        is_left = false;
+                        is_first = false;
+                    }
+                }
+                parent.is_none()
+            }
+        };
+
+        *node(new) = RbNode {
+            parent,
+            left: None,
+            right: None,
+            red: true,
+            linked: true,
+        };
+        match parent {
+            None => self.root = Some(new),
+            Some(p) if is_left => node(p).left = Some(new),
+            Some(p) => node(p).right = Some(new),
+        }
+        if is_first {
+            self.first = Some(new);
+        }
+        if is_last {
+            self.last = Some(new);
+        }
+        self.insert_fixup(new);
+    }
+
+    /// Removes an entry.
+    ///
+    /// # Safety
+    ///
+    /// The entry must be in this tree.
+    pub unsafe fn remove(&mut self, obj: &T) {
+        let z = NonNull::from(obj);
+        if self.first == Some(z) {
+            // `z` has no left child, its successor is the leftmost entry of
+            // its right subtree, or its parent.
+            self.first = right(z).map(leftmost).or(parent(z));
+        }
+        if self.last == Some(z) {
+            self.last = left(z).map(rightmost).or(parent(z));
+        }
+
+        let (x, x_parent, removed_red);
+        match (left(z), right(z)) {
+            (None, r) => {
+                (x, x_parent, removed_red) = (r, parent(z), node(z).red);
+                self.transplant(z, r);
+            }
+            (l, None) => {
+                (x, x_parent, removed_red) = (l, parent(z), node(z).red);
+                self.transplant(z, l);
+            }
+            (Some(l), Some(r)) => {
+                // replace `z` with its successor `y`
+                let y = leftmost(r);
+                removed_red = node(y).red;
+                x = right(y);
+                if y == r {
+                    x_parent = Some(y);
+                } else {
+                    x_parent = parent(y);
+                    self.transplant(y, x);
+                    node(y).right = Some(r);
+                    node(r).parent = Some(y);
+                }
+                self.transplant(z, Some(y));
+                node(y).left = Some(l);
+                node(l).parent = Some(y);
+                node(y).red = node(z).red;
+            }
+        }
+        if !removed_red {
+            self.remove_fixup(x, x_parent);
+        }
+
+        *node(z) = RbNode {
+            parent: None,
+            left: None,
+            right: None,
+            red: false,
+            linked: false,
+        };
+    }
+
+    /// Replaces the subtree rooted at `u` with the one rooted at `v`.
+    fn transplant(&mut self, u: NonNull<T>, v: Link<T>) {
+        let p = parent(u);
+        self.replace_child(p, u, v);
+        set_parent(v, p);
+    }
+
+    fn replace_child(&mut self, parent: Link<T>, old: NonNull<T>, new: Link<T>) {
+        match parent {
+            None => self.root = new,
+            Some(p) if left(p) == Some(old) => node(p).left = new,
+            Some(p) => node(p).right = new,
+        }
+    }
+
+    fn rotate_left(&mut self, x: NonNull<T>) {
+        let y = right(x).unwrap();
+        let b = left(y);
+        node(x).right = b;
+        set_parent(b, Some(x));
+        let p = parent(x);
+        node(y).parent = p;
+        self.replace_child(p, x, Some(y));
+        node(y).left = Some(x);
+        node(x).parent = Some(y);
+    }
+
+    fn rotate_right(&mut self, x: NonNull<T>) {
+        let y = left(x).unwrap();
+        let b = right(y);
+        node(x).left = b;
+        set_parent(b, Some(x));
+        let p = parent(x);
+        node(y).parent = p;
+        self.replace_child(p, x, Some(y));
+        node(y).right = Some(x);
+        node(x).parent = Some(y);
+    }
+
+    fn insert_fixup(&mut self, mut z: NonNull<T>) {
+        while let Some(p) = parent(z).filter(|&p| node(p).red) {
+            // a red node is not the root, so it has a parent
+            let g = parent(p).unwrap();
+            if left(g) == Some(p) {
+                let uncle = right(g);
+                if is_red(uncle) {
+                    set_red(p, false);
+                    set_red(uncle.unwrap(), false);
+                    set_red(g, true);
+                    z = g;
+                } else {
+                    if right(p) == Some(z) {
+                        z = p;
+                        self.rotate_left(z);
+                    }
+                    let p = parent(z).unwrap();
+                    let g = parent(p).unwrap();
+                    set_red(p, false);
+                    set_red(g, true);
+                    self.rotate_right(g);
+                }
+            } else {
+                let uncle = left(g);
+                if is_red(uncle) {
+                    set_red(p, false);
+                    set_red(uncle.unwrap(), false);
+                    set_red(g, true);
+                    z = g;
+                } else {
+                    if left(p) == Some(z) {
+                        z = p;
+                        self.rotate_right(z);
+                    }
+                    let p = parent(z).unwrap();
+                    let g = parent(p).unwrap();
+                    set_red(p, false);
+                    set_red(g, true);
+                    self.rotate_left(g);
+                }
+            }
+        }
+        set_red(self.root.unwrap(), false);
+    }
+
+    /// Restores the properties after a black node is removed, where `x` (may
+    /// be a leaf) is the node that took its place, with parent `x_parent`.
+    fn remove_fixup(&mut self, mut x: Link<T>, mut x_parent: Link<T>) {
+        while x != self.root && !is_red(x) {
+            // `x` is not the root, and its sibling exists as `x` is one black
+            // node short.
+            let p = x_parent.unwrap();
+            if left(p) == x {
+                let mut w = right(p).unwrap();
+                if node(w).red {
+                    set_red(w, false);
+                    set_red(p, true);
+                    self.rotate_left(p);
+                    w = right(p).unwrap();
+                }
+                if !is_red(left(w)) && !is_red(right(w)) {
+                    set_red(w, true);
+                    x = Some(p);
+                    x_parent = parent(p);
+                } else {
+                    if !is_red(right(w)) {
+                        set_red(left(w).unwrap(), false);
+                        set_red(w, true);
+                        self.rotate_right(w);
+                        w = right(p).unwrap();
+                    }
+                    set_red(w, node(p).red);
+                    set_red(p, false);
+                    set_red(right(w).unwrap(), false);
+                    self.rotate_left(p);
+                    x = self.root;
+                    break;
+                }
+            } else {
+                let mut w = left(p).unwrap();
+                if node(w).red {
+                    set_red(w, false);
+                    set_red(p, true);
+                    self.rotate_right(p);
+                    w = left(p).unwrap();
+                }
+                if !is_red(left(w)) && !is_red(right(w)) {
+                    set_red(w, true);
+                    x = Some(p);
+                    x_parent = parent(p);
+                } else {
+                    if !is_red(left(w)) {
+                        set_red(right(w).unwrap(), false);
+                        set_red(w, true);
+                        self.rotate_left(w);
+                        w = left(p).unwrap();
+                    }
+                    set_red(w, node(p).red);
+                    set_red(p, false);
+                    set_red(left(w).unwrap(), false);
+                    self.rotate_right(p);
+                    x = self.root;
+                    break;
+                }
+            }
+        }
+        if let Some(x) = x {
+            set_red(x, false);
+        }
+    }
+}
@@ -89,6 +89,10 @@ impl<T, const S: usize> BaseScheduler for RRScheduler<T, S> {
             .and_then(|idx| self.ready_queue.remove(idx))
     }
 
+    fn is_empty(&self) -> bool {
+        self.ready_queue.is_empty()
+    }
+
     fn pick_next_task(&mut self) -> Option<Self::SchedItem> {
         self.ready_queue.pop_front()
     }
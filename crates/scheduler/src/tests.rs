@@ -26,6 +26,7 @@ macro_rules! def_test_sched {
                     n += 1;
                 }
                 assert_eq!(n, NUM_TASKS);
+                assert!(scheduler.is_empty());
             }
 
             #[test]
@@ -51,6 +52,31 @@ macro_rules! def_test_sched {
                 );
             }
 
+            #[test]
+            fn bench_pick_put() {
+                const NUM_TASKS: usize = 10_000;
+                const COUNT: usize = NUM_TASKS * 100;
+
+                let mut scheduler = <$scheduler>::new();
+                for i in 0..NUM_TASKS {
+                    scheduler.add_task(Arc::new(<$task>::new(i)));
+                }
+
+                let t0 = std::time::Instant::now();
+                for _ in 0..COUNT {
+                    let next = scheduler.pick_next_task().unwrap();
+                    scheduler.task_tick(&next);
+                    scheduler.put_prev_task(next, false);
+                }
+                let t1 = std::time::Instant::now();
+                println!(
+                    "  {}: task pick/put speed with {} tasks: {:?}/task",
+                    stringify!($scheduler),
+                    NUM_TASKS,
+                    (t1 - t0) / (COUNT as u32)
+                );
+            }
+
             #[test]
             fn bench_remove() {
                 const NUM_TASKS: usize = 10_000;
@@ -79,6 +105,161 @@ macro_rules! def_test_sched {
     };
 }
 
+use crate::*;
+use alloc::sync::Arc;
+use std::cell::Cell;
+
+/// A fake clock for [`CFScheduler`], which advances 1us on each read so that
+/// the tests are deterministic.
+struct TestClock;
+
+thread_local! {
+    static TEST_CLOCK_NS: Cell<u64> = Cell::new(0);
+}
+
+impl TestClock {
+    fn advance(ns: u64) {
+        TEST_CLOCK_NS.with(|t| t.set(t.get() + ns));
+    }
+}
+
+impl SchedClock for TestClock {
+    fn now_ns() -> u64 {
+        TEST_CLOCK_NS.with(|t| {
+            t.set(t.get() + 1000);
+            t.get()
+        })
+    }
+}
+
 def_test_sched!(fifo, FifoScheduler::<usize>, FifoTask::<usize>);
 def_test_sched!(rr, RRScheduler::<usize, 5>, RRTask::<usize, 5>);
-def_test_sched!(cfs, CFScheduler::<usize>, CFSTask::<usize>);
+def_test_sched!(
+    cfs,
+    CFScheduler::<usize, super::TestClock>,
+    CFSTask::<usize>
+);
+
+type TestCFScheduler = CFScheduler<usize, TestClock>;
+
+/// Runs the picked task for `ns` and puts it back, returns its id.
+fn cfs_run(scheduler: &mut TestCFScheduler, ns: u64) -> usize {
+    let next = scheduler.pick_next_task().unwrap();
+    TestClock::advance(ns);
+    scheduler.task_tick(&next);
+    let id = *next.inner();
+    scheduler.put_prev_task(next, false);
+    id
+}
+
+#[test]
+fn test_cfs_nice() {
+    let mut scheduler = TestCFScheduler::new();
+    let tasks: Vec<_> = (0..2).map(|i| Arc::new(CFSTask::new(i))).collect();
+    scheduler.set_priority(&tasks[1], 5);
+    for t in &tasks {
+        scheduler.add_task(t.clone());
+    }
+
+    // nice 0 and nice 5 have weights 1024 and 335.
+    let mut runs = [0_usize; 2];
+    for _ in 0..13_590 {
+        runs[cfs_run(&mut scheduler, 1_000_000)] += 1;
+    }
+    assert!(runs[0].abs_diff(10_240) < 10, "{:?}", runs);
+    assert!(runs[1].abs_diff(3_350) < 10, "{:?}", runs);
+}
+
+#[test]
+fn test_cfs_wakeup() {
+    let mut scheduler = TestCFScheduler::new();
+    let sleeper = Arc::new(CFSTask::new(0));
+    scheduler.add_task(sleeper.clone());
+    let running = Arc::new(CFSTask::new(1));
+    scheduler.add_task(running.clone());
+
+    // `sleeper` blocks after running for a while.
+    assert_eq!(scheduler.pick_next_task().map(|t| *t.inner()), Some(0));
+    TestClock::advance(1_000_000);
+    for _ in 0..100 {
+        assert_eq!(cfs_run(&mut scheduler, 10_000_000), 1);
+    }
+
+    // It gets a limited credit for sleeping when woken up, enough to preempt
+    // the running task but not to run for long.
+    let curr = scheduler.pick_next_task().unwrap();
+    assert_eq!(*curr.inner(), 1);
+    TestClock::advance(1_000_000);
+    scheduler.add_task(sleeper.clone());
+    assert!(scheduler.check_preempt(&curr, &sleeper));
+    scheduler.put_prev_task(curr, true);
+    assert_eq!(cfs_run(&mut scheduler, 3_000_000), 0);
+    assert_eq!(cfs_run(&mut scheduler, 3_000_000), 0);
+    assert_eq!(cfs_run(&mut scheduler, 3_000_000), 1);
+
+    // A task is not removed twice.
+    assert!(scheduler.remove_task(&sleeper).is_some());
+    assert!(scheduler.remove_task(&sleeper).is_none());
+}
+
+#[test]
+fn test_cfs_blocked() {
+    let mut scheduler = TestCFScheduler::new();
+    let blocker = Arc::new(CFSTask::new(0));
+    scheduler.add_task(blocker.clone());
+    scheduler.add_task(Arc::new(CFSTask::new(1)));
+
+    // `blocker` runs for 50ms without a tick before blocking, which is still
+    // charged when it wakes up.
+    let curr = scheduler.pick_next_task().unwrap();
+    assert_eq!(*curr.inner(), 0);
+    TestClock::advance(50_000_000);
+    scheduler.task_blocked(&curr);
+    drop(curr);
+    scheduler.add_task(blocker);
+    for _ in 0..5 {
+        assert_eq!(cfs_run(&mut scheduler, 10_000_000), 1);
+    }
+    assert_eq!(cfs_run(&mut scheduler, 10_000_000), 0);
+}
+
+#[test]
+fn test_cfs_migrate() {
+    let mut src = TestCFScheduler::new();
+    let mut dst = TestCFScheduler::new();
+    for i in 0..2 {
+        src.add_task(Arc::new(CFSTask::new(i)));
+    }
+    dst.add_task(Arc::new(CFSTask::new(2)));
+    // The vruntime on `src` goes far ahead of the one on `dst`.
+    for _ in 0..100 {
+        cfs_run(&mut src, 10_000_000);
+    }
+    cfs_run(&mut dst, 1_000_000);
+
+    // A task stolen from `src` shares `dst` fairly with the local task,
+    // instead of waiting for it to catch up.
+    let stolen = src.pick_next_task().unwrap();
+    src.migrate_task_out(&stolen);
+    dst.migrate_task_in(&stolen);
+    TestClock::advance(1_000_000);
+    dst.put_prev_task(stolen, false);
+    let mut runs = [0_usize; 3];
+    for _ in 0..10 {
+        runs[cfs_run(&mut dst, 1_000_000)] += 1;
+    }
+    assert_eq!(runs[2], 5, "{:?}", runs);
+
+    // And back: it does not monopolize `src` either.
+    let stolen = dst.pick_next_task().unwrap();
+    let id = *stolen.inner();
+    dst.migrate_task_out(&stolen);
+    src.migrate_task_in(&stolen);
+    TestClock::advance(10_000_000);
+    src.put_prev_task(stolen, false);
+    let mut runs = [0_usize; 3];
+    for _ in 0..30 {
+        runs[cfs_run(&mut src, 10_000_000)] += 1;
+    }
+    assert_eq!(runs[id], 15, "{:?}", runs);
+}
@@ -200,7 +200,15 @@ impl Heap {
             HeapAllocator::Slab1024Bytes => (layout.size(), 1024),
             HeapAllocator::Slab2048Bytes => (layout.size(), 2048),
             HeapAllocator::Slab4096Bytes => (layout.size(), 4096),
-            HeapAllocator::BuddyAllocator => (layout.size(), layout.size()),
+            HeapAllocator::BuddyAllocator => (
+                layout.size(),
+                // the same rounding as `buddy_system_allocator::Heap::alloc`
+                layout
+                    .size()
+                    .next_power_of_two()
+                    .max(layout.align())
+                    .max(core::mem::size_of::<usize>()),
+            ),
         }
     }
 
@@ -1,6 +1,13 @@
 //! A list of timed events that will be triggered sequentially when the timer
 //! expires.
 //!
+//! Two implementations are provided:
+//!
+//! - [`TimerList`]: a min-heap of events sorted by deadline. Canceling events
+//!   needs a linear scan.
+//! - [`TimerWheel`]: a hierarchical timing wheel with O(1) set and cancel (by
+//!   a [`TimerHandle`]), suitable for a large number of timeouts.
+//!
 //! # Examples
 //!
 //! ```
@@ -31,10 +38,14 @@
 #![feature(binary_heap_retain)]
 extern crate alloc;
 
+mod wheel;
+
 use alloc::{boxed::Box, collections::BinaryHeap};
 use core::cmp::{Ord, Ordering, PartialOrd};
 use core::time::Duration;
 
+pub use self::wheel::{TimerHandle, TimerWheel};
+
 /// The type of the time value.
 ///
 /// Current it is just an alias of [`core::time::Duration`].
@@ -156,7 +167,7 @@ impl TimerEvent for TimerEventFn {
 
 #[cfg(test)]
 mod tests {
-    use super::{TimeValue, TimerEvent, TimerEventFn, TimerList};
+    use super::{TimeValue, TimerEvent, TimerEventFn, TimerList, TimerWheel};
     use core::sync::atomic::{AtomicUsize, Ordering};
     use std::time::{Duration, Instant};
 
@@ -231,4 +242,74 @@ mod tests {
             }
         }
     }
+
+    #[test]
+    fn test_timer_wheel() {
+        struct TestTimerEvent(usize);
+
+        impl TimerEvent for TestTimerEvent {
+            fn callback(self, _now: TimeValue) {}
+        }
+
+        const N: usize = 3000;
+        let granularity = Duration::from_micros(100);
+        let mut wheel = TimerWheel::new(granularity);
+        let mut deadlines = Vec::with_capacity(N);
+        let mut handles = Vec::with_capacity(N);
+        let mut seed = 0x2333_u64;
+        for i in 0..N {
+            // pseudo-random deadlines from 0 to ~3 hours, to cover all levels
+            // and the overflow list.
+            seed = seed.wrapping_mul(6364136223846793005).wrapping_add(1);
+            let nanos = (seed >> 20) % (1 << (10 + i % 34));
+            let ddl = Duration::from_nanos(nanos);
+            deadlines.push(ddl);
+            handles.push(wheel.set(ddl, TestTimerEvent(i)));
+        }
+        assert_eq!(wheel.len(), N);
+
+        // cancel every third timer, and cancel twice has no effect
+        for i in (0..N).step_by(3) {
+            assert_eq!(wheel.cancel(handles[i]).map(|e| e.0), Some(i));
+            assert!(wheel.cancel(handles[i]).is_none());
+        }
+
+        let mut expired = vec![false; N];
+        let mut now = Duration::ZERO;
+        let end = *deadlines.iter().max().unwrap() + granularity;
+        while !wheel.is_empty() {
+            let next = wheel.next_deadline().unwrap();
+            now = now.max(next).min(end) + Duration::from_nanos(seed % 50_000);
+            seed = seed.wrapping_mul(6364136223846793005).wrapping_add(1);
+            while let Some((ddl, event)) = wheel.expire_one(now) {
+                let i = event.0;
+                assert_eq!(ddl, deadlines[i]);
+                // never expired early, and delayed by at most one granularity
+                // after the last check.
+                assert!(ddl <= now);
+                assert!(!expired[i] && i % 3 != 0);
+                expired[i] = true;
+                // the handle is stale after expired
+                assert!(wheel.cancel(handles[i]).is_none());
+            }
+            // `next_deadline()` is never later than the time at which any
+            // pending event can be expired.
+            if let Some(next) = wheel.next_deadline() {
+                assert!(next + granularity > now);
+                assert!(
+                    (0..N).all(|i| expired[i] || i % 3 == 0 || deadlines[i] + granularity > next)
+                );
+            }
+        }
+        assert_eq!(expired.iter().filter(|&&e| e).count(), N - (N + 2) / 3);
+
+        // entries are reused, with fresh handles
+        let h = wheel.set(now, TestTimerEvent(0));
+        assert!(handles.iter().all(|&old| old != h));
+        assert!(wheel.expire_one(now - granularity).is_none());
+        assert_eq!(
+            wheel.expire_one(now + granularity).map(|(_, e)| e.0),
+            Some(0)
+        );
+    }
 }
@@ -0,0 +1,386 @@
+//! A hierarchical hashed timing wheel.
+
+use alloc::vec::Vec;
+
+use crate::{TimeValue, TimerEvent};
+
+const WHEEL_BITS: u32 = 6;
+const WHEEL_SIZE: usize = 1 << WHEEL_BITS;
+const WHEEL_MASK: u64 = WHEEL_SIZE as u64 - 1;
+const WHEEL_LEVELS: usize = 4;
+
+/// Events that are too far in the future for all wheel levels.
+const OVERFLOW_LIST: u32 = (WHEEL_LEVELS * WHEEL_SIZE) as u32;
+/// Events that have expired but not been taken by [`TimerWheel::expire_one`].
+const EXPIRED_LIST: u32 = OVERFLOW_LIST + 1;
+const NUM_LISTS: usize = EXPIRED_LIST as usize + 1;
+
+const NIL: u32 = u32::MAX;
+
+/// A handle of a timed event in the [`TimerWheel`], used to cancel it.
+///
+/// It becomes stale once the event is expired or canceled, then canceling with
+/// it has no effect.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct TimerHandle {
+    index: u32,
+    generation: u32,
+}
+
+struct TimerEntry<E> {
+    event: Option<E>,
+    deadline: TimeValue,
+    tick: u64,
+    generation: u32,
+    list: u32,
+    prev: u32,
+    next: u32, // also links the free entries
+}
+
+#[derive(Clone, Copy)]
+struct ListHead {
+    head: u32,
+    tail: u32,
+}
+
+impl ListHead {
+    const EMPTY: Self = Self {
+        head: NIL,
+        tail: NIL,
+    };
+}
+
+/// A hierarchical hashed timing wheel.
+///
+/// The time is divided into ticks of the given granularity. The wheel has
+/// several levels of 64 slots, a slot in level `l` covers `64^l` ticks. Events
+/// are placed into the lowest level that can hold them, and cascaded into
+/// lower levels when the time goes by. Events that do not fit in any level are
+/// put into an overflow list.
+///
+/// Unlike [`TimerList`](crate::TimerList), both [`set`](Self::set) and
+/// [`cancel`](Self::cancel) take O(1) time, and canceling uses the
+/// [`TimerHandle`] returned by [`set`](Self::set) instead of scanning. Events
+/// are never triggered before their deadlines, but may be delayed by at most
+/// one granularity.
+pub struct TimerWheel<E: TimerEvent> {
+    granularity_nanos: u64,
+    /// The next tick to be processed.
+    base: u64,
+    lists: [ListHead; NUM_LISTS],
+    occupied: [u64; WHEEL_LEVELS],
+    entries: Vec<TimerEntry<E>>,
+    free_head: u32,
+    /// Number of events in the wheel levels and the overflow list.
+    pending: usize,
+    /// Number of events in the expired list.
+    expired: usize,
+}
+
+impl<E: TimerEvent> TimerWheel<E> {
+    /// Creates a new empty timer wheel with the given tick granularity.
+    pub const fn new(granularity: TimeValue) -> Self {
+        let granularity_nanos = granularity.as_nanos() as u64;
+        assert!(granularity_nanos > 0);
+        Self {
+            granularity_nanos,
+            base: 0,
+            lists: [ListHead::EMPTY; NUM_LISTS],
+            occupied: [0; WHEEL_LEVELS],
+            entries: Vec::new(),
+            free_head: NIL,
+            pending: 0,
+            expired: 0,
+        }
+    }
+
+    /// Whether there is no timed event.
+    #[inline]
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+
+    /// Number of timed events that are not triggered or canceled.
+    #[inline]
+    pub fn len(&self) -> usize {
+        self.pending + self.expired
+    }
+
+    /// Set a timed event that will be triggered at `deadline`.
+    ///
+    /// Returns a handle that can be used to cancel the event.
+    pub fn set(&mut self, deadline: TimeValue, event: E) -> TimerHandle {
+        let tick = self.deadline_to_tick(deadline);
+        let index = self.alloc_entry(deadline, tick, event);
+        self.place(index);
+        TimerHandle {
+            index,
+            generation: self.entries[index as usize].generation,
+        }
+    }
+
+    /// Cancel the event of the given handle.
+    ///
+    /// Returns the canceled event, or `None` if it has already been expired
+    /// or canceled.
+    pub fn cancel(&mut self, handle: TimerHandle) -> Option<E> {
+        let entry = self.entries.get(handle.index as usize)?;
+        if entry.generation != handle.generation || entry.event.is_none() {
+            return None;
+        }
+        self.unlink(handle.index);
+        Some(self.free_entry(handle.index).1)
+    }
+
+    /// Get the earliest time at which an event can be expired.
+    ///
+    /// It's the deadline rounded up to the granularity. Events in the higher
+    /// levels are not sorted, so it may also return an earlier time at which
+    /// the wheel needs to be checked again (when these events are cascaded).
+    pub fn next_deadline(&self) -> Option<TimeValue> {
+        let head = self.lists[EXPIRED_LIST as usize].head;
+        if head != NIL {
+            return Some(self.entries[head as usize].deadline);
+        }
+        if self.pending == 0 {
+            return None;
+        }
+
+        let mut next_tick = u64::MAX;
+        for level in 0..WHEEL_LEVELS {
+            let shift = WHEEL_BITS * level as u32;
+            let curr_slot = (self.base >> shift) & WHEEL_MASK;
+            let bits = self.occupied[level];
+            if bits == 0 {
+                continue;
+            }
+            // The current slot is still pending if `base` is at its start
+            // (for level 0, always). Pending slots are processed in this
+            // round, others are in the next round.
+            let first_slot = if self.base & ((1 << shift) - 1) == 0 {
+                curr_slot
+            } else {
+                curr_slot + 1
+            };
+            let (slot, round) = if first_slot < WHEEL_SIZE as u64 && bits >> first_slot != 0 {
+                (first_slot + (bits >> first_slot).trailing_zeros() as u64, 0)
+            } else {
+                (bits.trailing_zeros() as u64, 1)
+            };
+            let round_shift = shift + WHEEL_BITS;
+            let tick = (((self.base >> round_shift) + round) << round_shift) + (slot << shift);
+            next_tick = next_tick.min(tick);
+        }
+        if self.lists[OVERFLOW_LIST as usize].head != NIL {
+            let shift = WHEEL_BITS * WHEEL_LEVELS as u32;
+            let round = (self.base & ((1 << shift) - 1) != 0) as u64;
+            next_tick = next_tick.min(((self.base >> shift) + round) << shift);
+        }
+        Some(self.tick_to_time(next_tick))
+    }
+
+    /// Try to expire one event that passed the deadline at the given time.
+    ///
+    /// Returns `None` if no event is expired.
+    pub fn expire_one(&mut self, now: TimeValue) -> Option<(TimeValue, E)> {
+        if self.expired == 0 {
+            self.advance(self.time_to_tick(now));
+        }
+        let index = self.lists[EXPIRED_LIST as usize].head;
+        if index == NIL {
+            return None;
+        }
+        self.unlink(index);
+        Some(self.free_entry(index))
+    }
+}
+
+// private methods
+impl<E: TimerEvent> TimerWheel<E> {
+    /// The first tick not earlier than `deadline`.
+    fn deadline_to_tick(&self, deadline: TimeValue) -> u64 {
+        let g = self.granularity_nanos as u128;
+        ((deadline.as_nanos() + g - 1) / g).min(u64::MAX as u128) as u64
+    }
+
+    /// The last tick not later than `now`.
+    fn time_to_tick(&self, now: TimeValue) -> u64 {
+        (now.as_nanos() / self.granularity_nanos as u128).min(u64::MAX as u128) as u64
+    }
+
+    fn tick_to_time(&self, tick: u64) -> TimeValue {
+        TimeValue::from_nanos(tick.saturating_mul(self.granularity_nanos))
+    }
+
+    fn alloc_entry(&mut self, deadline: TimeValue, tick: u64, event: E) -> u32 {
+        if self.free_head != NIL {
+            let index = self.free_head;
+            let entry = &mut self.entries[index as usize];
+            self.free_head = entry.next;
+            entry.event = Some(event);
+            entry.deadline = deadline;
+            entry.tick = tick;
+            index
+        } else {
+            let index = self.entries.len() as u32;
+            assert!(index != NIL, "too many timed events");
+            self.entries.push(TimerEntry {
+                event: Some(event),
+                deadline,
+                tick,
+                generation: 0,
+                list: NIL,
+                prev: NIL,
+                next: NIL,
+            });
+            index
+        }
+    }
+
+    fn free_entry(&mut self, index: u32) -> (TimeValue, E) {
+        let entry = &mut self.entries[index as usize];
+        let event = entry.event.take().unwrap();
+        entry.generation = entry.generation.wrapping_add(1);
+        entry.next = self.free_head;
+        self.free_head = index;
+        (entry.deadline, event)
+    }
+
+    /// Puts an unlinked entry into the list according to its tick.
+    fn place(&mut self, index: u32) {
+        let tick = self.entries[index as usize].tick;
+        if tick < self.base {
+            self.push_back(EXPIRED_LIST, index);
+            return;
+        }
+        let delta = tick - self.base;
+        for level in 0..WHEEL_LEVELS {
+            let shift = WHEEL_BITS * level as u32;
+            if delta < 1 << (shift + WHEEL_BITS) {
+                let slot = ((tick >> shift) & WHEEL_MASK) as usize;
+                self.push_back((level * WHEEL_SIZE + slot) as u32, index);
+                return;
+            }
+        }
+        self.push_back(OVERFLOW_LIST, index);
+    }
+
+    fn push_back(&mut self, list: u32, index: u32) {
+        let head = &mut self.lists[list as usize];
+        let tail = head.tail;
+        if tail == NIL {
+            head.head = index;
+        } else {
+            self.entries[tail as usize].next = index;
+        }
+        head.tail = index;
+
+        let entry = &mut self.entries[index as usize];
+        entry.list = list;
+        entry.prev = tail;
+        entry.next = NIL;
+
+        if list == EXPIRED_LIST {
+            self.expired += 1;
+        } else {
+            self.pending += 1;
+            if list < OVERFLOW_LIST {
+                let (level, slot) = (list as usize / WHEEL_SIZE, list as usize % WHEEL_SIZE);
+                self.occupied[level] |= 1 << slot;
+            }
+        }
+    }
+
+    fn unlink(&mut self, index: u32) {
+        let entry = &mut self.entries[index as usize];
+        let (list, prev, next) = (entry.list, entry.prev, entry.next);
+        entry.list = NIL;
+        if prev == NIL {
+            self.lists[list as usize].head = next;
+        } else {
+            self.entries[prev as usize].next = next;
+        }
+        if next == NIL {
+            self.lists[list as usize].tail = prev;
+        } else {
+            self.entries[next as usize].prev = prev;
+        }
+
+        if list == EXPIRED_LIST {
+            self.expired -= 1;
+        } else {
+            self.pending -= 1;
+            if list < OVERFLOW_LIST && self.lists[list as usize].head == NIL {
+                let (level, slot) = (list as usize / WHEEL_SIZE, list as usize % WHEEL_SIZE);
+                self.occupied[level] &= !(1 << slot);
+            }
+        }
+    }
+
+    /// Detaches all entries in the list, and re-places them according to
+    /// their ticks (or puts them into the expired list if `expire`).
+    fn replace_list(&mut self, list: u32, expire: bool) {
+        let mut index = core::mem::replace(&mut self.lists[list as usize], ListHead::EMPTY).head;
+        if list < OVERFLOW_LIST {
+            let (level, slot) = (list as usize / WHEEL_SIZE, list as usize % WHEEL_SIZE);
+            self.occupied[level] &= !(1 << slot);
+        }
+        while index != NIL {
+            let next = self.entries[index as usize].next;
+            self.pending -= 1;
+            if expire {
+                self.push_back(EXPIRED_LIST, index);
+            } else {
+                self.place(index);
+            }
+            index = next;
+        }
+    }
+
+    /// Cascades the higher levels at a level-1 boundary (`base % 64 == 0`).
+    fn cascade(&mut self) {
+        for level in 1..WHEEL_LEVELS {
+            let slot = (self.base >> (WHEEL_BITS * level as u32)) & WHEEL_MASK;
+            self.replace_list((level * WHEEL_SIZE) as u32 + slot as u32, false);
+            if slot != 0 {
+                return;
+            }
+        }
+        self.replace_list(OVERFLOW_LIST, false);
+    }
+
+    /// Processes all ticks up to `target` (inclusive), moves events of these
+    /// ticks to the expired list.
+    fn advance(&mut self, target: u64) {
+        while self.base <= target {
+            if self.pending == 0 {
+                self.base = target + 1;
+                return;
+            }
+            if self.base & WHEEL_MASK == 0 {
+                self.cascade();
+            }
+            self.replace_list((self.base & WHEEL_MASK) as u32, true);
+            self.base += 1;
+
+            // skip empty slots of level 0 until the next level-1 boundary.
+            let curr_slot = self.base & WHEEL_MASK;
+            if curr_slot != 0 {
+                let end = ((self.base | WHEEL_MASK) + 1).min(target + 1);
+                let bits = self.occupied[0] >> curr_slot;
+                self.base = if bits == 0 {
+                    end
+                } else {
+                    (self.base + bits.trailing_zeros() as u64).min(end)
+                };
+            }
+        }
+    }
+}
+
+impl<E: TimerEvent> Default for TimerWheel<E> {
+    /// Creates a timer wheel with the granularity of 1 millisecond.
+    fn default() -> Self {
+        Self::new(TimeValue::from_millis(1))
+    }
+}
@@ -11,6 +11,7 @@
 extern crate log;
 extern crate alloc;
 
+mod magazine;
 mod page;
 
 use allocator::{AllocResult, BaseAllocator, ByteAllocator, PageAllocator};
@@ -32,6 +33,10 @@ pub use page::GlobalPage;
 ///
 /// Currently, [`SlabByteAllocator`] is used as the byte allocator, while
 /// [`BitmapPageAllocator`] is used as the page allocator.
+///
+/// Small allocations (up to 4096 bytes) are served by per-CPU magazines of
+/// free blocks in front of the byte allocator, which is locked only when a
+/// magazine needs to be refilled or drained.
 pub struct GlobalAllocator {
     balloc: SpinNoIrq<SlabByteAllocator>,
     palloc: SpinNoIrq<BitmapPageAllocator<PAGE_SIZE>>,
@@ -71,15 +76,67 @@ impl GlobalAllocator {
     /// Allocate arbitrary number of bytes. Returns the left bound of the
     /// allocated region.
     ///
-    /// It firstly tries to allocate from the byte allocator. If there is no
-    /// memory, it asks the page allocator for more memory and adds it to the
-    /// byte allocator.
+    /// Small blocks are allocated from the magazine of the current CPU. Others,
+    /// and the refills of the magazines, are allocated from the byte allocator.
+    /// If there is no memory, it asks the page allocator for more memory and
+    /// adds it to the byte allocator.
     ///
     /// `align_pow2` must be a power of 2, and the returned region bound will be
     ///  aligned to it.
     pub fn alloc(&self, size: usize, align_pow2: usize) -> AllocResult<usize> {
+        axtrace::trace_scope!("alloc");
+        if let Some(block_size) = magazine::block_size(size, align_pow2) {
+            magazine::alloc(block_size, |blocks| self.refill_blocks(block_size, blocks))
+        } else {
+            self.alloc_bytes(&mut self.balloc.lock(), size, align_pow2)
+        }
+    }
+
+    /// Gives back the allocated region to the magazine of the current CPU, or
+    /// to the byte allocator if it's not small.
+    ///
+    /// The region should be allocated by [`alloc`], and `align_pow2` should be
+    /// the same as the one used in [`alloc`]. Otherwise, the behavior is
+    /// undefined.
+    ///
+    /// [`alloc`]: GlobalAllocator::alloc
+    pub fn dealloc(&self, pos: usize, size: usize, align_pow2: usize) {
+        if let Some(block_size) = magazine::block_size(size, align_pow2) {
+            magazine::dealloc(block_size, pos, |blocks| {
+                let mut balloc = self.balloc.lock();
+                for &block in blocks {
+                    balloc.dealloc(block, block_size, block_size);
+                }
+            })
+        } else {
+            self.balloc.lock().dealloc(pos, size, align_pow2)
+        }
+    }
+
+    /// Returns the number of bytes that can be used in a region allocated by
+    /// [`alloc`] with the given size and alignment, which is at least `size`.
+    ///
+    /// Regions with the same usable size are in the same size class, so one
+    /// allocated with `size` can be freed by [`dealloc`] with any other size
+    /// of the same usable size.
+    ///
+    /// [`alloc`]: GlobalAllocator::alloc
+    /// [`dealloc`]: GlobalAllocator::dealloc
+    pub fn usable_size(&self, size: usize, align_pow2: usize) -> usize {
+        if let Some(block_size) = magazine::block_size(size, align_pow2) {
+            block_size
+        } else {
+            self.balloc.lock().usable_size(size, align_pow2)
+        }
+    }
+
+    fn alloc_bytes(
+        &self,
+        balloc: &mut SlabByteAllocator,
+        size: usize,
+        align_pow2: usize,
+    ) -> AllocResult<usize> {
         // simple two-level allocator: if no heap memory, allocate from the page allocator.
-        let mut balloc = self.balloc.lock();
         loop {
             if let Ok(ptr) = balloc.alloc(size, align_pow2) {
                 return Ok(ptr);
@@ -98,15 +155,19 @@ impl GlobalAllocator {
         }
     }
 
-    /// Gives back the allocated region to the byte allocator.
-    ///
-    /// The region should be allocated by [`alloc`], and `align_pow2` should be
-    /// the same as the one used in [`alloc`]. Otherwise, the behavior is
-    /// undefined.
-    ///
-    /// [`alloc`]: GlobalAllocator::alloc
-    pub fn dealloc(&self, pos: usize, size: usize, align_pow2: usize) {
-        self.balloc.lock().dealloc(pos, size, align_pow2)
+    /// Fills `blocks` with blocks of `block_size` bytes allocated from the byte
+    /// allocator under one lock. Returns the number of blocks filled, which is
+    /// less than requested only if the memory is exhausted.
+    fn refill_blocks(&self, block_size: usize, blocks: &mut [usize]) -> AllocResult<usize> {
+        let mut balloc = self.balloc.lock();
+        for (i, block) in blocks.iter_mut().enumerate() {
+            match self.alloc_bytes(&mut balloc, block_size, block_size) {
+                Ok(ptr) => *block = ptr,
+                Err(e) if i == 0 => return Err(e),
+                Err(_) => return Ok(i),
+            }
+        }
+        Ok(blocks.len())
     }
 
     /// Allocates contiguous pages.
@@ -130,7 +191,19 @@ impl GlobalAllocator {
         self.palloc.lock().dealloc_pages(pos, num_pages)
     }
 
+    /// Allocates the `num_pages` pages starting from `pos`, fails if any of
+    /// them is not free.
+    ///
+    /// It can be used to grow a region allocated by [`alloc_pages`] in place.
+    ///
+    /// [`alloc_pages`]: GlobalAllocator::alloc_pages
+    pub fn alloc_pages_at(&self, pos: usize, num_pages: usize) -> AllocResult {
+        self.palloc.lock().alloc_pages_at(pos, num_pages)
+    }
+
     /// Returns the number of allocated bytes in the byte allocator.
+    ///
+    /// Free blocks cached in the per-CPU magazines are counted as allocated.
     pub fn used_bytes(&self) -> usize {
         self.balloc.lock().used_bytes()
     }
@@ -0,0 +1,120 @@
+//! Per-CPU magazine caches of small memory blocks.
+//!
+//! Each CPU keeps a magazine (a small stack of free blocks) for every size
+//! class of the slab allocator (64 to 4096 bytes). Small allocations and
+//! deallocations are served by the magazines of the current CPU, without
+//! taking any global lock. The global byte allocator is locked only to refill
+//! an empty magazine or to drain a full one, [`BATCH_SIZE`] blocks at a time.
+
+use allocator::AllocResult;
+use kernel_guard::IrqSave;
+
+/// Number of size classes, i.e., 64, 128, ..., 4096 bytes.
+const NUM_SIZE_CLASSES: usize = 7;
+/// Block size of the smallest size class, in log2.
+const MIN_CLASS_SHIFT: usize = 6;
+/// Block size of the largest size class.
+const MAX_BLOCK_SIZE: usize = 1 << (MIN_CLASS_SHIFT + NUM_SIZE_CLASSES - 1);
+/// Number of free blocks a magazine can hold.
+const MAGAZINE_CAPACITY: usize = 32;
+/// Number of blocks moved between a magazine and the global byte allocator at
+/// a time.
+pub(crate) const BATCH_SIZE: usize = MAGAZINE_CAPACITY / 2;
+
+struct Magazine {
+    len: usize,
+    blocks: [usize; MAGAZINE_CAPACITY],
+}
+
+struct CpuCache {
+    magazines: [Magazine; NUM_SIZE_CLASSES],
+}
+
+#[percpu::def_percpu]
+static CPU_CACHE: CpuCache = CpuCache::new();
+
+impl Magazine {
+    const fn new() -> Self {
+        Self {
+            len: 0,
+            blocks: [0; MAGAZINE_CAPACITY],
+        }
+    }
+}
+
+impl CpuCache {
+    const fn new() -> Self {
+        const EMPTY: Magazine = Magazine::new();
+        Self {
+            magazines: [EMPTY; NUM_SIZE_CLASSES],
+        }
+    }
+}
+
+/// Returns the block size of the size class for the given size and alignment,
+/// or [`None`] if it's too large to be cached.
+///
+/// It's the same as the slab chosen by [`SlabByteAllocator`], so the blocks
+/// can be allocated from and freed to the slab with the layout
+/// `(block_size, block_size)`.
+///
+/// [`SlabByteAllocator`]: allocator::SlabByteAllocator
+pub(crate) fn block_size(size: usize, align_pow2: usize) -> Option<usize> {
+    if size > MAX_BLOCK_SIZE || align_pow2 > MAX_BLOCK_SIZE {
+        None
+    } else {
+        Some(
+            size.max(align_pow2)
+                .max(1 << MIN_CLASS_SHIFT)
+                .next_power_of_two(),
+        )
+    }
+}
+
+/// Runs `f` on the magazine of the given block size on the current CPU.
+fn with_magazine<T>(block_size: usize, f: impl FnOnce(&mut Magazine) -> T) -> T {
+    let class = block_size.trailing_zeros() as usize - MIN_CLASS_SHIFT;
+    // Disable IRQs rather than just preemption, since IRQ handlers (e.g., the
+    // timer tick that wakes up tasks) may allocate too. It also prevents the
+    // current task from being migrated to other CPUs.
+    let _guard = IrqSave::new();
+    // Safety: the magazines are only accessed by the current CPU, with IRQs
+    // disabled.
+    f(unsafe { &mut CPU_CACHE.current_ref_mut_raw().magazines[class] })
+}
+
+/// Allocates a block of `block_size` bytes from the current CPU's magazine.
+///
+/// If the magazine is empty, `refill` is called to fill at most [`BATCH_SIZE`]
+/// blocks into the given slice, and returns the number of blocks filled.
+pub(crate) fn alloc<F>(block_size: usize, refill: F) -> AllocResult<usize>
+where
+    F: FnOnce(&mut [usize]) -> AllocResult<usize>,
+{
+    with_magazine(block_size, |mag| {
+        if mag.len == 0 {
+            mag.len = refill(&mut mag.blocks[..BATCH_SIZE])?;
+        }
+        mag.len -= 1;
+        Ok(mag.blocks[mag.len])
+    })
+}
+
+/// Frees a block of `block_size` bytes to the current CPU's magazine.
+///
+/// If the magazine is full, the [`BATCH_SIZE`] least recently freed blocks in
+/// it are passed to `drain` to be freed to the global byte allocator.
+pub(crate) fn dealloc<F>(block_size: usize, pos: usize, drain: F)
+where
+    F: FnOnce(&[usize]),
+{
+    with_magazine(block_size, |mag| {
+        if mag.len == MAGAZINE_CAPACITY {
+            drain(&mag.blocks[..BATCH_SIZE]);
+            mag.blocks.copy_within(BATCH_SIZE.., 0);
+            mag.len -= BATCH_SIZE;
+        }
+        mag.blocks[mag.len] = pos;
+        mag.len += 1;
+    })
+}
@@ -5,9 +5,15 @@ impl AllDevices {
     pub(crate) fn probe_bus_devices(&mut self) {
         // TODO: parse device tree
         #[cfg(feature = "virtio")]
-        for reg in axconfig::VIRTIO_MMIO_REGIONS {
+        for (i, reg) in axconfig::VIRTIO_MMIO_REGIONS.iter().enumerate() {
+            // IRQs of VirtIO MMIO devices are consecutive, in the same order
+            // as their regions. A zero base means they are not supported.
+            let irq_num = match axconfig::VIRTIO_MMIO_IRQ_BASE {
+                0 => None,
+                base => Some(base + i),
+            };
             for_each_drivers!(type Driver, {
-                if let Some(dev) = Driver::probe_mmio(reg.0, reg.1) {
+                if let Some(dev) = Driver::probe_mmio(reg.0, reg.1, irq_num) {
                     info!(
                         "registered a new {:?} device at [PA:{:#x}, PA:{:#x}): {:?}",
                         dev.device_type(),
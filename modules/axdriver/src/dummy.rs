@@ -25,10 +25,12 @@ cfg_if! {
             fn can_receive(&self) -> bool { false }
             fn rx_queue_size(&self) -> usize { 0 }
             fn tx_queue_size(&self) -> usize { 0 }
+            fn ack_interrupt(&mut self) -> bool { false }
             fn fill_rx_buffers(&mut self, _: &NetBufferPool) -> DevResult { Err(DevError::Unsupported) }
             fn prepare_tx_buffer(&self, _: &mut NetBuffer, _: usize) -> DevResult { Err(DevError::Unsupported) }
             fn recycle_rx_buffer(&mut self, _: NetBufferBox<'a>) -> DevResult { Err(DevError::Unsupported) }
-            fn transmit(&mut self, _: &NetBuffer) -> DevResult { Err(DevError::Unsupported) }
+            fn recycle_tx_buffers(&mut self) -> DevResult { Err(DevError::Unsupported) }
+            fn transmit(&mut self, _: NetBuffer<'a>) -> DevResult { Err(DevError::Unsupported) }
             fn receive(&mut self) -> DevResult<NetBufferBox<'a>> { Err(DevError::Unsupported) }
         }
     }
@@ -25,7 +25,9 @@ pub trait VirtIoDevMeta {
     type Device: BaseDriverOps;
     type Driver = VirtIoDriver<Self>;
 
-    fn try_new(transport: VirtIoTransport) -> DevResult<AxDeviceEnum>;
+    /// Creates the device from the probed transport. `irq_num` is the IRQ
+    /// number of the device if known.
+    fn try_new(transport: VirtIoTransport, irq_num: Option<usize>) -> DevResult<AxDeviceEnum>;
 }
 
 cfg_if! {
@@ -36,8 +38,8 @@ cfg_if! {
             const DEVICE_TYPE: DeviceType = DeviceType::Net;
             type Device = driver_virtio::VirtIoNetDev<'static, VirtIoHalImpl, VirtIoTransport, 64>;
 
-            fn try_new(transport: VirtIoTransport) -> DevResult<AxDeviceEnum> {
-                Ok(AxDeviceEnum::from_net(Self::Device::try_new(transport)?))
+            fn try_new(transport: VirtIoTransport, irq_num: Option<usize>) -> DevResult<AxDeviceEnum> {
+                Ok(AxDeviceEnum::from_net(Self::Device::try_new(transport, irq_num)?))
             }
         }
     }
@@ -51,8 +53,8 @@ cfg_if! {
             const DEVICE_TYPE: DeviceType = DeviceType::Block;
             type Device = driver_virtio::VirtIoBlkDev<VirtIoHalImpl, VirtIoTransport>;
 
-            fn try_new(transport: VirtIoTransport) -> DevResult<AxDeviceEnum> {
-                Ok(AxDeviceEnum::from_block(Self::Device::try_new(transport)?))
+            fn try_new(transport: VirtIoTransport, irq_num: Option<usize>) -> DevResult<AxDeviceEnum> {
+                Ok(AxDeviceEnum::from_block(Self::Device::try_new(transport, irq_num)?))
             }
         }
     }
@@ -66,7 +68,7 @@ cfg_if! {
             const DEVICE_TYPE: DeviceType = DeviceType::Display;
             type Device = driver_virtio::VirtIoGpuDev<VirtIoHalImpl, VirtIoTransport>;
 
-            fn try_new(transport: VirtIoTransport) -> DevResult<AxDeviceEnum> {
+            fn try_new(transport: VirtIoTransport, _irq_num: Option<usize>) -> DevResult<AxDeviceEnum> {
                 Ok(AxDeviceEnum::from_display(Self::Device::try_new(transport)?))
             }
         }
@@ -78,13 +80,17 @@ pub struct VirtIoDriver<D: VirtIoDevMeta + ?Sized>(PhantomData<D>);
 
 impl<D: VirtIoDevMeta> DriverProbe for VirtIoDriver<D> {
     #[cfg(bus = "mmio")]
-    fn probe_mmio(mmio_base: usize, mmio_size: usize) -> Option<AxDeviceEnum> {
+    fn probe_mmio(
+        mmio_base: usize,
+        mmio_size: usize,
+        irq_num: Option<usize>,
+    ) -> Option<AxDeviceEnum> {
         let base_vaddr = phys_to_virt(mmio_base.into());
         if let Some((ty, transport)) =
             driver_virtio::probe_mmio_device(base_vaddr.as_mut_ptr(), mmio_size)
         {
             if ty == D::DEVICE_TYPE {
-                match D::try_new(transport) {
+                match D::try_new(transport, irq_num) {
                     Ok(dev) => return Some(dev),
                     Err(e) => {
                         warn!(
@@ -121,7 +127,8 @@ impl<D: VirtIoDevMeta> DriverProbe for VirtIoDriver<D> {
             driver_virtio::probe_pci_device::<VirtIoHalImpl>(root, bdf, dev_info)
         {
             if ty == D::DEVICE_TYPE {
-                match D::try_new(transport) {
+                // TODO: legacy INTx and MSI-X interrupts of PCI devices
+                match D::try_new(transport, None) {
                     Ok(dev) => return Some(dev),
                     Err(e) => {
                         warn!(
@@ -156,6 +156,12 @@ impl File {
     pub fn metadata(&self) -> Result<Metadata> {
         self.inner.get_attr().map(Metadata)
     }
+
+    /// Reads a number of bytes starting from a given offset, without moving
+    /// the cursor. Returns the number of bytes read.
+    pub fn read_at(&self, buf: &mut [u8], offset: u64) -> Result<usize> {
+        self.inner.read_at(offset, buf)
+    }
 }
 
 impl Read for File {
@@ -1,12 +1,416 @@
+use alloc::{collections::BTreeMap, vec, vec::Vec};
 use axdriver::prelude::*;
 
+use crate::queue::{BlockQueue, RequestId};
+
 const BLOCK_SIZE: usize = 512;
 
+/// Maximum number of blocks in the block cache.
+const CACHE_SIZE: usize = 1024;
+/// Number of blocks to read ahead on a miss of sequential reads.
+const READ_AHEAD_SIZE: u64 = 16;
+/// Reads and writes of whole blocks of at least this size bypass the cache.
+const DIRECT_IO_SIZE: usize = 2 * BLOCK_SIZE;
+/// Write back all dirty blocks once there are this many.
+const DIRTY_LIMIT: usize = CACHE_SIZE / 4;
+
+const NIL: usize = usize::MAX;
+
+/// Statistics of the block cache of a [`Disk`].
+#[derive(Debug, Default, Clone, Copy)]
+pub struct CacheStats {
+    /// Number of block accesses served by the cache.
+    pub hits: u64,
+    /// Number of block accesses that missed the cache.
+    pub misses: u64,
+    /// Number of blocks read ahead.
+    pub read_ahead: u64,
+    /// Number of dirty blocks written back to the device.
+    pub write_backs: u64,
+}
+
+struct CacheEntry {
+    block_id: u64,
+    dirty: bool,
+    prev: usize,
+    next: usize,
+}
+
+/// Blocks being read ahead asynchronously.
+struct ReadAhead {
+    start_block: u64,
+    num_blocks: u64,
+    buf: Vec<u8>,
+    id: RequestId,
+}
+
+impl ReadAhead {
+    fn contains(&self, block_id: u64) -> bool {
+        (self.start_block..self.start_block + self.num_blocks).contains(&block_id)
+    }
+}
+
+/// An LRU cache of disk blocks.
+///
+/// Writes only dirty the cached blocks, which are written back to the device
+/// when evicted, when there are too many of them, or on [`flush`].
+///
+/// [`flush`]: BlockCache::flush
+struct BlockCache {
+    entries: Vec<CacheEntry>,
+    data: Vec<[u8; BLOCK_SIZE]>,
+    /// Block ID to the index of the entry.
+    map: BTreeMap<u64, usize>,
+    /// Entries not in use (e.g., failed to read).
+    free: Vec<usize>,
+    /// The most recently used entry.
+    head: usize,
+    /// The least recently used entry.
+    tail: usize,
+    num_dirty: usize,
+    /// The block that a sequential read would access next.
+    next_seq_block: u64,
+    /// The read ahead in flight, if the device is asynchronous.
+    pending: Option<ReadAhead>,
+    stats: CacheStats,
+}
+
+impl BlockCache {
+    fn new() -> Self {
+        Self {
+            entries: Vec::new(),
+            data: Vec::new(),
+            map: BTreeMap::new(),
+            free: Vec::new(),
+            head: NIL,
+            tail: NIL,
+            num_dirty: 0,
+            next_seq_block: 0,
+            pending: None,
+            stats: CacheStats::default(),
+        }
+    }
+
+    fn unlink(&mut self, idx: usize) {
+        let (prev, next) = (self.entries[idx].prev, self.entries[idx].next);
+        match prev {
+            NIL => self.head = next,
+            _ => self.entries[prev].next = next,
+        }
+        match next {
+            NIL => self.tail = prev,
+            _ => self.entries[next].prev = prev,
+        }
+    }
+
+    fn push_front(&mut self, idx: usize) {
+        self.entries[idx].prev = NIL;
+        self.entries[idx].next = self.head;
+        match self.head {
+            NIL => self.tail = idx,
+            head => self.entries[head].prev = idx,
+        }
+        self.head = idx;
+    }
+
+    /// Looks up the block, and marks it as the most recently used if found.
+    fn lookup(&mut self, block_id: u64) -> Option<usize> {
+        let idx = *self.map.get(&block_id)?;
+        if self.head != idx {
+            self.unlink(idx);
+            self.push_front(idx);
+        }
+        Some(idx)
+    }
+
+    fn write_back(&mut self, dev: &mut BlockQueue, idx: usize) -> DevResult {
+        let entry = &mut self.entries[idx];
+        if entry.dirty {
+            dev.write_blocks(entry.block_id, &self.data[idx])?;
+            entry.dirty = false;
+            self.num_dirty -= 1;
+            self.stats.write_backs += 1;
+        }
+        Ok(())
+    }
+
+    /// Gets an entry not in the cache, evicts the least recently used one if
+    /// the cache is full.
+    fn alloc_entry(&mut self, dev: &mut BlockQueue) -> DevResult<usize> {
+        if let Some(idx) = self.free.pop() {
+            return Ok(idx);
+        }
+        if self.entries.len() < CACHE_SIZE {
+            self.entries.push(CacheEntry {
+                block_id: 0,
+                dirty: false,
+                prev: NIL,
+                next: NIL,
+            });
+            self.data.push([0; BLOCK_SIZE]);
+            return Ok(self.entries.len() - 1);
+        }
+        if self.entries[self.tail].dirty {
+            // the evicted block will be written back, see `finish_read_ahead`.
+            self.finish_read_ahead(dev)?;
+        }
+        let idx = self.tail;
+        self.write_back(dev, idx)?;
+        self.unlink(idx);
+        self.map.remove(&self.entries[idx].block_id);
+        Ok(idx)
+    }
+
+    /// Reads the block from the device into a new entry.
+    fn fill(&mut self, dev: &mut BlockQueue, block_id: u64) -> DevResult<usize> {
+        let idx = self.alloc_entry(dev)?;
+        if let Err(e) = dev.read_blocks(block_id, &mut self.data[idx]) {
+            self.free.push(idx);
+            return Err(e);
+        }
+        self.insert(idx, block_id);
+        Ok(idx)
+    }
+
+    fn insert(&mut self, idx: usize, block_id: u64) {
+        self.entries[idx].block_id = block_id;
+        self.entries[idx].dirty = false;
+        self.map.insert(block_id, idx);
+        self.push_front(idx);
+    }
+
+    /// Returns the number of uncached blocks from `start_block`, at most
+    /// `max_blocks` of them. The first block is assumed to be uncached.
+    fn uncached_run(&self, dev: &BlockQueue, start_block: u64, max_blocks: u64) -> u64 {
+        let end = (start_block + max_blocks).min(dev.num_blocks());
+        let mut num_blocks = 1;
+        while start_block + num_blocks < end && !self.map.contains_key(&(start_block + num_blocks))
+        {
+            num_blocks += 1;
+        }
+        num_blocks
+    }
+
+    /// Reads a run of uncached blocks from `start_block` in one request, at
+    /// most `max_blocks` of them. Returns the entry of the first block.
+    fn fill_run(
+        &mut self,
+        dev: &mut BlockQueue,
+        start_block: u64,
+        max_blocks: u64,
+    ) -> DevResult<usize> {
+        let num_blocks = self.uncached_run(dev, start_block, max_blocks);
+        if num_blocks == 1 {
+            return self.fill(dev, start_block);
+        }
+
+        let mut buf = vec![0; num_blocks as usize * BLOCK_SIZE];
+        dev.read_blocks(start_block, &mut buf)?;
+        // insert backwards, so the first block is the most recently used.
+        let mut idx = NIL;
+        for (i, data) in buf.chunks_exact(BLOCK_SIZE).enumerate().rev() {
+            idx = self.alloc_entry(dev)?;
+            self.data[idx].copy_from_slice(data);
+            self.insert(idx, start_block + i as u64);
+        }
+        self.stats.read_ahead += num_blocks - 1;
+        Ok(idx)
+    }
+
+    /// Submits an asynchronous request to read ahead the uncached blocks from
+    /// `start_block`, if no read ahead is in flight.
+    fn start_read_ahead(&mut self, dev: &mut BlockQueue, start_block: u64) -> DevResult {
+        if self.pending.is_some()
+            || start_block >= dev.num_blocks()
+            || self.map.contains_key(&start_block)
+        {
+            return Ok(());
+        }
+        let num_blocks = self.uncached_run(dev, start_block, READ_AHEAD_SIZE);
+        let mut buf = vec![0; num_blocks as usize * BLOCK_SIZE];
+        // Safety: the heap buffer is kept in `self.pending` and not accessed
+        // until the request is waited in `finish_read_ahead`.
+        if let Some(id) = unsafe { dev.submit_read(start_block, &mut buf)? } {
+            self.pending = Some(ReadAhead {
+                start_block,
+                num_blocks,
+                buf,
+                id,
+            });
+        }
+        Ok(())
+    }
+
+    /// Waits for the read ahead in flight, and inserts the blocks that are
+    /// still not cached.
+    ///
+    /// It must be done before any block is written to the device, otherwise
+    /// the blocks read ahead may be stale.
+    fn finish_read_ahead(&mut self, dev: &mut BlockQueue) -> DevResult {
+        let Some(ra) = self.pending.take() else {
+            return Ok(());
+        };
+        dev.wait(ra.id)?;
+        // Allocate all entries before inserting any: an allocation may evict
+        // (and write back) a block in the range that was written after the
+        // read ahead was submitted, which must not be replaced by the stale
+        // data read ahead.
+        let blocks: Vec<usize> = (0..ra.buf.len() / BLOCK_SIZE)
+            .filter(|&i| !self.map.contains_key(&(ra.start_block + i as u64)))
+            .collect();
+        let mut entries = Vec::with_capacity(blocks.len());
+        for _ in 0..blocks.len() {
+            match self.alloc_entry(dev) {
+                Ok(idx) => entries.push(idx),
+                Err(e) => {
+                    self.free.extend(entries);
+                    return Err(e);
+                }
+            }
+        }
+        // insert backwards, so the first block is the most recently used.
+        for (&i, idx) in blocks.iter().zip(entries).rev() {
+            self.data[idx].copy_from_slice(&ra.buf[i * BLOCK_SIZE..(i + 1) * BLOCK_SIZE]);
+            self.insert(idx, ra.start_block + i as u64);
+            self.stats.read_ahead += 1;
+        }
+        Ok(())
+    }
+
+    /// Returns the data of the block to read.
+    fn read(&mut self, dev: &mut BlockQueue, block_id: u64) -> DevResult<&[u8; BLOCK_SIZE]> {
+        let sequential = block_id == self.next_seq_block;
+        self.next_seq_block = block_id + 1;
+        if self
+            .pending
+            .as_ref()
+            .map_or(false, |ra| ra.contains(block_id))
+        {
+            self.finish_read_ahead(dev)?;
+        }
+        let idx = if let Some(idx) = self.lookup(block_id) {
+            self.stats.hits += 1;
+            idx
+        } else {
+            self.stats.misses += 1;
+            if sequential && dev.is_async() {
+                // read the following blocks while reading the requested one.
+                self.finish_read_ahead(dev)?;
+                self.start_read_ahead(dev, block_id + 1)?;
+                self.fill(dev, block_id)?
+            } else if sequential {
+                self.fill_run(dev, block_id, 1 + READ_AHEAD_SIZE)?
+            } else {
+                self.fill(dev, block_id)?
+            }
+        };
+        Ok(&self.data[idx])
+    }
+
+    /// Reads whole blocks from `start_block` into `buf`.
+    ///
+    /// Cached blocks are copied from the cache, while each run of uncached
+    /// blocks is read from the device in one request, without being cached.
+    fn read_direct(&mut self, dev: &mut BlockQueue, start_block: u64, buf: &mut [u8]) -> DevResult {
+        let num_blocks = (buf.len() / BLOCK_SIZE) as u64;
+        let mut i = 0;
+        while i < num_blocks {
+            let offset = i as usize * BLOCK_SIZE;
+            if let Some(&idx) = self.map.get(&(start_block + i)) {
+                self.stats.hits += 1;
+                buf[offset..offset + BLOCK_SIZE].copy_from_slice(&self.data[idx]);
+                i += 1;
+            } else {
+                let run_start = i;
+                while i < num_blocks && !self.map.contains_key(&(start_block + i)) {
+                    i += 1;
+                }
+                self.stats.misses += i - run_start;
+                let end = i as usize * BLOCK_SIZE;
+                dev.read_blocks(start_block + run_start, &mut buf[offset..end])?;
+            }
+        }
+        self.next_seq_block = start_block + num_blocks;
+        Ok(())
+    }
+
+    /// Writes whole blocks from `start_block` to the device in one request.
+    ///
+    /// Cached copies of the blocks are updated, and become clean.
+    fn write_direct(&mut self, dev: &mut BlockQueue, start_block: u64, buf: &[u8]) -> DevResult {
+        self.finish_read_ahead(dev)?;
+        dev.write_blocks(start_block, buf)?;
+        for (i, data) in buf.chunks_exact(BLOCK_SIZE).enumerate() {
+            if let Some(&idx) = self.map.get(&(start_block + i as u64)) {
+                self.data[idx].copy_from_slice(data);
+                if self.entries[idx].dirty {
+                    self.entries[idx].dirty = false;
+                    self.num_dirty -= 1;
+                }
+            }
+        }
+        Ok(())
+    }
+
+    /// Returns the data of the block to write, and marks it dirty.
+    ///
+    /// The block is not read from the device if it will be `overwritten` as a
+    /// whole.
+    fn write(
+        &mut self,
+        dev: &mut BlockQueue,
+        block_id: u64,
+        overwritten: bool,
+    ) -> DevResult<&mut [u8; BLOCK_SIZE]> {
+        if self.num_dirty >= DIRTY_LIMIT {
+            self.flush(dev)?;
+        }
+        let idx = if let Some(idx) = self.lookup(block_id) {
+            self.stats.hits += 1;
+            idx
+        } else {
+            self.stats.misses += 1;
+            if overwritten {
+                let idx = self.alloc_entry(dev)?;
+                self.insert(idx, block_id);
+                idx
+            } else {
+                self.fill(dev, block_id)?
+            }
+        };
+        if !self.entries[idx].dirty {
+            self.entries[idx].dirty = true;
+            self.num_dirty += 1;
+        }
+        Ok(&mut self.data[idx])
+    }
+
+    /// Writes back all dirty blocks, in the order of block IDs.
+    fn flush(&mut self, dev: &mut BlockQueue) -> DevResult {
+        self.finish_read_ahead(dev)?;
+        if self.num_dirty > 0 {
+            let dirty = self
+                .map
+                .values()
+                .copied()
+                .filter(|&idx| self.entries[idx].dirty)
+                .collect::<Vec<_>>();
+            for idx in dirty {
+                self.write_back(dev, idx)?;
+            }
+        }
+        Ok(())
+    }
+}
+
 /// A disk device with a cursor.
+///
+/// Blocks are accessed through an LRU block cache, see [`CacheStats`].
 pub struct Disk {
     block_id: u64,
     offset: usize,
-    dev: AxBlockDevice,
+    dev: BlockQueue,
+    cache: BlockCache,
 }
 
 impl Disk {
@@ -16,7 +420,8 @@ impl Disk {
         Self {
             block_id: 0,
             offset: 0,
-            dev,
+            dev: BlockQueue::new(dev),
+            cache: BlockCache::new(),
         }
     }
 
@@ -36,57 +441,74 @@ impl Disk {
         self.offset = pos as usize % BLOCK_SIZE;
     }
 
-    /// Read within one block, returns the number of bytes read.
-    pub fn read_one(&mut self, buf: &mut [u8]) -> DevResult<usize> {
-        let read_size = if self.offset == 0 && buf.len() >= BLOCK_SIZE {
-            // whole block
-            self.dev
-                .read_block(self.block_id, &mut buf[0..BLOCK_SIZE])?;
+    /// Get the statistics of the block cache.
+    pub fn cache_stats(&self) -> CacheStats {
+        self.cache.stats
+    }
+
+    fn advance(&mut self, count: usize) {
+        self.offset += count;
+        if self.offset >= BLOCK_SIZE {
             self.block_id += 1;
-            BLOCK_SIZE
-        } else {
-            // partial block
-            let mut data = [0u8; BLOCK_SIZE];
-            let start = self.offset;
-            let count = buf.len().min(BLOCK_SIZE - self.offset);
-
-            self.dev.read_block(self.block_id, &mut data)?;
-            buf[..count].copy_from_slice(&data[start..start + count]);
-
-            self.offset += count;
-            if self.offset >= BLOCK_SIZE {
-                self.block_id += 1;
-                self.offset -= BLOCK_SIZE;
-            }
-            count
-        };
-        Ok(read_size)
+            self.offset -= BLOCK_SIZE;
+        }
+    }
+
+    /// Read within one block, or whole blocks if the cursor is at a block
+    /// boundary. Returns the number of bytes read.
+    ///
+    /// Multiple whole blocks are read from the device in large requests,
+    /// bypassing the cache.
+    pub fn read_one(&mut self, buf: &mut [u8]) -> DevResult<usize> {
+        if self.offset == 0 && buf.len() >= DIRECT_IO_SIZE {
+            let len = buf.len() / BLOCK_SIZE * BLOCK_SIZE;
+            self.cache
+                .read_direct(&mut self.dev, self.block_id, &mut buf[..len])?;
+            self.block_id += (len / BLOCK_SIZE) as u64;
+            return Ok(len);
+        }
+        let start = self.offset;
+        let count = buf.len().min(BLOCK_SIZE - start);
+        let data = self.cache.read(&mut self.dev, self.block_id)?;
+        buf[..count].copy_from_slice(&data[start..start + count]);
+        self.advance(count);
+        Ok(count)
     }
 
-    /// Write within one block, returns the number of bytes written.
+    /// Write within one block, or whole blocks if the cursor is at a block
+    /// boundary. Returns the number of bytes written.
+    ///
+    /// Multiple whole blocks are written to the device in large requests.
+    /// Otherwise, the data is written to the block cache, call
+    /// [`flush`](Self::flush) to write it to the device.
     pub fn write_one(&mut self, buf: &[u8]) -> DevResult<usize> {
-        let write_size = if self.offset == 0 && buf.len() >= BLOCK_SIZE {
-            // whole block
-            self.dev.write_block(self.block_id, &buf[0..BLOCK_SIZE])?;
-            self.block_id += 1;
-            BLOCK_SIZE
-        } else {
-            // partial block
-            let mut data = [0u8; BLOCK_SIZE];
-            let start = self.offset;
-            let count = buf.len().min(BLOCK_SIZE - self.offset);
-
-            self.dev.read_block(self.block_id, &mut data)?;
-            data[start..start + count].copy_from_slice(&buf[..count]);
-            self.dev.write_block(self.block_id, &data)?;
-
-            self.offset += count;
-            if self.offset >= BLOCK_SIZE {
-                self.block_id += 1;
-                self.offset -= BLOCK_SIZE;
-            }
-            count
-        };
-        Ok(write_size)
+        if self.offset == 0 && buf.len() >= DIRECT_IO_SIZE {
+            let len = buf.len() / BLOCK_SIZE * BLOCK_SIZE;
+            self.cache
+                .write_direct(&mut self.dev, self.block_id, &buf[..len])?;
+            self.block_id += (len / BLOCK_SIZE) as u64;
+            return Ok(len);
+        }
+        let start = self.offset;
+        let count = buf.len().min(BLOCK_SIZE - start);
+        let data = self
+            .cache
+            .write(&mut self.dev, self.block_id, count == BLOCK_SIZE)?;
+        data[start..start + count].copy_from_slice(&buf[..count]);
+        self.advance(count);
+        Ok(count)
+    }
+
+    /// Write back all dirty blocks in the cache, and flush the device.
+    pub fn flush(&mut self) -> DevResult {
+        self.cache.flush(&mut self.dev)?;
+        self.dev.flush()
+    }
+}
+
+impl Drop for Disk {
+    fn drop(&mut self) {
+        // the buffer of the read ahead must outlive the request.
+        self.cache.finish_read_ahead(&mut self.dev).ok();
     }
 }
@@ -7,7 +7,7 @@ use capability::{Cap, WithCap};
 use core::fmt;
 
 #[cfg(feature = "myfs")]
-pub use crate::dev::Disk;
+pub use crate::dev::{CacheStats, Disk};
 #[cfg(feature = "myfs")]
 pub use crate::fs::myfs::MyFileSystemIf;
 
@@ -182,6 +182,14 @@ impl File {
         Ok(read_len)
     }
 
+    /// Reads the file at the given offset, without moving the cursor. Returns
+    /// the number of bytes read.
+    pub fn read_at(&self, offset: u64, buf: &mut [u8]) -> AxResult<usize> {
+        let node = self.node.access(Cap::READ)?;
+        let read_len = node.read_at(offset, buf)?;
+        Ok(read_len)
+    }
+
     /// Writes the file at the current position. Returns the number of bytes
     /// written.
     ///
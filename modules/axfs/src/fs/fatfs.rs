@@ -1,5 +1,5 @@
 use alloc::sync::Arc;
-use core::cell::UnsafeCell;
+use core::{cell::UnsafeCell, mem::ManuallyDrop};
 
 use axfs_vfs::{VfsDirEntry, VfsError, VfsNodePerm, VfsResult};
 use axfs_vfs::{VfsNodeAttr, VfsNodeOps, VfsNodeRef, VfsNodeType, VfsOps};
@@ -10,12 +10,20 @@ use crate::dev::Disk;
 
 const BLOCK_SIZE: usize = 512;
 
+/// Serializes all operations on the filesystem.
+///
+/// `fatfs` is not thread-safe, while its disk I/O may sleep until the block
+/// device completes the requests, letting other tasks run.
+static FS_LOCK: Mutex<()> = Mutex::new(());
+
 pub struct FatFileSystem {
     inner: fatfs::FileSystem<Disk, NullTimeProvider, LossyOemCpConverter>,
     root_dir: UnsafeCell<Option<VfsNodeRef>>,
 }
 
-pub struct FileWrapper<'a>(Mutex<File<'a, Disk, NullTimeProvider, LossyOemCpConverter>>);
+pub struct FileWrapper<'a>(
+    Mutex<ManuallyDrop<File<'a, Disk, NullTimeProvider, LossyOemCpConverter>>>,
+);
 pub struct DirWrapper<'a>(Dir<'a, Disk, NullTimeProvider, LossyOemCpConverter>);
 
 unsafe impl Sync for FatFileSystem {}
@@ -54,7 +62,7 @@ impl FatFileSystem {
     }
 
     fn new_file(file: File<'_, Disk, NullTimeProvider, LossyOemCpConverter>) -> Arc<FileWrapper> {
-        Arc::new(FileWrapper(Mutex::new(file)))
+        Arc::new(FileWrapper(Mutex::new(ManuallyDrop::new(file))))
     }
 
     fn new_dir(dir: Dir<'_, Disk, NullTimeProvider, LossyOemCpConverter>) -> Arc<DirWrapper> {
@@ -66,6 +74,7 @@ impl VfsNodeOps for FileWrapper<'static> {
     axfs_vfs::impl_vfs_non_dir_default! {}
 
     fn get_attr(&self) -> VfsResult<VfsNodeAttr> {
+        let _guard = FS_LOCK.lock();
         let size = self.0.lock().seek(SeekFrom::End(0)).map_err(as_vfs_err)?;
         let blocks = (size + BLOCK_SIZE as u64 - 1) / BLOCK_SIZE as u64;
         // FAT fs doesn't support permissions, we just set everything to 755
@@ -74,22 +83,38 @@ impl VfsNodeOps for FileWrapper<'static> {
     }
 
     fn read_at(&self, offset: u64, buf: &mut [u8]) -> VfsResult<usize> {
+        let _guard = FS_LOCK.lock();
         let mut file = self.0.lock();
         file.seek(SeekFrom::Start(offset)).map_err(as_vfs_err)?; // TODO: more efficient
         file.read(buf).map_err(as_vfs_err)
     }
 
     fn write_at(&self, offset: u64, buf: &[u8]) -> VfsResult<usize> {
+        let _guard = FS_LOCK.lock();
         let mut file = self.0.lock();
         file.seek(SeekFrom::Start(offset)).map_err(as_vfs_err)?; // TODO: more efficient
         file.write(buf).map_err(as_vfs_err)
     }
 
     fn truncate(&self, size: u64) -> VfsResult {
+        let _guard = FS_LOCK.lock();
         let mut file = self.0.lock();
         file.seek(SeekFrom::Start(size)).map_err(as_vfs_err)?; // TODO: more efficient
         file.truncate().map_err(as_vfs_err)
     }
+
+    fn fsync(&self) -> VfsResult {
+        let _guard = FS_LOCK.lock();
+        self.0.lock().flush().map_err(as_vfs_err)
+    }
+}
+
+impl Drop for FileWrapper<'_> {
+    fn drop(&mut self) {
+        // dropping the file flushes it to the disk.
+        let _guard = FS_LOCK.lock();
+        unsafe { ManuallyDrop::drop(self.0.get_mut()) };
+    }
 }
 
 impl VfsNodeOps for DirWrapper<'static> {
@@ -106,6 +131,7 @@ impl VfsNodeOps for DirWrapper<'static> {
     }
 
     fn parent(&self) -> Option<VfsNodeRef> {
+        let _guard = FS_LOCK.lock();
         self.0
             .open_dir("..")
             .map_or(None, |dir| Some(FatFileSystem::new_dir(dir)))
@@ -121,6 +147,7 @@ impl VfsNodeOps for DirWrapper<'static> {
             return self.lookup(rest);
         }
 
+        let _guard = FS_LOCK.lock();
         // TODO: use `fatfs::Dir::find_entry`, but it's not public.
         if let Ok(file) = self.0.open_file(path) {
             Ok(FatFileSystem::new_file(file))
@@ -141,6 +168,7 @@ impl VfsNodeOps for DirWrapper<'static> {
             return self.create(rest, ty);
         }
 
+        let _guard = FS_LOCK.lock();
         match ty {
             VfsNodeType::File => {
                 self.0.create_file(path).map_err(as_vfs_err)?;
@@ -161,10 +189,12 @@ impl VfsNodeOps for DirWrapper<'static> {
         if let Some(rest) = path.strip_prefix("./") {
             return self.remove(rest);
         }
+        let _guard = FS_LOCK.lock();
         self.0.remove(path).map_err(as_vfs_err)
     }
 
     fn read_dir(&self, start_idx: usize, dirents: &mut [VfsDirEntry]) -> VfsResult<usize> {
+        let _guard = FS_LOCK.lock();
         let mut iter = self.0.iter().skip(start_idx);
         for (i, out_entry) in dirents.iter_mut().enumerate() {
             let x = iter.next();
@@ -231,7 +261,7 @@ impl Write for Disk {
         Ok(write_len)
     }
     fn flush(&mut self) -> Result<(), Self::Error> {
-        Ok(())
+        Disk::flush(self).map_err(|_| ())
     }
 }
 
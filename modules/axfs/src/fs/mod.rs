@@ -9,5 +9,11 @@ cfg_if::cfg_if! {
 #[cfg(feature = "devfs")]
 pub use axfs_devfs as devfs;
 
+#[cfg(feature = "devfs")]
+mod tracedev;
+
+#[cfg(feature = "devfs")]
+pub use tracedev::TraceDev;
+
 #[cfg(feature = "ramfs")]
 pub use axfs_ramfs as ramfs;
@@ -0,0 +1,31 @@
+use alloc::string::String;
+use axfs_vfs::{VfsNodeAttr, VfsNodeOps, VfsNodePerm, VfsNodeType, VfsResult};
+
+/// A device that reports the statistics of the tracepoints (see [`axtrace`])
+/// in text when read, like `/dev/trace`.
+///
+/// The report is generated again on each read, so a reader should read it in
+/// one go with a large enough buffer to get a consistent snapshot.
+pub struct TraceDev;
+
+impl VfsNodeOps for TraceDev {
+    fn get_attr(&self) -> VfsResult<VfsNodeAttr> {
+        Ok(VfsNodeAttr::new(
+            VfsNodePerm::from_bits_truncate(0o444),
+            VfsNodeType::CharDevice,
+            0,
+            0,
+        ))
+    }
+
+    fn read_at(&self, offset: u64, buf: &mut [u8]) -> VfsResult<usize> {
+        let mut report = String::new();
+        axtrace::report(&mut report).ok();
+        let start = report.len().min(offset as usize);
+        let len = buf.len().min(report.len() - start);
+        buf[..len].copy_from_slice(&report.as_bytes()[start..start + len]);
+        Ok(len)
+    }
+
+    axfs_vfs::impl_vfs_non_dir_default! {}
+}
@@ -6,8 +6,9 @@
 //!
 //! - `fatfs`: Use [FAT] as the main filesystem and mount it on `/`. This feature
 //!    is **enabled** by default.
-//! - `devfs`: Mount [`axfs_devfs::DeviceFileSystem`] on `/dev`. This feature is
-//!    **enabled** by default.
+//! - `devfs`: Mount [`axfs_devfs::DeviceFileSystem`] on `/dev`, with
+//!    `/dev/trace` if the tracepoints are enabled (see [`axtrace`]). This
+//!    feature is **enabled** by default.
 //! - `ramfs`: Mount [`axfs_ramfs::RamFileSystem`] on `/tmp`. This feature is
 //!    **enabled** by default.
 //! - `myfs`: Allow users to define their custom filesystems to override the
@@ -15,6 +16,9 @@
 //!    to create and initialize other filesystems. This feature is **disabled** by
 //!    by default, but it will override other filesystem selection features if
 //!    both are enabled.
+//! - `irq`, `multitask`: If both are enabled and the block device supports
+//!    interrupts, multiple requests (e.g., reads ahead) can be in flight, and
+//!    the tasks waiting for them sleep until the device interrupts.
 //!
 //! [FAT]: https://en.wikipedia.org/wiki/File_Allocation_Table
 //! [`MyFileSystemIf`]: fops::MyFileSystemIf
@@ -28,6 +32,7 @@ extern crate alloc;
 
 mod dev;
 mod fs;
+mod queue;
 mod root;
 
 pub mod api;
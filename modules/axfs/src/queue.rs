@@ -0,0 +1,373 @@
+//! Requests to the block device, which may be asynchronous.
+//!
+//! If the block device supports asynchronous requests and interrupts, and
+//! both the `irq` and `multitask` features are enabled, multiple requests can
+//! be in flight at the same time (e.g., a read and the blocks read ahead), and
+//! the task waiting for a request sleeps until the device interrupt signals
+//! completions. Otherwise, requests are done synchronously by the driver.
+//!
+//! Asynchronous transfers are split into one device request per block, as
+//! some drivers (e.g., virtio-blk) only transfer a block per request. They are
+//! tracked as one request, which completes when all its blocks complete.
+
+use alloc::collections::BTreeMap;
+use axdriver::prelude::*;
+
+/// The ID of an asynchronous request, see [`BlockQueue::submit_read`].
+pub(crate) type RequestId = usize;
+
+/// A block device with its asynchronous requests in flight.
+pub(crate) struct BlockQueue {
+    dev: AxBlockDevice,
+    async_enabled: bool,
+    /// Number of device requests in flight.
+    num_in_flight: usize,
+    next_id: RequestId,
+    /// Requests with blocks in flight.
+    pending: BTreeMap<RequestId, PendingRequest>,
+    /// The request of each device request in flight, by the device ID.
+    dev_requests: BTreeMap<usize, RequestId>,
+    /// Results of the completed requests that have not been waited.
+    completed: BTreeMap<RequestId, DevResult>,
+}
+
+/// A request whose blocks have not all completed.
+struct PendingRequest {
+    num_blocks: usize,
+    /// The first error of its blocks.
+    result: DevResult,
+}
+
+impl BlockQueue {
+    pub fn new(dev: AxBlockDevice) -> Self {
+        let async_enabled = dev.irq_num().map_or(false, irq::init);
+        Self {
+            dev,
+            async_enabled,
+            num_in_flight: 0,
+            next_id: 0,
+            pending: BTreeMap::new(),
+            dev_requests: BTreeMap::new(),
+            completed: BTreeMap::new(),
+        }
+    }
+
+    #[inline]
+    pub fn num_blocks(&self) -> u64 {
+        self.dev.num_blocks()
+    }
+
+    #[inline]
+    pub fn block_size(&self) -> usize {
+        self.dev.block_size()
+    }
+
+    /// Whether requests can be in flight while the caller does other things.
+    #[inline]
+    pub fn is_async(&self) -> bool {
+        self.async_enabled
+    }
+
+    /// Retrieves the completed requests from the device.
+    fn poll(&mut self) {
+        while let Some((dev_id, res)) = self.dev.poll_request() {
+            self.num_in_flight -= 1;
+            match self.dev_requests.remove(&dev_id) {
+                Some(id) => self.complete_blocks(id, 1, res),
+                None => warn!("unknown block device request {}: {:?}", dev_id, res),
+            }
+        }
+    }
+
+    /// Completes `num_blocks` blocks of the request `id` with `res`, and the
+    /// request itself if they are the last ones.
+    fn complete_blocks(&mut self, id: RequestId, num_blocks: usize, res: DevResult) {
+        let Some(req) = self.pending.get_mut(&id) else {
+            return;
+        };
+        req.num_blocks -= num_blocks;
+        if req.result.is_ok() {
+            req.result = res;
+        }
+        if req.num_blocks == 0 {
+            let req = self.pending.remove(&id).unwrap();
+            self.completed.insert(id, req.result);
+        }
+    }
+
+    /// Blocks until some device requests in flight complete.
+    fn wait_any(&mut self) {
+        let num_in_flight = self.num_in_flight;
+        loop {
+            irq::prepare_wait(&mut self.dev);
+            self.poll();
+            if self.num_in_flight < num_in_flight || self.num_in_flight == 0 {
+                return;
+            }
+            irq::wait();
+        }
+    }
+
+    /// Submits a device request by `submit`, waits for a free slot if the
+    /// request queue is full. Returns the device ID of the request.
+    fn submit<F>(&mut self, mut submit: F) -> DevResult<usize>
+    where
+        F: FnMut(&mut AxBlockDevice) -> DevResult<usize>,
+    {
+        loop {
+            match submit(&mut self.dev) {
+                Ok(id) => {
+                    self.num_in_flight += 1;
+                    return Ok(id);
+                }
+                Err(DevError::Again) if self.num_in_flight > 0 => self.wait_any(),
+                Err(e) => return Err(e),
+            }
+        }
+    }
+
+    /// Submits a request of the blocks in `buf` from `start_block`, as one
+    /// device request per block by `submit`.
+    ///
+    /// If a block fails to be submitted, waits for the blocks submitted, and
+    /// returns the error.
+    ///
+    /// # Safety
+    ///
+    /// `buf` must stay valid and must not be accessed until the request is
+    /// waited by [`wait`](Self::wait).
+    unsafe fn submit_blocks<F>(
+        &mut self,
+        start_block: u64,
+        buf: *mut [u8],
+        mut submit: F,
+    ) -> DevResult<RequestId>
+    where
+        F: FnMut(&mut AxBlockDevice, u64, *mut [u8]) -> DevResult<usize>,
+    {
+        let block_size = self.block_size();
+        let len = unsafe { (&*buf).len() };
+        if len == 0 || len % block_size != 0 {
+            return Err(DevError::InvalidParam);
+        }
+        let id = self.next_id;
+        self.next_id = self.next_id.wrapping_add(1);
+        let num_blocks = len / block_size;
+        self.pending.insert(
+            id,
+            PendingRequest {
+                num_blocks,
+                result: Ok(()),
+            },
+        );
+        for i in 0..num_blocks {
+            let block_id = start_block + i as u64;
+            let block = unsafe {
+                core::ptr::slice_from_raw_parts_mut(
+                    (buf as *mut u8).add(i * block_size),
+                    block_size,
+                )
+            };
+            match self.submit(|dev| submit(dev, block_id, block)) {
+                Ok(dev_id) => {
+                    self.dev_requests.insert(dev_id, id);
+                }
+                Err(e) => {
+                    // The blocks not submitted will never complete, wait for
+                    // the others, which still access `buf`.
+                    self.complete_blocks(id, num_blocks - i, Ok(()));
+                    let _ = self.wait(id);
+                    return Err(e);
+                }
+            }
+        }
+        Ok(id)
+    }
+
+    /// Submits a request to read blocks from `start_block` into `buf`, and
+    /// returns its ID without waiting for it to complete.
+    ///
+    /// Returns [`None`] if the device does not support asynchronous requests,
+    /// in which case the blocks have been read synchronously.
+    ///
+    /// # Safety
+    ///
+    /// `buf` must stay valid and must not be accessed until the request is
+    /// waited by [`wait`](Self::wait).
+    pub unsafe fn submit_read(
+        &mut self,
+        start_block: u64,
+        buf: &mut [u8],
+    ) -> DevResult<Option<RequestId>> {
+        if !self.async_enabled {
+            return self.dev.read_blocks(start_block, buf).map(|_| None);
+        }
+        self.submit_blocks(start_block, buf, |dev, block_id, buf| unsafe {
+            dev.submit_read_blocks(block_id, &mut *buf)
+        })
+        .map(Some)
+    }
+
+    /// Blocks until the request completes, and returns its result.
+    pub fn wait(&mut self, id: RequestId) -> DevResult {
+        loop {
+            if let Some(res) = self.completed.remove(&id) {
+                return res;
+            }
+            if self.num_in_flight == 0 {
+                return Err(DevError::BadState);
+            }
+            self.wait_any();
+        }
+    }
+
+    /// Reads blocks from `start_block` into `buf`, and blocks until done.
+    pub fn read_blocks(&mut self, start_block: u64, buf: &mut [u8]) -> DevResult {
+        if !self.async_enabled {
+            return self.dev.read_blocks(start_block, buf);
+        }
+        // Safety: `buf` is not accessed until the request completes.
+        let id = unsafe {
+            self.submit_blocks(start_block, buf, |dev, block_id, buf| {
+                dev.submit_read_blocks(block_id, &mut *buf)
+            })?
+        };
+        self.wait(id)
+    }
+
+    /// Writes blocks from `start_block` from `buf`, and blocks until done.
+    pub fn write_blocks(&mut self, start_block: u64, buf: &[u8]) -> DevResult {
+        if !self.async_enabled {
+            return self.dev.write_blocks(start_block, buf);
+        }
+        // Safety: `buf` is not accessed until the request completes, and the
+        // device only reads from it.
+        let id = unsafe {
+            self.submit_blocks(
+                start_block,
+                buf as *const [u8] as *mut [u8],
+                |dev, block_id, buf| dev.submit_write_blocks(block_id, &*buf),
+            )?
+        };
+        self.wait(id)
+    }
+
+    /// Waits for all requests in flight to complete, then flushes the device.
+    pub fn flush(&mut self) -> DevResult {
+        while self.num_in_flight > 0 {
+            self.wait_any();
+        }
+        self.dev.flush()
+    }
+}
+
+cfg_if::cfg_if! {
+    if #[cfg(all(feature = "irq", feature = "multitask"))] {
+        mod irq {
+            use core::sync::atomic::{AtomicBool, AtomicUsize, Ordering};
+
+            use axdriver::prelude::*;
+            use axtask::WaitQueue;
+
+            static IRQ_NUM: AtomicUsize = AtomicUsize::new(0);
+            static IRQ_PENDING: AtomicBool = AtomicBool::new(false);
+            static IRQ_WQ: WaitQueue = WaitQueue::new();
+
+            fn irq_handler() {
+                // Mask the IRQ until the waiting task has acknowledged it.
+                axhal::irq::set_enable(IRQ_NUM.load(Ordering::Relaxed), false);
+                IRQ_PENDING.store(true, Ordering::Release);
+                IRQ_WQ.notify_one(true);
+            }
+
+            /// Registers the handler of the block device IRQ, returns `true`
+            /// on success.
+            pub fn init(irq_num: usize) -> bool {
+                IRQ_NUM.store(irq_num, Ordering::Relaxed);
+                if axhal::irq::register_handler(irq_num, irq_handler) {
+                    info!("  block device irq: {}", irq_num);
+                    true
+                } else {
+                    warn!("failed to register block device IRQ {}", irq_num);
+                    false
+                }
+            }
+
+            /// Acknowledges the device and unmasks its IRQ, must be called
+            /// before checking completions, so that later ones wake up
+            /// [`wait`].
+            pub fn prepare_wait(dev: &mut AxBlockDevice) {
+                IRQ_PENDING.store(false, Ordering::Release);
+                dev.ack_interrupt();
+                axhal::irq::set_enable(IRQ_NUM.load(Ordering::Relaxed), true);
+            }
+
+            /// Sleeps until the next device interrupt.
+            pub fn wait() {
+                IRQ_WQ.wait_until(|| IRQ_PENDING.load(Ordering::Acquire));
+            }
+        }
+    } else {
+        mod irq {
+            use axdriver::prelude::*;
+
+            /// Interrupts are not supported, requests are synchronous.
+            pub fn init(_irq_num: usize) -> bool {
+                false
+            }
+
+            pub fn prepare_wait(_dev: &mut AxBlockDevice) {}
+
+            pub fn wait() {}
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use driver_block::ramdisk::RamDisk;
+
+    const BLOCK_SIZE: usize = 512;
+
+    /// Creates a queue doing asynchronous requests, as if the device had an
+    /// IRQ. The RAM disk transfers one block per request, like virtio-blk.
+    fn async_queue(data: &[u8]) -> BlockQueue {
+        let mut queue = BlockQueue::new(RamDisk::from(data));
+        queue.async_enabled = true;
+        queue
+    }
+
+    #[test]
+    fn test_async_multi_block() {
+        let data: Vec<u8> = (0..BLOCK_SIZE * 16)
+            .map(|i| (i * 7 + i / 251) as u8)
+            .collect();
+        let blocks = |start: usize, end: usize| &data[start * BLOCK_SIZE..end * BLOCK_SIZE];
+        let mut queue = async_queue(&data);
+        assert!(queue.is_async());
+
+        // more blocks than the device requests that can be in flight
+        let mut buf = vec![0; BLOCK_SIZE * 10];
+        queue.read_blocks(3, &mut buf).unwrap();
+        assert_eq!(buf, blocks(3, 13));
+
+        // a read submitted before a write to other blocks
+        let mut ra = vec![0; BLOCK_SIZE * 3];
+        let id = unsafe { queue.submit_read(0, &mut ra) }.unwrap().unwrap();
+        queue.write_blocks(8, &[0xff; BLOCK_SIZE * 2]).unwrap();
+        queue.wait(id).unwrap();
+        assert_eq!(ra, blocks(0, 3));
+
+        let buf = &mut buf[..BLOCK_SIZE * 4];
+        queue.read_blocks(7, buf).unwrap();
+        assert_eq!(&buf[..BLOCK_SIZE], blocks(7, 8));
+        assert!(buf[BLOCK_SIZE..BLOCK_SIZE * 3].iter().all(|&b| b == 0xff));
+        assert_eq!(&buf[BLOCK_SIZE * 3..], blocks(10, 11));
+
+        // the request fails if any of its blocks fails
+        assert!(queue.read_blocks(15, &mut buf[..BLOCK_SIZE * 2]).is_err());
+        assert_eq!(queue.num_in_flight, 0);
+        assert!(queue.pending.is_empty() && queue.completed.is_empty());
+    }
+}
@@ -157,6 +157,9 @@ pub(crate) fn init_rootfs(disk: crate::dev::Disk) {
         devfs.add("null", Arc::new(null));
         devfs.add("zero", Arc::new(zero));
         foo_dir.add("bar", Arc::new(bar));
+        if axtrace::ENABLED {
+            devfs.add("trace", Arc::new(fs::TraceDev));
+        }
 
         root_dir
             .mount("/dev", Arc::new(devfs))
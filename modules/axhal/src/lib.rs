@@ -66,6 +66,16 @@ pub mod console {
 /// Miscellaneous operation, e.g. terminate the system.
 pub mod misc {
     pub use super::platform::misc::*;
+
+    /// Shutdown the whole system, including all CPUs.
+    ///
+    /// The buffered log records (if any) and the statistics of the
+    /// tracepoints (if enabled) are printed first.
+    pub fn terminate() -> ! {
+        log::logger().flush();
+        axtrace::dump();
+        super::platform::misc::terminate()
+    }
 }
 
 /// Multi-core operations.
@@ -1,6 +1,6 @@
 #![allow(unused_imports)]
 
-use aarch64_cpu::registers::{CNTFRQ_EL0, CNTPCT_EL0, CNTP_CTL_EL0, CNTP_TVAL_EL0};
+use aarch64_cpu::registers::{CNTFRQ_EL0, CNTPCT_EL0, CNTP_CTL_EL0, CNTP_CVAL_EL0, CNTP_TVAL_EL0};
 use ratio::Ratio;
 use tock_registers::interfaces::{Readable, Writeable};
 
@@ -30,15 +30,9 @@ pub fn nanos_to_ticks(nanos: u64) -> u64 {
 /// A timer interrupt will be triggered at the given deadline (in nanoseconds).
 #[cfg(feature = "irq")]
 pub fn set_oneshot_timer(deadline_ns: u64) {
-    let cnptct = CNTPCT_EL0.get();
-    let cnptct_deadline = nanos_to_ticks(deadline_ns);
-    if cnptct < cnptct_deadline {
-        let interval = cnptct_deadline - cnptct;
-        debug_assert!(interval <= u32::MAX as u64);
-        CNTP_TVAL_EL0.set(interval);
-    } else {
-        CNTP_TVAL_EL0.set(0);
-    }
+    // The comparator is absolute and 64-bit, so there is no race with the
+    // counter, and no limit on how far the deadline can be.
+    CNTP_CVAL_EL0.set(nanos_to_ticks(deadline_ns));
 }
 
 /// Early stage initialization: stores the timer frequency.
@@ -6,6 +6,10 @@ const LAPIC_TICKS_PER_SEC: u64 = 1_000_000_000; // TODO: need to calibrate
 #[cfg(feature = "irq")]
 static mut NANOS_TO_LAPIC_TICKS_RATIO: ratio::Ratio = ratio::Ratio::zero();
 
+/// Whether the LAPIC timer is in the TSC-deadline mode.
+#[cfg(feature = "irq")]
+static mut USE_TSC_DEADLINE: bool = false;
+
 static mut INIT_TICK: u64 = 0;
 static mut CPU_FREQ_MHZ: u64 = axconfig::TIMER_FREQUENCY as u64 / 1_000_000;
 
@@ -27,21 +31,54 @@ pub fn nanos_to_ticks(nanos: u64) -> u64 {
 /// Set a one-shot timer.
 ///
 /// A timer interrupt will be triggered at the given deadline (in nanoseconds).
+/// If the deadline is too far to be represented (e.g., `u64::MAX`), the timer
+/// is disarmed, or fires at the farthest time it can reach.
 #[cfg(feature = "irq")]
 pub fn set_oneshot_timer(deadline_ns: u64) {
+    unsafe {
+        if USE_TSC_DEADLINE {
+            // The deadline is an absolute TSC value, no conversion to the
+            // uncalibrated LAPIC ticks is needed. Writing 0 disarms the timer.
+            let tsc = deadline_ns
+                .checked_mul(CPU_FREQ_MHZ)
+                .and_then(|t| (t / 1_000).checked_add(INIT_TICK))
+                .unwrap_or(0);
+            x86::msr::wrmsr(x86::msr::IA32_TSC_DEADLINE, tsc);
+            return;
+        }
+    }
+
     let lapic = super::apic::local_apic();
     let now_ns = crate::time::current_time_nanos();
     unsafe {
         if now_ns < deadline_ns {
             let apic_ticks = NANOS_TO_LAPIC_TICKS_RATIO.mul_trunc(deadline_ns - now_ns);
-            assert!(apic_ticks <= u32::MAX as u64);
-            lapic.set_timer_initial(apic_ticks.max(1) as u32);
+            lapic.set_timer_initial(apic_ticks.clamp(1, u32::MAX as u64) as u32);
         } else {
             lapic.set_timer_initial(1);
         }
     }
 }
 
+/// Switches the LAPIC timer of the current CPU to the TSC-deadline mode if
+/// it's supported, returns whether it's switched.
+#[cfg(feature = "irq")]
+unsafe fn enable_tsc_deadline() -> bool {
+    let supported = CpuId::new()
+        .get_feature_info()
+        .map_or(false, |info| info.has_tsc_deadline());
+    if supported {
+        use x2apic::lapic::TimerMode;
+        super::apic::local_apic().set_timer_mode(TimerMode::TscDeadline);
+        // Serialize the mode switch before any write to `IA32_TSC_DEADLINE`.
+        core::sync::atomic::fence(core::sync::atomic::Ordering::SeqCst);
+        // Fire as soon as IRQs are enabled, like the initial count does in the
+        // one-shot mode, so that the timer handler starts programming it.
+        x86::msr::wrmsr(x86::msr::IA32_TSC_DEADLINE, 1);
+    }
+    supported
+}
+
 pub(super) fn init_early() {
     if let Some(freq) = CpuId::new()
         .get_processor_frequency_info()
@@ -70,6 +107,11 @@ pub(super) fn init_primary() {
             LAPIC_TICKS_PER_SEC as u32,
             crate::time::NANOS_PER_SEC as u32,
         );
+
+        USE_TSC_DEADLINE = enable_tsc_deadline();
+        if USE_TSC_DEADLINE {
+            axlog::ax_println!("Using TSC-deadline timer");
+        }
     }
 }
 
@@ -78,5 +120,8 @@ pub(super) fn init_secondary() {
     #[cfg(feature = "irq")]
     unsafe {
         super::apic::local_apic().enable_timer();
+        if USE_TSC_DEADLINE {
+            enable_tsc_deadline();
+        }
     }
 }
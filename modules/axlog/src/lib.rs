@@ -18,6 +18,9 @@
 //!   optimized out to a no-op.
 //! - `log-level-warn`, `log-level-info`, `log-level-debug`, `log-level-trace`:
 //!   Similar to `log-level-error`.
+//! - `buffered`: Buffer the log records in per-CPU ring buffers, and print
+//!   them later by [`drain`], so that logging does not wait for the console.
+//!   See [`enable_buffering`] for details. Not available with `std`.
 
 #![cfg_attr(not(feature = "std"), no_std)]
 
@@ -31,6 +34,12 @@ use log::{Level, LevelFilter, Log, Metadata, Record};
 #[cfg(not(feature = "std"))]
 use crate_interface::call_interface;
 
+#[cfg(all(feature = "buffered", not(feature = "std")))]
+mod ring;
+
+#[cfg(all(feature = "buffered", not(feature = "std")))]
+pub use ring::{drain, enable_buffering, flush, overflows, LogRing};
+
 pub use log::{debug, error, info, trace, warn};
 
 /// Prints to the console.
@@ -101,6 +110,21 @@ pub trait LogIf {
     fn current_task_id() -> Option<u64>;
 }
 
+#[cfg(not(feature = "std"))]
+fn current_time() -> core::time::Duration {
+    call_interface!(LogIf::current_time)
+}
+
+#[cfg(not(feature = "std"))]
+fn current_cpu_id() -> Option<usize> {
+    call_interface!(LogIf::current_cpu_id)
+}
+
+#[cfg(not(feature = "std"))]
+fn current_task_id() -> Option<u64> {
+    call_interface!(LogIf::current_task_id)
+}
+
 struct Logger;
 
 impl Write for Logger {
@@ -130,16 +154,16 @@ impl Log for Logger {
         let level = record.level();
         let line = record.line().unwrap_or(0);
         let path = record.target();
-        let args_color = match level {
-            Level::Error => ColorCode::Red,
-            Level::Warn => ColorCode::Yellow,
-            Level::Info => ColorCode::Green,
-            Level::Debug => ColorCode::Cyan,
-            Level::Trace => ColorCode::BrightBlack,
-        };
 
         cfg_if::cfg_if! {
             if #[cfg(feature = "std")] {
+                let args_color = match level {
+                    Level::Error => ColorCode::Red,
+                    Level::Warn => ColorCode::Yellow,
+                    Level::Info => ColorCode::Green,
+                    Level::Debug => ColorCode::Cyan,
+                    Level::Trace => ColorCode::BrightBlack,
+                };
                 __print_impl(with_color!(
                     ColorCode::White,
                     "[{time} {path}:{line}] {args}\n",
@@ -149,53 +173,85 @@ impl Log for Logger {
                     args = with_color!(args_color, "{}", record.args()),
                 ));
             } else {
-                let cpu_id = call_interface!(LogIf::current_cpu_id);
-                let tid = call_interface!(LogIf::current_task_id);
-                let now = call_interface!(LogIf::current_time);
-                if let Some(cpu_id) = cpu_id {
-                    if let Some(tid) = tid {
-                        // show CPU ID and task ID
-                        __print_impl(with_color!(
-                            ColorCode::White,
-                            "[{:>3}.{:06} {cpu_id}:{tid} {path}:{line}] {args}\n",
-                            now.as_secs(),
-                            now.subsec_micros(),
-                            cpu_id = cpu_id,
-                            tid = tid,
-                            path = path,
-                            line = line,
-                            args = with_color!(args_color, "{}", record.args()),
-                        ));
-                    } else {
-                        // show CPU ID only
-                        __print_impl(with_color!(
-                            ColorCode::White,
-                            "[{:>3}.{:06} {cpu_id} {path}:{line}] {args}\n",
-                            now.as_secs(),
-                            now.subsec_micros(),
-                            cpu_id = cpu_id,
-                            path = path,
-                            line = line,
-                            args = with_color!(args_color, "{}", record.args()),
-                        ));
-                    }
-                } else {
-                    // neither CPU ID nor task ID is shown
-                    __print_impl(with_color!(
-                        ColorCode::White,
-                        "[{:>3}.{:06} {path}:{line}] {args}\n",
-                        now.as_secs(),
-                        now.subsec_micros(),
-                        path = path,
-                        line = line,
-                        args = with_color!(args_color, "{}", record.args()),
-                    ));
+                #[cfg(feature = "buffered")]
+                if ring::push(record) {
+                    return;
                 }
+                print_record(
+                    level,
+                    current_time(),
+                    current_cpu_id(),
+                    current_task_id(),
+                    path,
+                    line,
+                    *record.args(),
+                );
             }
         }
     }
 
-    fn flush(&self) {}
+    fn flush(&self) {
+        #[cfg(feature = "buffered")]
+        ring::flush();
+    }
+}
+
+#[cfg(not(feature = "std"))]
+fn print_record(
+    level: Level,
+    now: core::time::Duration,
+    cpu_id: Option<usize>,
+    tid: Option<u64>,
+    path: &str,
+    line: u32,
+    args: fmt::Arguments,
+) {
+    let args_color = match level {
+        Level::Error => ColorCode::Red,
+        Level::Warn => ColorCode::Yellow,
+        Level::Info => ColorCode::Green,
+        Level::Debug => ColorCode::Cyan,
+        Level::Trace => ColorCode::BrightBlack,
+    };
+    if let Some(cpu_id) = cpu_id {
+        if let Some(tid) = tid {
+            // show CPU ID and task ID
+            __print_impl(with_color!(
+                ColorCode::White,
+                "[{:>3}.{:06} {cpu_id}:{tid} {path}:{line}] {args}\n",
+                now.as_secs(),
+                now.subsec_micros(),
+                cpu_id = cpu_id,
+                tid = tid,
+                path = path,
+                line = line,
+                args = with_color!(args_color, "{}", args),
+            ));
+        } else {
+            // show CPU ID only
+            __print_impl(with_color!(
+                ColorCode::White,
+                "[{:>3}.{:06} {cpu_id} {path}:{line}] {args}\n",
+                now.as_secs(),
+                now.subsec_micros(),
+                cpu_id = cpu_id,
+                path = path,
+                line = line,
+                args = with_color!(args_color, "{}", args),
+            ));
+        }
+    } else {
+        // neither CPU ID nor task ID is shown
+        __print_impl(with_color!(
+            ColorCode::White,
+            "[{:>3}.{:06} {path}:{line}] {args}\n",
+            now.as_secs(),
+            now.subsec_micros(),
+            path = path,
+            line = line,
+            args = with_color!(args_color, "{}", args),
+        ));
+    }
 }
 
 #[doc(hidden)]
@@ -0,0 +1,280 @@
+//! Buffered logging: the log records are written into per-CPU lock-free ring
+//! buffers and printed later by [`drain`], instead of being printed to the
+//! (slow) console while the caller waits.
+
+use core::cell::UnsafeCell;
+use core::fmt::{self, Write};
+use core::mem::MaybeUninit;
+use core::ptr;
+use core::sync::atomic::{AtomicBool, AtomicPtr, AtomicU64, AtomicUsize, Ordering};
+use core::time::Duration;
+
+use kernel_guard::{BaseGuard, NoPreemptIrqSave};
+use log::{Level, Record};
+use spinlock::SpinNoIrq;
+
+use crate::{current_cpu_id, current_task_id, current_time};
+
+/// Number of records in each ring, must be a power of two.
+const RING_SLOTS: usize = 256;
+/// Maximum length of a formatted message, longer ones are truncated.
+const MSG_LEN: usize = 192;
+
+/// A log record whose arguments have been formatted.
+#[derive(Clone, Copy)]
+struct RawRecord {
+    time_ns: u64,
+    tid: Option<u64>,
+    level: Level,
+    path: &'static str,
+    line: u32,
+    len: u16,
+    msg: [u8; MSG_LEN],
+}
+
+impl RawRecord {
+    fn msg(&self) -> &str {
+        // SAFETY: `msg` is only filled by `MsgWriter`, which copies whole
+        // UTF-8 characters.
+        unsafe { core::str::from_utf8_unchecked(&self.msg[..self.len as usize]) }
+    }
+}
+
+/// The log ring buffer of a CPU.
+///
+/// It is written only by its CPU with preemption and IRQs disabled (a single
+/// producer), and read by [`drain`] under a lock (a single consumer), so no
+/// locks are needed in the fast path.
+pub struct LogRing {
+    /// Index of the next record to read, only updated by the consumer.
+    head: AtomicUsize,
+    /// Index of the next record to write, only updated by the producer.
+    tail: AtomicUsize,
+    slots: [UnsafeCell<MaybeUninit<RawRecord>>; RING_SLOTS],
+}
+
+unsafe impl Sync for LogRing {}
+
+impl LogRing {
+    /// Creates an empty ring buffer.
+    #[allow(clippy::declare_interior_mutable_const)]
+    pub const fn new() -> Self {
+        const EMPTY_SLOT: UnsafeCell<MaybeUninit<RawRecord>> =
+            UnsafeCell::new(MaybeUninit::uninit());
+        Self {
+            head: AtomicUsize::new(0),
+            tail: AtomicUsize::new(0),
+            slots: [EMPTY_SLOT; RING_SLOTS],
+        }
+    }
+
+    /// Appends a record, returns `false` if the ring is full.
+    ///
+    /// Must be called on the CPU owning the ring, with preemption and IRQs
+    /// disabled.
+    fn push(&self, record: &RawRecord) -> bool {
+        let tail = self.tail.load(Ordering::Relaxed);
+        if tail.wrapping_sub(self.head.load(Ordering::Acquire)) >= RING_SLOTS {
+            return false;
+        }
+        // SAFETY: the slot is not visible to the consumer until `tail` is
+        // published, and there are no other producers.
+        unsafe { (*self.slots[tail % RING_SLOTS].get()).write(*record) };
+        self.tail.store(tail.wrapping_add(1), Ordering::Release);
+        true
+    }
+
+    /// Returns the timestamp of the oldest record, if any.
+    ///
+    /// Must be called with `DRAIN_LOCK` held.
+    fn peek_time(&self) -> Option<u64> {
+        let head = self.head.load(Ordering::Relaxed);
+        if head == self.tail.load(Ordering::Acquire) {
+            return None;
+        }
+        // SAFETY: the slot has been published by the producer, and will not be
+        // overwritten until `head` is advanced.
+        Some(unsafe { (*self.slots[head % RING_SLOTS].get()).assume_init_ref() }.time_ns)
+    }
+
+    /// Removes the oldest record.
+    ///
+    /// Must be called with `DRAIN_LOCK` held.
+    fn pop(&self) -> Option<RawRecord> {
+        let head = self.head.load(Ordering::Relaxed);
+        if head == self.tail.load(Ordering::Acquire) {
+            return None;
+        }
+        // SAFETY: same as `peek_time`.
+        let record = unsafe { (*self.slots[head % RING_SLOTS].get()).assume_init_read() };
+        self.head.store(head.wrapping_add(1), Ordering::Release);
+        Some(record)
+    }
+}
+
+impl Default for LogRing {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+static ENABLED: AtomicBool = AtomicBool::new(false);
+static RINGS: AtomicPtr<LogRing> = AtomicPtr::new(ptr::null_mut());
+static NUM_RINGS: AtomicUsize = AtomicUsize::new(0);
+/// Number of records dropped because the ring was full.
+static OVERFLOWS: AtomicU64 = AtomicU64::new(0);
+/// `OVERFLOWS` at the last time they were reported.
+static REPORTED_OVERFLOWS: AtomicU64 = AtomicU64::new(0);
+/// Serializes the consumers.
+static DRAIN_LOCK: SpinNoIrq<()> = SpinNoIrq::new(());
+
+fn rings() -> &'static [LogRing] {
+    let ptr = RINGS.load(Ordering::Acquire);
+    if ptr.is_null() {
+        &[]
+    } else {
+        // SAFETY: set from a `&'static [LogRing]` in `enable_buffering`.
+        unsafe { core::slice::from_raw_parts(ptr, NUM_RINGS.load(Ordering::Acquire)) }
+    }
+}
+
+/// Writes into a fixed-size buffer, truncating at a character boundary once
+/// the buffer is full.
+struct MsgWriter<'a> {
+    buf: &'a mut [u8; MSG_LEN],
+    len: usize,
+}
+
+impl Write for MsgWriter<'_> {
+    fn write_str(&mut self, s: &str) -> fmt::Result {
+        let mut n = s.len().min(MSG_LEN - self.len);
+        while !s.is_char_boundary(n) {
+            n -= 1;
+        }
+        self.buf[self.len..self.len + n].copy_from_slice(&s.as_bytes()[..n]);
+        self.len += n;
+        if n < s.len() {
+            Err(fmt::Error)
+        } else {
+            Ok(())
+        }
+    }
+}
+
+/// Tries to buffer `record` in the ring of the current CPU, returns `false`
+/// if it must be printed directly.
+pub(crate) fn push(record: &Record) -> bool {
+    if !ENABLED.load(Ordering::Acquire) {
+        return false;
+    }
+    // Only the static strings can be kept in the ring.
+    let Some(path) = record.module_path_static() else {
+        return false;
+    };
+    if record.target() != path {
+        return false;
+    }
+
+    // Format outside the critical section, as the arguments may log as well.
+    let mut raw = RawRecord {
+        time_ns: 0,
+        tid: current_task_id(),
+        level: record.level(),
+        path,
+        line: record.line().unwrap_or(0),
+        len: 0,
+        msg: [0; MSG_LEN],
+    };
+    let mut writer = MsgWriter {
+        buf: &mut raw.msg,
+        len: 0,
+    };
+    let _ = writer.write_fmt(*record.args());
+    raw.len = writer.len as u16;
+
+    let state = NoPreemptIrqSave::acquire();
+    let ring = current_cpu_id().and_then(|cpu_id| rings().get(cpu_id));
+    let buffered = if let Some(ring) = ring {
+        raw.time_ns = current_time().as_nanos() as u64;
+        if !ring.push(&raw) {
+            OVERFLOWS.fetch_add(1, Ordering::Relaxed);
+        }
+        true
+    } else {
+        false
+    };
+    NoPreemptIrqSave::release(state);
+    buffered
+}
+
+/// Starts buffering the log records of each CPU in `rings[cpu_id]`.
+///
+/// The buffered records are not printed until [`drain`] is called, so the
+/// caller should arrange a task to call it periodically. The records of CPUs
+/// without a ring, or without a static module path, are still printed
+/// directly.
+pub fn enable_buffering(rings: &'static [LogRing]) {
+    NUM_RINGS.store(rings.len(), Ordering::Release);
+    RINGS.store(rings.as_ptr() as *mut LogRing, Ordering::Release);
+    ENABLED.store(true, Ordering::Release);
+}
+
+/// Stops buffering the log records, and prints the buffered ones.
+///
+/// It should be called before the system shuts down, or in the panic handler,
+/// to not lose the last records.
+pub fn flush() {
+    ENABLED.store(false, Ordering::Release);
+    drain();
+}
+
+/// Prints the buffered log records of all CPUs in the order of time, returns
+/// the number of records printed.
+///
+/// It prints at most the records buffered before it is called, so that it
+/// does not keep running if the rings are filled continuously.
+pub fn drain() -> usize {
+    let rings = rings();
+    let mut count = 0;
+    while count < rings.len() * RING_SLOTS {
+        let guard = DRAIN_LOCK.lock();
+        let oldest = rings
+            .iter()
+            .enumerate()
+            .filter_map(|(cpu_id, ring)| Some((cpu_id, ring.peek_time()?)))
+            .min_by_key(|&(_, time_ns)| time_ns);
+        let Some((cpu_id, _)) = oldest else {
+            break;
+        };
+        let Some(record) = rings[cpu_id].pop() else {
+            break;
+        };
+        drop(guard);
+
+        crate::print_record(
+            record.level,
+            Duration::from_nanos(record.time_ns),
+            Some(cpu_id),
+            record.tid,
+            record.path,
+            record.line,
+            format_args!("{}", record.msg()),
+        );
+        count += 1;
+    }
+
+    let overflows = OVERFLOWS.load(Ordering::Relaxed);
+    let reported = REPORTED_OVERFLOWS.swap(overflows, Ordering::Relaxed);
+    if overflows != reported {
+        crate::ax_println!(
+            "[log buffer overflow: {} records dropped]",
+            overflows - reported
+        );
+    }
+    count
+}
+
+/// Returns the number of log records dropped because the ring buffer was full.
+pub fn overflows() -> u64 {
+    OVERFLOWS.load(Ordering::Relaxed)
+}
@@ -11,11 +11,16 @@
 //! - [`IpAddr`], [`Ipv4Addr`]: IP addresses (either v4 or v6) and IPv4 addresses.
 //! - [`SocketAddr`]: IP address with a port number.
 //! - [`resolve_socket_addr`]: Function for DNS query.
+//! - [`buffer_pool_stats`]: Function for the usage of the packet buffers.
 //!
 //! # Cargo Features
 //!
 //! - `smoltcp`: Use [smoltcp] as the underlying network stack. This is enabled
 //!   by default.
+//! - `irq`, `multitask`: If both are enabled and the NIC supports interrupts,
+//!   received packets are processed by a dedicated task driven by the NIC
+//!   interrupts, and blocking socket operations sleep until their sockets
+//!   are ready, instead of busy polling.
 //!
 //! [smoltcp]: https://github.com/smoltcp-rs/smoltcp
 
@@ -33,9 +38,11 @@ cfg_if::cfg_if! {
     }
 }
 
+pub use self::net_impl::buffer_pool_stats;
 pub use self::net_impl::resolve_socket_addr;
 pub use self::net_impl::TcpSocket;
 pub use self::net_impl::UdpSocket;
+pub use driver_net::NetBufferPoolStats;
 pub use smoltcp::wire::{IpAddress as IpAddr, IpEndpoint as SocketAddr, Ipv4Address as Ipv4Addr};
 
 use axdriver::{prelude::*, AxDeviceContainer};
@@ -0,0 +1,96 @@
+//! Interrupt-driven packet processing, in the way of Linux NAPI.
+//!
+//! The NIC interrupt only masks itself and wakes up a dedicated poll task.
+//! The poll task processes all received packets with the interrupt masked,
+//! and keeps polling (without interrupts) as long as packets come in faster
+//! than a budget per round. Once the NIC is drained, it unmasks the interrupt
+//! and sleeps until the next one, or the next timer event of the sockets.
+//!
+//! It is only available with both the `irq` and `multitask` features.
+//! Otherwise, or if the NIC has no interrupts, the NIC is polled by the
+//! tasks that operate on the sockets.
+
+cfg_if::cfg_if! {
+    if #[cfg(all(feature = "irq", feature = "multitask"))] {
+        use core::sync::atomic::{AtomicBool, AtomicUsize, Ordering};
+
+        use axtask::WaitQueue;
+
+        use super::{ETH0, RX_BUF_QUEUE_SIZE, SOCKET_SET};
+
+        /// Stay in polling mode if a round receives this many packets.
+        const POLL_BUDGET: usize = RX_BUF_QUEUE_SIZE;
+
+        static ENABLED: AtomicBool = AtomicBool::new(false);
+        static IRQ_NUM: AtomicUsize = AtomicUsize::new(0);
+        static POLL_PENDING: AtomicBool = AtomicBool::new(false);
+        static POLL_WQ: WaitQueue = WaitQueue::new();
+
+        /// Whether the NIC is driven by interrupts.
+        #[inline]
+        pub fn is_enabled() -> bool {
+            ENABLED.load(Ordering::Acquire)
+        }
+
+        /// Wakes up the poll task to poll the NIC once more, and recompute the
+        /// socket timers that may have been changed by other tasks.
+        pub fn wake_poll_task() {
+            if is_enabled() {
+                POLL_PENDING.store(true, Ordering::Release);
+                POLL_WQ.notify_one(false);
+            }
+        }
+
+        fn irq_handler() {
+            // Mask the IRQ until the poll task has drained the NIC.
+            axhal::irq::set_enable(IRQ_NUM.load(Ordering::Relaxed), false);
+            POLL_PENDING.store(true, Ordering::Release);
+            POLL_WQ.notify_one(true);
+        }
+
+        fn poll_task() {
+            let irq_num = IRQ_NUM.load(Ordering::Relaxed);
+            loop {
+                // Acknowledge before polling, so that packets arriving after
+                // the last poll raise the (masked) IRQ again.
+                POLL_PENDING.store(false, Ordering::Release);
+                ETH0.ack_interrupt();
+                while ETH0.poll(&SOCKET_SET.0) >= POLL_BUDGET {
+                    axtask::yield_now(); // under load: keep polling
+                }
+                axhal::irq::set_enable(irq_num, true);
+
+                let condition = || POLL_PENDING.load(Ordering::Acquire);
+                match ETH0.poll_delay(&SOCKET_SET.0) {
+                    Some(delay) => {
+                        POLL_WQ.wait_timeout_until(delay, condition);
+                    }
+                    None => POLL_WQ.wait_until(condition),
+                }
+            }
+        }
+
+        /// Switches the NIC to interrupt mode, with the given IRQ number.
+        pub fn init(irq_num: usize) {
+            IRQ_NUM.store(irq_num, Ordering::Relaxed);
+            if axhal::irq::register_handler(irq_num, irq_handler) {
+                ENABLED.store(true, Ordering::Release);
+                axtask::spawn(poll_task);
+                info!("  irq:      {} (NAPI)", irq_num);
+            } else {
+                warn!("failed to register NIC IRQ {}, fall back to polling", irq_num);
+            }
+        }
+    } else {
+        /// Whether the NIC is driven by interrupts.
+        #[inline]
+        pub const fn is_enabled() -> bool {
+            false
+        }
+
+        pub fn wake_poll_task() {}
+
+        /// Interrupts are not supported, the NIC is polled.
+        pub fn init(_irq_num: usize) {}
+    }
+}
@@ -1,5 +1,7 @@
-use alloc::{boxed::Box, collections::VecDeque};
-use core::ops::{Deref, DerefMut};
+use alloc::collections::{BTreeMap, VecDeque};
+use alloc::{sync::Arc, vec, vec::Vec};
+use core::sync::atomic::{AtomicBool, Ordering};
+use core::task::Waker;
 
 use axerrno::{ax_err, AxError, AxResult};
 use axsync::Mutex;
@@ -9,154 +11,251 @@ use smoltcp::socket::tcp::{self, State};
 use super::{SocketSetWrapper, LISTEN_QUEUE_SIZE, SOCKET_SET};
 use crate::SocketAddr;
 
-const PORT_NUM: usize = 65536;
-
-struct ListenTableEntry {
+struct AcceptQueue {
+    /// `false` after the socket stops listening.
+    listening: bool,
     syn_queue: VecDeque<SocketHandle>,
+    /// Waker of the blocked `accept()`, registered to new sockets in the SYN
+    /// queue so that it is woken up when they are connected.
+    waker: Option<Waker>,
+}
+
+impl Drop for AcceptQueue {
+    fn drop(&mut self) {
+        for &handle in &self.syn_queue {
+            SOCKET_SET.remove(handle);
+        }
+    }
+}
+
+/// A listening socket with its own queue of incoming connections.
+///
+/// A port can be shared by several listening sockets that all set
+/// `reuse_port` (like `SO_REUSEPORT`), in which case the incoming connections
+/// are spread over their queues by the hash of the remote address, so that
+/// they can be accepted by different tasks in parallel.
+pub struct ListenTableEntry {
+    port: u16,
+    reuse_port: bool,
+    queue: Mutex<AcceptQueue>,
 }
 
 impl ListenTableEntry {
-    pub fn new() -> Self {
+    fn new(port: u16, reuse_port: bool) -> Self {
         Self {
-            syn_queue: VecDeque::with_capacity(LISTEN_QUEUE_SIZE),
+            port,
+            reuse_port,
+            queue: Mutex::new(AcceptQueue {
+                listening: true,
+                syn_queue: VecDeque::with_capacity(LISTEN_QUEUE_SIZE),
+                waker: None,
+            }),
         }
     }
-}
 
-impl Drop for ListenTableEntry {
-    fn drop(&mut self) {
-        for &handle in &self.syn_queue {
+    /// Whether there is a connected socket to accept. If not, `waker` is
+    /// registered in the same way as [`accept`](Self::accept).
+    pub fn can_accept(&self, waker: Option<&Waker>) -> AxResult<bool> {
+        let mut queue = self.queue.lock();
+        if !queue.listening {
+            return ax_err!(InvalidInput, "socket accept() failed: not listen");
+        }
+        if let Some(waker) = waker {
+            queue.waker = Some(waker.clone());
+        }
+        Ok(queue.syn_queue.iter().any(|&handle| {
+            let (connected, _) = get_socket_info(handle, waker);
+            connected
+        }))
+    }
+
+    /// Takes a connected socket from the SYN queue.
+    ///
+    /// If there is none, returns [`Err(WouldBlock)`](AxError::WouldBlock), and
+    /// registers `waker` (if any) to all sockets in the SYN queue as well as
+    /// the later ones, to be woken up when any of them is connected, or the
+    /// socket stops listening.
+    pub fn accept(&self, waker: Option<&Waker>) -> AxResult<(SocketHandle, Option<SocketAddr>)> {
+        let mut queue = self.queue.lock();
+        if !queue.listening {
+            return ax_err!(InvalidInput, "socket accept() failed: not listen");
+        }
+        if let Some(waker) = waker {
+            queue.waker = Some(waker.clone());
+        }
+        let syn_queue = &mut queue.syn_queue;
+        if let Some(&handle) = syn_queue.front() {
+            // In most cases, the order in which sockets establish connections
+            // is the same as the order in which they join the SYN queue. That
+            // is, the front of the queue connects first. At this point, we can
+            // use `pop_front` to speed up queue deletion.
+            let (connected, peer_addr) = get_socket_info(handle, waker);
+            if connected {
+                syn_queue.pop_front();
+                return Ok((handle, peer_addr));
+            }
+        } else {
+            return Err(AxError::WouldBlock);
+        }
+        if let Some((idx, peer_addr)) =
+            syn_queue
+                .iter()
+                .enumerate()
+                .skip(1)
+                .find_map(|(idx, &handle)| {
+                    let (connected, peer_addr) = get_socket_info(handle, waker);
+                    if connected {
+                        Some((idx, peer_addr))
+                    } else {
+                        None
+                    }
+                })
+        {
+            warn!(
+                "slow removal in SYN queue: index = {}, len = {}!",
+                idx,
+                syn_queue.len()
+            );
+            // this removal can be slow
+            let handle = syn_queue.remove(idx).unwrap();
+            Ok((handle, peer_addr))
+        } else {
+            // wait for connection
+            Err(AxError::WouldBlock)
+        }
+    }
+
+    fn incoming_tcp_packet(&self, src: SocketAddr, dst: SocketAddr) {
+        let mut queue = self.queue.lock();
+        if !queue.listening {
+            return;
+        }
+        if queue.syn_queue.len() >= LISTEN_QUEUE_SIZE {
+            // SYN queue is full, drop the packet
+            warn!("SYN queue overflow!");
+            return;
+        }
+        let mut socket = SocketSetWrapper::new_tcp_socket();
+        if socket.listen(dst).is_ok() {
+            if let Some(waker) = &queue.waker {
+                socket.register_recv_waker(waker);
+            }
+            let handle = SOCKET_SET.add(socket);
+            debug!(
+                "socket {}: prepare for connection {} -> {}",
+                handle, src, dst
+            );
+            queue.syn_queue.push_back(handle);
+        }
+    }
+
+    /// Closes the queue, drops the pending connections, and wakes up the
+    /// blocked `accept()`.
+    fn close(&self) {
+        let mut queue = self.queue.lock();
+        queue.listening = false;
+        for handle in queue.syn_queue.drain(..) {
             SOCKET_SET.remove(handle);
         }
+        if let Some(waker) = queue.waker.take() {
+            waker.wake();
+        }
     }
 }
 
+/// The listening sockets indexed by ports, only the ports in use take memory.
 pub struct ListenTable {
-    tcp: Box<[Mutex<Option<Box<ListenTableEntry>>>]>,
+    tcp: Mutex<BTreeMap<u16, Vec<Arc<ListenTableEntry>>>>,
+    /// Whether no ports are listened, to skip snooping the incoming packets.
+    empty: AtomicBool,
 }
 
 impl ListenTable {
     pub fn new() -> Self {
-        let tcp = unsafe {
-            let mut buf = Box::new_uninit_slice(PORT_NUM);
-            for i in 0..PORT_NUM {
-                buf[i].write(Mutex::new(None));
-            }
-            buf.assume_init()
-        };
-        Self { tcp }
+        Self {
+            tcp: Mutex::new(BTreeMap::new()),
+            empty: AtomicBool::new(true),
+        }
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.empty.load(Ordering::Acquire)
     }
 
     pub fn can_listen(&self, port: u16) -> bool {
-        self.tcp[port as usize].lock().is_none()
+        !self.tcp.lock().contains_key(&port)
     }
 
-    pub fn listen(&self, port: u16) -> AxResult {
+    /// Starts listening on `port`, returns the entry to accept connections.
+    ///
+    /// Fails with [`AddrInUse`](AxError::AddrInUse) if the port is already
+    /// listened, unless both the existing and the new sockets set
+    /// `reuse_port`.
+    pub fn listen(&self, port: u16, reuse_port: bool) -> AxResult<Arc<ListenTableEntry>> {
         if port == 0 {
             return ax_err!(InvalidInput, "socket listen() failed");
         }
-        let mut entry = self.tcp[port as usize].lock();
-        if entry.is_none() {
-            *entry = Some(Box::new(ListenTableEntry::new()));
-            Ok(())
-        } else {
-            ax_err!(AddrInUse, "socket listen() failed")
-        }
-    }
-
-    pub fn unlisten(&self, port: u16) {
-        debug!("socket unlisten on {}", port);
-        *self.tcp[port as usize].lock() = None;
-    }
-
-    pub fn can_accept(&self, port: u16) -> AxResult<bool> {
-        if let Some(entry) = self.tcp[port as usize].lock().deref() {
-            if entry.syn_queue.iter().any(|&handle| {
-                let (connected, _) = get_socket_info(handle);
-                connected
-            }) {
-                Ok(true)
-            } else {
-                Ok(false)
+        let mut tcp = self.tcp.lock();
+        let entry = Arc::new(ListenTableEntry::new(port, reuse_port));
+        if let Some(entries) = tcp.get_mut(&port) {
+            if !reuse_port || entries.iter().any(|e| !e.reuse_port) {
+                return ax_err!(AddrInUse, "socket listen() failed");
             }
+            entries.push(entry.clone());
         } else {
-            ax_err!(InvalidInput, "socket accept() failed: not listen")
+            tcp.insert(port, vec![entry.clone()]);
+            self.empty.store(false, Ordering::Release);
         }
+        Ok(entry)
     }
 
-    pub fn accept(&self, port: u16) -> AxResult<(SocketHandle, Option<SocketAddr>)> {
-        if let Some(entry) = self.tcp[port as usize].lock().deref_mut() {
-            let syn_queue = &mut entry.syn_queue;
-            if let Some(&handle) = syn_queue.front() {
-                // In most cases, the order in which sockets establish connections
-                // is the same as the order in which they join the SYN queue. That
-                // is, the front of the queue connects first. At this point, we can
-                // use `pop_front` to speed up queue deletion.
-                let (connected, peer_addr) = get_socket_info(handle);
-                if connected {
-                    syn_queue.pop_front();
-                    return Ok((handle, peer_addr));
-                }
-            } else {
-                return Err(AxError::WouldBlock);
+    /// Stops listening on the port of `entry`. Other sockets sharing the port
+    /// are not affected.
+    pub fn unlisten(&self, entry: &Arc<ListenTableEntry>) {
+        debug!("socket unlisten on {}", entry.port);
+        let mut tcp = self.tcp.lock();
+        if let Some(entries) = tcp.get_mut(&entry.port) {
+            entries.retain(|e| !Arc::ptr_eq(e, entry));
+            if entries.is_empty() {
+                tcp.remove(&entry.port);
+                self.empty.store(tcp.is_empty(), Ordering::Release);
             }
-            if let Some((idx, peer_addr)) =
-                syn_queue
-                    .iter()
-                    .enumerate()
-                    .skip(1)
-                    .find_map(|(idx, &handle)| {
-                        let (connected, peer_addr) = get_socket_info(handle);
-                        if connected {
-                            Some((idx, peer_addr))
-                        } else {
-                            None
-                        }
-                    })
-            {
-                warn!(
-                    "slow removal in SYN queue: index = {}, len = {}!",
-                    idx,
-                    syn_queue.len()
-                );
-                // this removal can be slow
-                let handle = syn_queue.remove(idx).unwrap();
-                Ok((handle, peer_addr))
-            } else {
-                // wait for connection
-                Err(AxError::WouldBlock)
-            }
-        } else {
-            ax_err!(InvalidInput, "socket accept() failed: not listen")
         }
+        drop(tcp);
+        entry.close();
     }
 
     pub fn incoming_tcp_packet(&self, src: SocketAddr, dst: SocketAddr) {
-        if let Some(entry) = self.tcp[dst.port as usize].lock().deref_mut() {
-            if entry.syn_queue.len() >= LISTEN_QUEUE_SIZE {
-                // SYN queue is full, drop the packet
-                warn!("SYN queue overflow!");
-                return;
-            }
-            let mut socket = SocketSetWrapper::new_tcp_socket();
-            if socket.listen(dst).is_ok() {
-                let handle = SOCKET_SET.add(socket);
-                debug!(
-                    "socket {}: prepare for connection {} -> {}",
-                    handle, src, dst
-                );
-                entry.syn_queue.push_back(handle);
-            }
-        }
+        let entry = match self.tcp.lock().get(&dst.port) {
+            Some(entries) if entries.len() == 1 => entries[0].clone(),
+            Some(entries) => entries[reuse_port_hash(src) % entries.len()].clone(),
+            None => return,
+        };
+        entry.incoming_tcp_packet(src, dst);
     }
 }
 
-fn get_socket_info(handle: SocketHandle) -> (bool, Option<SocketAddr>) {
-    let (connected, peer_addr) = SOCKET_SET.with_socket::<tcp::Socket, _, _>(handle, |socket| {
-        (
-            !matches!(socket.state(), State::Listen | State::SynReceived),
-            socket.remote_endpoint(),
-        )
-    });
+/// Hashes the remote address to pick one of the sockets sharing a port, so
+/// that the retransmitted SYNs of a connection go to the same socket.
+fn reuse_port_hash(src: SocketAddr) -> usize {
+    let hash = src
+        .addr
+        .as_bytes()
+        .iter()
+        .fold(src.port as u32, |h, &b| h.rotate_left(8) ^ b as u32);
+    (hash.wrapping_mul(0x9e37_79b9) >> 16) as usize
+}
+
+/// Returns whether the socket is connected and its remote address. If it is
+/// not connected yet, registers `waker` to it.
+fn get_socket_info(handle: SocketHandle, waker: Option<&Waker>) -> (bool, Option<SocketAddr>) {
+    let (connected, peer_addr) =
+        SOCKET_SET.with_socket_mut::<tcp::Socket, _, _>(handle, |socket| {
+            let connected = !matches!(socket.state(), State::Listen | State::SynReceived);
+            if let (false, Some(waker)) = (connected, waker) {
+                socket.register_recv_waker(waker);
+            }
+            (connected, socket.remote_endpoint())
+        });
     (connected, peer_addr)
 }
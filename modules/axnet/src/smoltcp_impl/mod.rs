@@ -1,19 +1,21 @@
 mod dns;
+mod irq;
 mod listen_table;
 mod tcp;
 mod udp;
+mod waiter;
 
 use alloc::{collections::VecDeque, vec};
 use core::cell::RefCell;
-use core::ops::DerefMut;
+use core::time::Duration;
 
 use axdriver::prelude::*;
 use axhal::time::{current_time_nanos, NANOS_PER_MICROS};
 use axsync::Mutex;
-use driver_net::{DevError, NetBufferBox, NetBufferPool};
+use driver_net::{DevError, NetBufferBox, NetBufferPool, NetBufferPoolStats, NetOffloads};
 use lazy_init::LazyInit;
 use smoltcp::iface::{Config, Interface, SocketHandle, SocketSet};
-use smoltcp::phy::{Device, DeviceCapabilities, Medium, RxToken, TxToken};
+use smoltcp::phy::{Checksum, Device, DeviceCapabilities, Medium, RxToken, TxToken};
 use smoltcp::socket::{self, AnySocket};
 use smoltcp::time::Instant;
 use smoltcp::wire::{EthernetAddress, HardwareAddress, IpAddress, IpCidr};
@@ -38,8 +40,8 @@ const UDP_TX_BUF_LEN: usize = 64 * 1024;
 const RX_BUF_QUEUE_SIZE: usize = 64;
 const LISTEN_QUEUE_SIZE: usize = 512;
 
-const NET_BUF_LEN: usize = 1526;
-const NET_BUF_POOL_SIZE: usize = 128;
+const NET_BUF_LEN: usize = 1526; // for standard frames with the virtio-net header
+const NET_BUF_POOL_SIZE: usize = 256; // enough for full RX and TX queues
 
 static NET_BUF_POOL: LazyInit<NetBufferPool> = LazyInit::new();
 
@@ -52,6 +54,7 @@ struct SocketSetWrapper<'a>(Mutex<SocketSet<'a>>);
 struct DeviceWrapper {
     inner: RefCell<AxNetDevice>, // use `RefCell` is enough since it's wrapped in `Mutex` in `InterfaceWrapper`.
     rx_buf_queue: VecDeque<NetBufferBox<'static>>,
+    offloads: NetOffloads,
 }
 
 struct InterfaceWrapper {
@@ -112,8 +115,12 @@ impl<'a> SocketSetWrapper<'a> {
         f(socket)
     }
 
+    /// Polls the NIC and processes the sockets, unless another task is doing
+    /// so. Socket operations need not queue up behind it for the same work:
+    /// a blocked operation polls again (or is woken up) if its socket is
+    /// still not ready.
     pub fn poll_interfaces(&self) {
-        ETH0.poll(&self.0);
+        ETH0.try_poll(&self.0);
     }
 
     pub fn remove(&self, handle: SocketHandle) {
@@ -159,37 +166,70 @@ impl InterfaceWrapper {
         };
     }
 
-    pub fn poll(&self, sockets: &Mutex<SocketSet>) {
-        let mut dev = self.dev.lock();
-        dev.poll(|buf| {
+    /// Receives packets from the NIC and processes them, returns the number
+    /// of packets received.
+    pub fn poll(&self, sockets: &Mutex<SocketSet>) -> usize {
+        self.poll_device(&mut self.dev.lock(), sockets)
+    }
+
+    /// Like [`poll`](Self::poll), but returns [`None`] without waiting if the
+    /// NIC is being polled by another task, which is going to process the
+    /// packets and the sockets for the caller as well.
+    pub fn try_poll(&self, sockets: &Mutex<SocketSet>) -> Option<usize> {
+        let mut dev = self.dev.try_lock()?;
+        Some(self.poll_device(&mut dev, sockets))
+    }
+
+    fn poll_device(&self, dev: &mut DeviceWrapper, sockets: &Mutex<SocketSet>) -> usize {
+        let nr_recv = dev.poll(|buf| {
             snoop_tcp_packet(buf).ok(); // preprocess TCP packets
         });
 
-        let timestamp =
-            Instant::from_micros_const((current_time_nanos() / NANOS_PER_MICROS) as i64);
         let mut iface = self.iface.lock();
         let mut sockets = sockets.lock();
-        iface.poll(timestamp, dev.deref_mut(), &mut sockets);
+        iface.poll(current_instant(), dev, &mut sockets);
+        nr_recv
+    }
+
+    /// Returns how long to wait before the next [`poll`](Self::poll) for the
+    /// timers (e.g., retransmission) of the sockets, or [`None`] if there are
+    /// no timers pending.
+    pub fn poll_delay(&self, sockets: &Mutex<SocketSet>) -> Option<Duration> {
+        let mut iface = self.iface.lock();
+        let sockets = sockets.lock();
+        iface
+            .poll_delay(current_instant(), &sockets)
+            .map(|delay| Duration::from_micros(delay.total_micros()))
+    }
+
+    /// Acknowledges the interrupt of the NIC.
+    pub fn ack_interrupt(&self) -> bool {
+        self.dev.lock().inner.borrow_mut().ack_interrupt()
     }
 }
 
 impl DeviceWrapper {
     fn new(inner: AxNetDevice) -> Self {
+        let offloads = inner.offloads();
         Self {
             inner: RefCell::new(inner),
             rx_buf_queue: VecDeque::with_capacity(RX_BUF_QUEUE_SIZE),
+            offloads,
         }
     }
 
-    fn poll<F>(&mut self, f: F)
+    fn poll<F>(&mut self, f: F) -> usize
     where
         F: Fn(&[u8]),
     {
+        self.recycle_tx_buffers();
+        let mut nr_recv = 0;
         while self.rx_buf_queue.len() < RX_BUF_QUEUE_SIZE {
             match self.inner.borrow_mut().receive() {
                 Ok(buf) => {
                     f(buf.packet());
                     self.rx_buf_queue.push_back(buf);
+                    nr_recv += 1;
                 }
                 Err(DevError::Again) => break, // TODO: better method to avoid error type conversion
                 Err(err) => {
@@ -198,11 +238,35 @@ impl DeviceWrapper {
                 }
             }
         }
+        nr_recv
     }
 
     fn receive(&mut self) -> Option<NetBufferBox<'static>> {
         self.rx_buf_queue.pop_front()
     }
+
+    /// Reclaims the buffers of the packets that the device has sent.
+    fn recycle_tx_buffers(&self) {
+        if let Err(err) = self.inner.borrow_mut().recycle_tx_buffers() {
+            warn!("recycle_tx_buffers failed: {:?}", err);
+        }
+    }
+
+    /// Whether one more packet can be transmitted: there is a free buffer for
+    /// it, and the device can accept it. Completed transmissions are reclaimed
+    /// first to free up the transmit queue.
+    fn can_transmit(&self) -> bool {
+        let stats = NET_BUF_POOL.stats();
+        if stats.in_use >= stats.capacity {
+            return false;
+        }
+        let mut dev = self.inner.borrow_mut();
+        if dev.can_transmit() {
+            return true;
+        }
+        dev.recycle_tx_buffers().ok();
+        dev.can_transmit()
+    }
 }
 
 impl Device for DeviceWrapper {
@@ -210,19 +274,38 @@ impl Device for DeviceWrapper {
     type TxToken<'a> = AxNetTxToken<'a> where Self: 'a;
 
     fn receive(&mut self, _timestamp: Instant) -> Option<(Self::RxToken<'_>, Self::TxToken<'_>)> {
+        // Keep the packet queued until the reply can be sent.
+        if self.rx_buf_queue.is_empty() || !self.can_transmit() {
+            return None;
+        }
         let rx_buf = self.receive()?;
         Some((AxNetRxToken(&self.inner, rx_buf), AxNetTxToken(&self.inner)))
     }
 
     fn transmit(&mut self, _timestamp: Instant) -> Option<Self::TxToken<'_>> {
-        Some(AxNetTxToken(&self.inner))
+        // The stack keeps the packet until the device can queue it.
+        if self.can_transmit() {
+            Some(AxNetTxToken(&self.inner))
+        } else {
+            None
+        }
     }
 
     fn capabilities(&self) -> DeviceCapabilities {
         let mut caps = DeviceCapabilities::default();
-        caps.max_transmission_unit = 1514;
+        caps.max_transmission_unit = self.offloads.max_frame_len;
         caps.max_burst_size = None;
         caps.medium = Medium::Ethernet;
+        // Only do in software what the NIC does not.
+        let checksum = match (self.offloads.rx_checksum, self.offloads.tx_checksum) {
+            (false, false) => Checksum::Both,
+            (false, true) => Checksum::Rx,
+            (true, false) => Checksum::Tx,
+            (true, true) => Checksum::None,
+        };
+        caps.checksum.ipv4 = checksum;
+        caps.checksum.tcp = checksum;
+        caps.checksum.udp = checksum;
         caps
     }
 }
@@ -252,40 +335,63 @@ impl<'a> TxToken for AxNetTxToken<'a> {
     where
         F: FnOnce(&mut [u8]) -> R,
     {
+        // The token is only given out if there are a free buffer and a free
+        // slot in the transmit queue, and the device is locked until here.
         let mut dev = self.0.borrow_mut();
-        let mut tx_buf = NET_BUF_POOL.alloc().unwrap();
+        let mut tx_buf = NET_BUF_POOL
+            .alloc()
+            .expect("no free buffer for a transmit token");
         dev.prepare_tx_buffer(&mut tx_buf, len).unwrap();
         let result = f(tx_buf.packet_mut());
         trace!("SEND {} bytes: {:02X?}", len, tx_buf.packet());
-        dev.transmit(&tx_buf).unwrap();
+        // Only queue the packet, the buffer is reclaimed after it is sent.
+        if let Err(err) = dev.transmit(tx_buf) {
+            warn!("transmit failed: {:?}", err);
+        }
         result
     }
 }
 
+fn current_instant() -> Instant {
+    Instant::from_micros_const((current_time_nanos() / NANOS_PER_MICROS) as i64)
+}
+
 fn snoop_tcp_packet(buf: &[u8]) -> Result<(), smoltcp::wire::Error> {
     use crate::SocketAddr;
     use smoltcp::wire::{EthernetFrame, IpProtocol, Ipv4Packet, TcpPacket};
 
+    if LISTEN_TABLE.is_empty() {
+        return Ok(()); // no need to create sockets for incoming connections
+    }
     let ether_frame = EthernetFrame::new_checked(buf)?;
     let ipv4_packet = Ipv4Packet::new_checked(ether_frame.payload())?;
 
     if ipv4_packet.next_header() == IpProtocol::Tcp {
         let tcp_packet = TcpPacket::new_checked(ipv4_packet.payload())?;
-        let src_addr = SocketAddr::new(ipv4_packet.src_addr().into(), tcp_packet.src_port());
-        let dst_addr = SocketAddr::new(ipv4_packet.dst_addr().into(), tcp_packet.dst_port());
         let is_first = tcp_packet.syn() && !tcp_packet.ack();
         if is_first {
             // create a socket for the first incoming TCP packet, as the later accept() returns.
+            let src_addr = SocketAddr::new(ipv4_packet.src_addr().into(), tcp_packet.src_port());
+            let dst_addr = SocketAddr::new(ipv4_packet.dst_addr().into(), tcp_packet.dst_port());
             LISTEN_TABLE.incoming_tcp_packet(src_addr, dst_addr);
         }
     }
     Ok(())
 }
 
+/// Returns the statistics of the buffers for the packets in flight.
+pub fn buffer_pool_stats() -> NetBufferPoolStats {
+    NET_BUF_POOL.stats()
+}
+
 pub(crate) fn init(mut net_dev: AxNetDevice) {
-    let pool = NetBufferPool::new(NET_BUF_POOL_SIZE, NET_BUF_LEN).unwrap();
+    // Leave room for the frames larger than the standard ones.
+    let max_frame_len = net_dev.offloads().max_frame_len;
+    let buf_len = NET_BUF_LEN + max_frame_len.saturating_sub(NetOffloads::NONE.max_frame_len);
+    let pool = NetBufferPool::new(NET_BUF_POOL_SIZE, buf_len).unwrap();
     NET_BUF_POOL.init_by(pool);
     net_dev.fill_rx_buffers(&NET_BUF_POOL).unwrap();
+    let irq_num = net_dev.irq_num();
 
     let ether_addr = EthernetAddress(net_dev.mac_address().0);
     let eth0 = InterfaceWrapper::new("eth0", net_dev, ether_addr);
@@ -300,4 +406,8 @@ pub(crate) fn init(mut net_dev: AxNetDevice) {
     info!("  ether:    {}", ETH0.ethernet_address());
     info!("  ip:       {}/{}", IP, IP_PREFIX);
     info!("  gateway:  {}", GATEWAY);
+
+    if let Some(irq_num) = irq_num {
+        irq::init(irq_num);
+    }
 }
@@ -1,11 +1,15 @@
+use alloc::sync::Arc;
 use axerrno::{ax_err, ax_err_type, AxError, AxResult};
 use axio::PollState;
 use axsync::Mutex;
+use core::task::Waker;
 
 use smoltcp::iface::SocketHandle;
 use smoltcp::socket::tcp::{self, ConnectError, RecvError, State};
 use smoltcp::wire::IpAddress;
 
+use super::listen_table::ListenTableEntry;
+use super::waiter::SocketWaiter;
 use super::{SocketSetWrapper, ETH0, LISTEN_TABLE, SOCKET_SET};
 use crate::SocketAddr;
 
@@ -24,6 +28,9 @@ pub struct TcpSocket {
     local_addr: Option<SocketAddr>,
     peer_addr: Option<SocketAddr>,
     nonblock: bool,
+    reuse_port: bool,
+    listen_entry: Option<Arc<ListenTableEntry>>, // `Some` if is listening
+    waiter: SocketWaiter,
 }
 
 impl TcpSocket {
@@ -37,6 +44,9 @@ impl TcpSocket {
             local_addr: None,
             peer_addr: None,
             nonblock: false,
+            reuse_port: false,
+            listen_entry: None,
+            waiter: SocketWaiter::new(),
         }
     }
 
@@ -71,6 +81,16 @@ impl TcpSocket {
         self.nonblock = nonblocking;
     }
 
+    /// Allows the socket to listen on the same port as other sockets that set
+    /// this option as well, which is like `SO_REUSEPORT`.
+    ///
+    /// The incoming connections are spread over the sockets, so that each of
+    /// them can be accepted by a different task. It must be set before
+    /// [`listen`](Self::listen).
+    pub fn set_reuse_port(&mut self, reuse_port: bool) {
+        self.reuse_port = reuse_port;
+    }
+
     /// Connects to the given address and port.
     ///
     /// The local port is generated automatically.
@@ -99,21 +119,25 @@ impl TcpSocket {
                 Ok((socket.local_endpoint(), socket.remote_endpoint()))
             })?;
 
-        loop {
-            SOCKET_SET.poll_interfaces();
-            let (state, may_recv) = SOCKET_SET.with_socket::<tcp::Socket, _, _>(handle, |socket| {
-                (socket.state(), socket.may_recv())
-            });
-            if may_recv || state == State::Established {
-                self.local_addr = local_addr;
-                self.peer_addr = peer_addr;
-                return Ok(());
-            } else if state == State::SynSent {
-                axtask::yield_now();
-            } else {
-                return ax_err!(ConnectionRefused, "socket connect() failed");
-            }
-        }
+        self.waiter.block_on(false, |waker| {
+            SOCKET_SET.with_socket_mut::<tcp::Socket, _, _>(handle, |socket| {
+                let state = socket.state();
+                if socket.may_recv() || state == State::Established {
+                    Ok(())
+                } else if state == State::SynSent {
+                    // wait for the state change
+                    if let Some(waker) = waker {
+                        socket.register_recv_waker(waker);
+                    }
+                    Err(AxError::WouldBlock)
+                } else {
+                    ax_err!(ConnectionRefused, "socket connect() failed")
+                }
+            })
+        })?;
+        self.local_addr = local_addr;
+        self.peer_addr = peer_addr;
+        Ok(())
     }
 
     /// Binds an unbound socket to the given address and port.
@@ -154,7 +178,7 @@ impl TcpSocket {
             port
         };
 
-        LISTEN_TABLE.listen(local_port)?;
+        self.listen_entry = Some(LISTEN_TABLE.listen(local_port, self.reuse_port)?);
         debug!("socket listening on {}", self.local_addr.unwrap());
         let handle = self.handle.take().unwrap(); // should not connect/send/recv any more
         SOCKET_SET.remove(handle);
@@ -168,37 +192,24 @@ impl TcpSocket {
     ///
     /// It's must be called after [`bind`](Self::bind) and [`listen`](Self::listen).
     pub fn accept(&mut self) -> AxResult<TcpSocket> {
-        if !self.is_listening() {
-            return ax_err!(InvalidInput, "socket accept() failed: not listen");
-        }
-
-        let local_port = self
-            .local_addr
-            .ok_or_else(|| ax_err_type!(InvalidInput, "socket accept() failed: no address bound"))?
-            .port;
+        let entry = self
+            .listen_entry
+            .as_ref()
+            .ok_or_else(|| ax_err_type!(InvalidInput, "socket accept() failed: not listen"))?;
 
-        loop {
-            SOCKET_SET.poll_interfaces();
-            match LISTEN_TABLE.accept(local_port) {
-                Ok((handle, peer_addr)) => {
-                    debug!("socket accepted a new connection {}", peer_addr.unwrap());
-                    return Ok(TcpSocket {
-                        handle: Some(handle),
-                        local_addr: self.local_addr,
-                        peer_addr,
-                        nonblock: false,
-                    });
-                }
-                Err(AxError::WouldBlock) => {
-                    if self.nonblock {
-                        return Err(AxError::WouldBlock);
-                    } else {
-                        axtask::yield_now()
-                    }
-                }
-                Err(e) => return Err(e),
-            }
-        }
+        let (handle, peer_addr) = self
+            .waiter
+            .block_on(self.nonblock, |waker| entry.accept(waker))?;
+        debug!("socket accepted a new connection {}", peer_addr.unwrap());
+        Ok(TcpSocket {
+            handle: Some(handle),
+            local_addr: self.local_addr,
+            peer_addr,
+            nonblock: false,
+            reuse_port: false,
+            listen_entry: None,
+            waiter: SocketWaiter::new(),
+        })
     }
 
     /// Close the connection.
@@ -211,8 +222,8 @@ impl TcpSocket {
             });
         } else {
             // listener
-            if let Some(local_addr) = self.local_addr {
-                LISTEN_TABLE.unlisten(local_addr.port);
+            if let Some(entry) = &self.listen_entry {
+                LISTEN_TABLE.unlisten(entry);
             }
         }
         SOCKET_SET.poll_interfaces();
@@ -224,9 +235,8 @@ impl TcpSocket {
         let handle = self
             .handle
             .ok_or_else(|| ax_err_type!(NotConnected, "socket recv() failed"))?;
-        loop {
-            SOCKET_SET.poll_interfaces();
-            match SOCKET_SET.with_socket_mut::<tcp::Socket, _, _>(handle, |socket| {
+        self.waiter.block_on(self.nonblock, |waker| {
+            SOCKET_SET.with_socket_mut::<tcp::Socket, _, _>(handle, |socket| {
                 if !socket.is_open() {
                     // not connected
                     ax_err!(NotConnected, "socket recv() failed")
@@ -243,22 +253,13 @@ impl TcpSocket {
                     }
                 } else {
                     // no more data
-                    Err(AxError::WouldBlock)
-                }
-            }) {
-                Ok(n) => {
-                    return Ok(n);
-                }
-                Err(AxError::WouldBlock) => {
-                    if self.nonblock {
-                        return Err(AxError::WouldBlock);
-                    } else {
-                        axtask::yield_now()
+                    if let Some(waker) = waker {
+                        socket.register_recv_waker(waker);
                     }
+                    Err(AxError::WouldBlock)
                 }
-                Err(e) => return Err(e),
-            }
-        }
+            })
+        })
     }
 
     /// Transmits data in the given buffer.
@@ -266,9 +267,8 @@ impl TcpSocket {
         let handle = self
             .handle
             .ok_or_else(|| ax_err_type!(NotConnected, "socket send() failed"))?;
-        loop {
-            SOCKET_SET.poll_interfaces();
-            match SOCKET_SET.with_socket_mut::<tcp::Socket, _, _>(handle, |socket| {
+        self.waiter.block_on(self.nonblock, |waker| {
+            SOCKET_SET.with_socket_mut::<tcp::Socket, _, _>(handle, |socket| {
                 if !socket.is_open() || !socket.may_send() {
                     // not connected
                     ax_err!(NotConnected, "socket send() failed")
@@ -278,54 +278,171 @@ impl TcpSocket {
                     let len = socket
                         .send_slice(buf)
                         .map_err(|_| ax_err_type!(ConnectionRefused, "socket send() failed"))?;
+                    super::irq::wake_poll_task(); // flush it out
                     Ok(len)
                 } else {
                     // tx buffer is full
+                    if let Some(waker) = waker {
+                        socket.register_send_waker(waker);
+                    }
                     Err(AxError::WouldBlock)
                 }
-            }) {
-                Ok(n) => {
-                    return Ok(n);
+            })
+        })
+    }
+
+    /// Receives data by passing the received bytes in the receive buffer of
+    /// the socket to `f`, without copying them out first.
+    ///
+    /// `f` returns how many bytes at the beginning of the given slice have
+    /// been consumed, which are removed from the buffer. The slice is only
+    /// the contiguous part of the ring buffer, so it may be shorter than the
+    /// data available. Returns what `f` returns, or `Ok(0)` if the connection
+    /// is closed by the peer.
+    ///
+    /// `f` runs with the socket set locked, so it must not access any socket,
+    /// and should be quick (e.g., not do I/O) to not stall other sockets.
+    pub fn recv_with<F>(&self, mut f: F) -> AxResult<usize>
+    where
+        F: FnMut(&[u8]) -> AxResult<usize>,
+    {
+        let handle = self
+            .handle
+            .ok_or_else(|| ax_err_type!(NotConnected, "socket recv() failed"))?;
+        self.waiter.block_on(self.nonblock, |waker| {
+            SOCKET_SET.with_socket_mut::<tcp::Socket, _, _>(handle, |socket| {
+                if !socket.is_open() {
+                    // not connected
+                    ax_err!(NotConnected, "socket recv() failed")
+                } else if !socket.may_recv() {
+                    // connection closed
+                    Ok(0)
+                } else if socket.can_recv() {
+                    // data available
+                    let res = socket.recv(|buf| match f(buf) {
+                        Ok(len) => {
+                            let len = len.min(buf.len());
+                            (len, Ok(len))
+                        }
+                        Err(e) => (0, Err(e)),
+                    });
+                    match res {
+                        Ok(res) => res,
+                        Err(RecvError::Finished) => Ok(0),
+                        Err(_) => ax_err!(ConnectionRefused, "socket recv() failed"),
+                    }
+                } else {
+                    // no more data
+                    if let Some(waker) = waker {
+                        socket.register_recv_waker(waker);
+                    }
+                    Err(AxError::WouldBlock)
                 }
-                Err(AxError::WouldBlock) => {
-                    if self.nonblock {
-                        return Err(AxError::WouldBlock);
-                    } else {
-                        axtask::yield_now()
+            })
+        })
+    }
+
+    /// Transmits data by letting `f` fill the free space in the transmit
+    /// buffer of the socket directly, without copying it from another buffer.
+    ///
+    /// `f` returns how many bytes at the beginning of the given slice have
+    /// been filled, which are enqueued to be sent. The slice is only the
+    /// contiguous part of the free space in the ring buffer, so it may be
+    /// shorter than the free space. Returns what `f` returns.
+    ///
+    /// `f` runs with the socket set locked, so it must not access any socket.
+    pub fn send_with<F>(&self, mut f: F) -> AxResult<usize>
+    where
+        F: FnMut(&mut [u8]) -> AxResult<usize>,
+    {
+        let handle = self
+            .handle
+            .ok_or_else(|| ax_err_type!(NotConnected, "socket send() failed"))?;
+        self.waiter.block_on(self.nonblock, |waker| {
+            SOCKET_SET.with_socket_mut::<tcp::Socket, _, _>(handle, |socket| {
+                if !socket.is_open() || !socket.may_send() {
+                    // not connected
+                    ax_err!(NotConnected, "socket send() failed")
+                } else if socket.can_send() {
+                    // connected, and the tx buffer is not full
+                    let len = socket
+                        .send(|buf| match f(buf) {
+                            Ok(len) => {
+                                let len = len.min(buf.len());
+                                (len, Ok(len))
+                            }
+                            Err(e) => (0, Err(e)),
+                        })
+                        .map_err(|_| ax_err_type!(ConnectionRefused, "socket send() failed"))??;
+                    if len > 0 {
+                        super::irq::wake_poll_task(); // flush it out
                     }
+                    Ok(len)
+                } else {
+                    // tx buffer is full
+                    if let Some(waker) = waker {
+                        socket.register_send_waker(waker);
+                    }
+                    Err(AxError::WouldBlock)
                 }
-                Err(e) => return Err(e),
-            }
-        }
+            })
+        })
     }
 
     /// Detect whether the socket needs to receive/can send.
     ///
     /// Return is <need to receive, can send>
+    ///
+    /// If the socket is not ready for either, the wakers registered by
+    /// [`register_poll_waker`](Self::register_poll_waker) are woken up once
+    /// it may become ready.
     pub fn poll(&self) -> AxResult<PollState> {
         SOCKET_SET.poll_interfaces();
+        let waker = self.waiter.waker();
         if let Some(handle) = self.handle {
             // stream
             SOCKET_SET.with_socket_mut::<tcp::Socket, _, _>(handle, |socket| {
-                Ok(PollState {
+                let state = PollState {
                     readable: socket.is_open() && socket.can_recv(),
                     writable: socket.is_open() && socket.can_send(),
-                })
+                };
+                if let Some(waker) = waker {
+                    if !state.readable {
+                        socket.register_recv_waker(waker);
+                    }
+                    if !state.writable {
+                        socket.register_send_waker(waker);
+                    }
+                }
+                Ok(state)
             })
         } else {
             // listener
-            let local_port = self
-                .local_addr
-                .ok_or_else(|| {
-                    ax_err_type!(InvalidInput, "socket poll() failed: no address bound")
-                })?
-                .port;
+            let entry = self
+                .listen_entry
+                .as_ref()
+                .ok_or_else(|| ax_err_type!(InvalidInput, "socket poll() failed: not listen"))?;
             Ok(PollState {
-                readable: LISTEN_TABLE.can_accept(local_port)?,
+                readable: entry.can_accept(waker)?,
                 writable: false,
             })
         }
     }
+
+    /// Registers a waker that is woken up whenever the readiness of the socket
+    /// (see [`poll`](Self::poll)) may have changed, until it is unregistered.
+    ///
+    /// Returns `false` if it's not supported (i.e., the NIC is not driven by
+    /// interrupts), in which case the socket must be polled.
+    pub fn register_poll_waker(&self, waker: &Waker) -> bool {
+        self.waiter.register_poll_waker(waker)
+    }
+
+    /// Unregisters a waker registered by
+    /// [`register_poll_waker`](Self::register_poll_waker).
+    pub fn unregister_poll_waker(&self, waker: &Waker) {
+        self.waiter.unregister_poll_waker(waker)
+    }
 }
 
 impl Drop for TcpSocket {
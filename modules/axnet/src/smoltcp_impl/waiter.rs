@@ -0,0 +1,141 @@
+use axerrno::{AxError, AxResult};
+use core::task::Waker;
+
+use super::SOCKET_SET;
+
+cfg_if::cfg_if! {
+    if #[cfg(all(feature = "irq", feature = "multitask"))] {
+        use alloc::{sync::Arc, task::Wake, vec::Vec};
+        use core::sync::atomic::{AtomicBool, Ordering};
+
+        use axsync::Mutex;
+        use axtask::WaitQueue;
+
+        struct WaiterInner {
+            woken: AtomicBool,
+            wq: WaitQueue,
+            /// Persistent wakers of readiness changes (e.g., from `epoll`).
+            poll_wakers: Mutex<Vec<Waker>>,
+        }
+
+        impl Wake for WaiterInner {
+            fn wake(self: Arc<Self>) {
+                self.wake_by_ref();
+            }
+
+            fn wake_by_ref(self: &Arc<Self>) {
+                self.woken.store(true, Ordering::Release);
+                self.wq.notify_all(false);
+                for waker in self.poll_wakers.lock().iter() {
+                    waker.wake_by_ref();
+                }
+            }
+        }
+    }
+}
+
+/// Blocks the tasks that operate on a socket until the socket is ready.
+///
+/// If the NIC is driven by interrupts, the tasks sleep until the network stack
+/// wakes up the [`Waker`] registered to the socket. Otherwise, they yield the
+/// CPU and poll the NIC again next time.
+pub struct SocketWaiter {
+    #[cfg(all(feature = "irq", feature = "multitask"))]
+    inner: Arc<WaiterInner>,
+    #[cfg(all(feature = "irq", feature = "multitask"))]
+    waker: Waker,
+}
+
+impl SocketWaiter {
+    #[cfg(all(feature = "irq", feature = "multitask"))]
+    pub fn new() -> Self {
+        let inner = Arc::new(WaiterInner {
+            woken: AtomicBool::new(false),
+            wq: WaitQueue::new(),
+            poll_wakers: Mutex::new(Vec::new()),
+        });
+        let waker = Waker::from(inner.clone());
+        Self { inner, waker }
+    }
+
+    #[cfg(not(all(feature = "irq", feature = "multitask")))]
+    pub const fn new() -> Self {
+        Self {}
+    }
+
+    /// Returns the waker to be registered to the socket when it is found not
+    /// ready, or [`None`] if the NIC is polled.
+    pub fn waker(&self) -> Option<&Waker> {
+        #[cfg(all(feature = "irq", feature = "multitask"))]
+        if super::irq::is_enabled() {
+            return Some(&self.waker);
+        }
+        None
+    }
+
+    /// Registers a waker that is woken up (and kept) whenever the socket is
+    /// woken up, until it is unregistered. Returns `false` if the NIC is
+    /// polled and no wakeups will happen.
+    pub fn register_poll_waker(&self, _waker: &Waker) -> bool {
+        #[cfg(all(feature = "irq", feature = "multitask"))]
+        if super::irq::is_enabled() {
+            self.inner.poll_wakers.lock().push(_waker.clone());
+            return true;
+        }
+        false
+    }
+
+    /// Unregisters a waker registered by
+    /// [`register_poll_waker`](Self::register_poll_waker).
+    pub fn unregister_poll_waker(&self, _waker: &Waker) {
+        #[cfg(all(feature = "irq", feature = "multitask"))]
+        self.inner
+            .poll_wakers
+            .lock()
+            .retain(|w| !w.will_wake(_waker));
+    }
+
+    /// Prepares for a wait, returns the waker that should be registered to the
+    /// socket if it is found not ready, or [`None`] if the NIC is polled.
+    ///
+    /// It must be called before checking the socket, so that the wakeups
+    /// between the check and [`wait`](Self::wait) are not lost.
+    fn prepare(&self) -> Option<&Waker> {
+        #[cfg(all(feature = "irq", feature = "multitask"))]
+        if super::irq::is_enabled() {
+            self.inner.woken.store(false, Ordering::Release);
+        }
+        self.waker()
+    }
+
+    fn wait(&self) {
+        #[cfg(all(feature = "irq", feature = "multitask"))]
+        if super::irq::is_enabled() {
+            // timers of the socket may have changed, let the poll task know.
+            super::irq::wake_poll_task();
+            let inner = &self.inner;
+            inner.wq.wait_until(|| inner.woken.load(Ordering::Acquire));
+            return;
+        }
+        axtask::yield_now();
+    }
+
+    /// Polls the interfaces and calls `f` repeatedly, until it returns a result
+    /// other than [`Err(WouldBlock)`](AxError::WouldBlock), or returns it
+    /// directly if `nonblock` is `true`.
+    ///
+    /// `f` receives the waker to register to the socket before returning
+    /// [`Err(WouldBlock)`](AxError::WouldBlock).
+    pub fn block_on<T, F>(&self, nonblock: bool, mut f: F) -> AxResult<T>
+    where
+        F: FnMut(Option<&Waker>) -> AxResult<T>,
+    {
+        loop {
+            SOCKET_SET.poll_interfaces();
+            match f(self.prepare()) {
+                Err(AxError::WouldBlock) if !nonblock => self.wait(),
+                res => return res,
+            }
+        }
+    }
+}
@@ -2,6 +2,8 @@ use core::panic::PanicInfo;
 
 #[panic_handler]
 fn panic(info: &PanicInfo) -> ! {
+    #[cfg(feature = "log-buffered")]
+    axlog::flush(); // print the buffered records before the panic message
     error!("{}", info);
     loop {}
     // axhal::misc::terminate()
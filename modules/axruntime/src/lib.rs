@@ -13,6 +13,10 @@
 //! - `fs`: Enable filesystem support.
 //! - `net`: Enable networking support.
 //! - `display`: Enable graphics support.
+//! - `log-buffered`: Buffer the log records and print them in a low-priority
+//!   task, see [`axlog::enable_buffering`].
+//! - `tickless`: Stop the periodic timer tick when a CPU is idle or has only
+//!   one runnable task, see [`axtask::on_timer_tick`].
 //!
 //! All the features are optional and disabled by default.
 
@@ -91,6 +95,19 @@ impl axlog::LogIf for LogIfImpl {
     }
 }
 
+struct TraceIfImpl;
+
+#[crate_interface::impl_interface]
+impl axtrace::TraceIf for TraceIfImpl {
+    fn current_time_nanos() -> u64 {
+        axhal::time::current_time_nanos()
+    }
+
+    fn current_cpu_id() -> usize {
+        axhal::cpu::this_cpu_id()
+    }
+}
+
 use core::sync::atomic::{AtomicUsize, Ordering};
 
 static INITED_CPUS: AtomicUsize = AtomicUsize::new(0);
@@ -190,6 +207,9 @@ pub extern "C" fn rust_main(cpu_id: usize, dtb: usize) -> ! {
         init_interrupt();
     }
 
+    #[cfg(feature = "log-buffered")]
+    start_log_drainer();
+
     info!("Primary CPU {} init OK.", cpu_id);
     INITED_CPUS.fetch_add(1, Ordering::Relaxed);
 
@@ -217,6 +237,30 @@ pub extern "C" fn rust_main(cpu_id: usize, dtb: usize) -> ! {
     }
 }
 
+/// Starts buffering the log records, and spawns a low-priority task to print
+/// them periodically.
+#[cfg(feature = "log-buffered")]
+fn start_log_drainer() {
+    use core::time::Duration;
+    const LOG_DRAIN_INTERVAL: Duration = Duration::from_millis(10);
+    #[allow(clippy::declare_interior_mutable_const)]
+    const EMPTY_RING: axlog::LogRing = axlog::LogRing::new();
+    static LOG_RINGS: [axlog::LogRing; axconfig::SMP] = [EMPTY_RING; axconfig::SMP];
+
+    axlog::enable_buffering(&LOG_RINGS);
+    axtask::spawn_raw(
+        || {
+            axtask::set_priority(19);
+            loop {
+                axlog::drain();
+                axtask::sleep(LOG_DRAIN_INTERVAL);
+            }
+        },
+        "log_drainer".into(),
+        axconfig::TASK_STACK_SIZE,
+    );
+}
+
 #[cfg(feature = "alloc")]
 fn init_allocator() {
     use axhal::mem::{memory_regions, phys_to_virt, MemRegionFlags};
@@ -273,13 +317,17 @@ fn remap_kernel_memory() -> Result<(), axhal::paging::PagingError> {
 fn init_interrupt() {
     use axhal::time::TIMER_IRQ_NUM;
 
-    // Setup timer interrupt handler
+    // Setup timer interrupt handler. In the tickless mode, the timer is
+    // programmed by `axtask::on_timer_tick` instead of periodically.
+    #[cfg(not(feature = "tickless"))]
     const PERIODIC_INTERVAL_NANOS: u64 =
         axhal::time::NANOS_PER_SEC / axconfig::TICKS_PER_SEC as u64;
 
+    #[cfg(not(feature = "tickless"))]
     #[percpu::def_percpu]
     static NEXT_DEADLINE: u64 = 0;
 
+    #[cfg(not(feature = "tickless"))]
     fn update_timer() {
         let now_ns = axhal::time::current_time_nanos();
         // Safety: we have disabled preemption in IRQ handler.
@@ -292,6 +340,7 @@ fn init_interrupt() {
     }
 
     axhal::irq::register_handler(TIMER_IRQ_NUM, || {
+        #[cfg(not(feature = "tickless"))]
         update_timer();
         #[cfg(feature = "multitask")]
         axtask::on_timer_tick();
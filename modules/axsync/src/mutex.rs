@@ -1,4 +1,4 @@
-//! A naïve sleeping mutex.
+//! An adaptive sleeping mutex.
 
 use core::cell::UnsafeCell;
 use core::fmt;
@@ -7,14 +7,55 @@ use core::sync::atomic::{AtomicU64, Ordering};
 
 use axtask::{current, WaitQueue};
 
+/// Set in the lock word if some tasks are sleeping in the wait queue. The rest
+/// bits are the ID of the owner task.
+const PARKED: u64 = 1 << 63;
+/// Maximum number of times to spin on a locked [`Mutex`] whose owner is
+/// running, before going to sleep.
+const MAX_SPINS: usize = 1000;
+
+/// Contention statistics of all [`Mutex`]es, see [`mutex_stats`].
+#[derive(Debug, Clone, Copy, Default)]
+pub struct MutexStats {
+    /// Number of locks that found the mutex locked.
+    pub contended: u64,
+    /// Number of contended locks acquired by spinning.
+    pub spin_acquired: u64,
+    /// Number of times a task went to sleep on a mutex.
+    pub parked: u64,
+    /// Number of unlocks that handed the mutex over to a sleeping task.
+    pub handoffs: u64,
+}
+
+static CONTENDED: AtomicU64 = AtomicU64::new(0);
+static SPIN_ACQUIRED: AtomicU64 = AtomicU64::new(0);
+static PARKED_COUNT: AtomicU64 = AtomicU64::new(0);
+static HANDOFFS: AtomicU64 = AtomicU64::new(0);
+
+/// Returns the contention statistics of all [`Mutex`]es since boot.
+///
+/// Only the slow paths are counted, uncontended locks are not.
+pub fn mutex_stats() -> MutexStats {
+    MutexStats {
+        contended: CONTENDED.load(Ordering::Relaxed),
+        spin_acquired: SPIN_ACQUIRED.load(Ordering::Relaxed),
+        parked: PARKED_COUNT.load(Ordering::Relaxed),
+        handoffs: HANDOFFS.load(Ordering::Relaxed),
+    }
+}
+
 /// A mutual exclusion primitive useful for protecting shared data, similar to
 /// [`std::sync::Mutex`](https://doc.rust-lang.org/std/sync/struct.Mutex.html).
 ///
-/// When the mutex is locked, the current task will block and be put into the
-/// wait queue. When the mutex is unlocked, all tasks waiting on the queue
-/// will be woken up.
+/// When the mutex is locked by a task running on another CPU, the current task
+/// spins for a while, expecting that the lock will be released soon. Otherwise,
+/// the current task will block and be put into the wait queue. When the mutex
+/// is unlocked, it is handed over to the first task waiting on the queue, so
+/// the waiting tasks get the lock in FIFO order and are never starved by new
+/// comers.
 pub struct Mutex<T: ?Sized> {
     wq: WaitQueue,
+    /// The ID of the owner task, or 0 if unlocked, with the [`PARKED`] bit.
     owner_id: AtomicU64,
     data: UnsafeCell<T>,
 }
@@ -70,27 +111,12 @@ impl<T: ?Sized> Mutex<T> {
     /// and the lock will be dropped when the guard falls out of scope.
     pub fn lock(&self) -> MutexGuard<T> {
         let current_id = current().id().as_u64();
-        loop {
-            // Can fail to lock even if the spinlock is not locked. May be more efficient than `try_lock`
-            // when called in a loop.
-            match self.owner_id.compare_exchange_weak(
-                0,
-                current_id,
-                Ordering::Acquire,
-                Ordering::Relaxed,
-            ) {
-                Ok(_) => break,
-                Err(owner_id) => {
-                    assert_ne!(
-                        owner_id,
-                        current_id,
-                        "{} tried to acquire mutex it already owns.",
-                        current().id_name()
-                    );
-                    // Wait until the lock looks unlocked before retrying
-                    self.wq.wait_until(|| !self.is_locked());
-                }
-            }
+        if self
+            .owner_id
+            .compare_exchange(0, current_id, Ordering::Acquire, Ordering::Relaxed)
+            .is_err()
+        {
+            self.lock_contended(current_id);
         }
         MutexGuard {
             lock: self,
@@ -98,6 +124,73 @@ impl<T: ?Sized> Mutex<T> {
         }
     }
 
+    #[cold]
+    fn lock_contended(&self, current_id: u64) {
+        CONTENDED.fetch_add(1, Ordering::Relaxed);
+
+        // Spin while the owner is running on another CPU, unless there are
+        // already tasks waiting in the queue, which are served first.
+        let mut spins = 0;
+        loop {
+            let state = self.owner_id.load(Ordering::Relaxed);
+            if state == 0 {
+                if self
+                    .owner_id
+                    .compare_exchange_weak(0, current_id, Ordering::Acquire, Ordering::Relaxed)
+                    .is_ok()
+                {
+                    SPIN_ACQUIRED.fetch_add(1, Ordering::Relaxed);
+                    return;
+                }
+                continue;
+            }
+            assert_ne!(
+                state & !PARKED,
+                current_id,
+                "{} tried to acquire mutex it already owns.",
+                current().id_name()
+            );
+            if state & PARKED != 0
+                || spins == MAX_SPINS
+                || !axtask::is_task_running(state & !PARKED)
+            {
+                break;
+            }
+            spins += 1;
+            core::hint::spin_loop();
+        }
+
+        // Sleep until the owner hands the lock over to us. The condition is
+        // checked with the wait queue locked, so setting `PARKED` and going
+        // to sleep is atomic with respect to `force_unlock`.
+        self.wq.wait_until(|| {
+            let mut state = self.owner_id.load(Ordering::Acquire);
+            loop {
+                if state & !PARKED == current_id {
+                    return true; // handed over by the previous owner
+                }
+                let new_state = if state == 0 {
+                    current_id
+                } else {
+                    state | PARKED
+                };
+                match self.owner_id.compare_exchange_weak(
+                    state,
+                    new_state,
+                    Ordering::Acquire,
+                    Ordering::Acquire,
+                ) {
+                    Ok(_) if state == 0 => return true,
+                    Ok(_) => {
+                        PARKED_COUNT.fetch_add(1, Ordering::Relaxed);
+                        return false;
+                    }
+                    Err(s) => state = s,
+                }
+            }
+        });
+    }
+
     /// Try to lock this [`Mutex`], returning a lock guard if successful.
     #[inline(always)]
     pub fn try_lock(&self) -> Option<MutexGuard<T>> {
@@ -120,20 +213,41 @@ impl<T: ?Sized> Mutex<T> {
 
     /// Force unlock the [`Mutex`].
     ///
+    /// If there are tasks waiting on the queue, the lock is handed over to
+    /// the first one rather than released.
+    ///
     /// # Safety
     ///
     /// This is *extremely* unsafe if the lock is not held by the current
     /// thread. However, this can be useful in some instances for exposing
     /// the lock to FFI that doesn’t know how to deal with RAII.
     pub unsafe fn force_unlock(&self) {
-        let owner_id = self.owner_id.swap(0, Ordering::Release);
+        let current_id = current().id().as_u64();
+        if self
+            .owner_id
+            .compare_exchange(current_id, 0, Ordering::Release, Ordering::Relaxed)
+            .is_ok()
+        {
+            return;
+        }
+        let owner_id = self.owner_id.load(Ordering::Relaxed);
         assert_eq!(
-            owner_id,
-            current().id().as_u64(),
+            owner_id & !PARKED,
+            current_id,
             "{} tried to release mutex it doesn't own",
             current().id_name()
         );
-        self.wq.notify_one(true);
+        self.wq.notify_one_with(true, |task, num_left| {
+            let new_state = match task {
+                Some(task) => {
+                    HANDOFFS.fetch_add(1, Ordering::Relaxed);
+                    let parked = if num_left > 0 { PARKED } else { 0 };
+                    task.id().as_u64() | parked
+                }
+                None => 0,
+            };
+            self.owner_id.store(new_state, Ordering::Release);
+        });
     }
 
     /// Returns a mutable reference to the underlying data.
@@ -11,7 +11,7 @@ use crate::hv::scheduler::{HVScheduler, HVTask};
 #[cfg(feature = "hv")]
 use crate::hv::vcpu::VirtCpu;
 
-pub(crate) use crate::run_queue::{AxRunQueue, RUN_QUEUE};
+pub(crate) use crate::run_queue::{current_run_queue, select_spawn_run_queue};
 
 #[doc(cfg(feature = "multitask"))]
 pub use crate::task::{CurrentTask, TaskId, TaskInner};
@@ -31,7 +31,15 @@ cfg_if::cfg_if! {
         pub(crate) type Scheduler = scheduler::RRScheduler<TaskInner, MAX_TIME_SLICE>;
     } else if #[cfg(feature = "sched_cfs")] {
         pub(crate) type AxTask = scheduler::CFSTask<TaskInner>;
-        pub(crate) type Scheduler = scheduler::CFScheduler<TaskInner>;
+        pub(crate) type Scheduler = scheduler::CFScheduler<TaskInner, CfsClock>;
+
+        pub(crate) struct CfsClock;
+
+        impl scheduler::SchedClock for CfsClock {
+            fn now_ns() -> u64 {
+                axhal::time::current_time_nanos()
+            }
+        }
     } else if #[cfg(feature = "hv")] {
         const MAX_TIME_SLICE: usize = 5;
         pub(crate) type AxTask = HVTask<MAX_TIME_SLICE>;
@@ -79,8 +87,6 @@ pub fn init_scheduler() {
     info!("Initialize scheduling...");
 
     crate::run_queue::init();
-    #[cfg(feature = "irq")]
-    crate::timers::init();
 
     info!("  use {} scheduler.", Scheduler::scheduler_name());
 }
@@ -93,12 +99,20 @@ pub fn init_scheduler_secondary() {
 /// Handles periodic timer ticks for the task manager.
 ///
 /// For example, advance scheduler states, checks timed events, etc.
+///
+/// With the `tickless` feature, it handles every timer interrupt instead, and
+/// programs the next one by itself.
 #[cfg(feature = "irq")]
 #[doc(cfg(feature = "irq"))]
 pub fn on_timer_tick() {
     // error!("phy {} time tick ",this_cpu_id());
-    crate::timers::check_events();
-    RUN_QUEUE.lock().scheduler_timer_tick();
+    #[cfg(not(feature = "tickless"))]
+    {
+        crate::timers::check_events();
+        current_run_queue().scheduler_timer_tick();
+    }
+    #[cfg(feature = "tickless")]
+    crate::timers::tickless::on_timer_irq();
 }
 
 /// Spawns a new task with the given parameters.
@@ -109,7 +123,7 @@ where
     F: FnOnce() + Send + 'static,
 {
     let task = TaskInner::new(f, name, stack_size);
-    RUN_QUEUE.lock().add_task(task.clone());
+    select_spawn_run_queue(&task).add_task(task.clone());
     task
 }
 
@@ -120,18 +134,17 @@ pub fn spawn_vcpu(vcpu: Arc<VirtCpu>) -> AxTaskRef {
     let name = format!("{}", &vcpu);
     error!("{} add in rq", &name);
     let task = TaskInner::new_vcpu(name, axconfig::TASK_STACK_SIZE, vcpu);
-    RUN_QUEUE.lock().add_task(task.clone());
+    select_spawn_run_queue(&task).add_task(task.clone());
     task
 }
 
 #[cfg(feature = "hv")]
 pub fn spawn_vcpus(vcpus: Vec<Arc<VirtCpu>>) {
-    let mut guard = RUN_QUEUE.lock();
-
     for vcpu in vcpus {
         let name = format!("{}", &vcpu);
         error!("{} add in rq", &name);
-        guard.add_task(TaskInner::new_vcpu(name, axconfig::TASK_STACK_SIZE, vcpu));
+        let task = TaskInner::new_vcpu(name, axconfig::TASK_STACK_SIZE, vcpu);
+        select_spawn_run_queue(&task).add_task(task);
     }
 }
 
@@ -158,13 +171,23 @@ where
 ///
 /// [CFS]: https://en.wikipedia.org/wiki/Completely_Fair_Scheduler
 pub fn set_priority(prio: isize) -> bool {
-    RUN_QUEUE.lock().set_current_priority(prio)
+    current_run_queue().set_current_priority(prio)
+}
+
+/// Returns `true` if the task with the given ID (see [`TaskId::as_u64`]) is
+/// running on some CPU.
+///
+/// The result is only a hint, as the task may be switched out right after it
+/// returns. It helps decide whether it's worth busy-waiting for the task,
+/// e.g., to release a lock.
+pub fn is_task_running(task_id: u64) -> bool {
+    crate::run_queue::is_task_running(task_id)
 }
 
 /// Current task gives up the CPU time voluntarily, and switches to another
 /// ready task.
 pub fn yield_now() {
-    RUN_QUEUE.lock().yield_current();
+    current_run_queue().yield_current();
 }
 
 /// Current task is going to sleep for the given duration.
@@ -179,14 +202,14 @@ pub fn sleep(dur: core::time::Duration) {
 /// If the feature `irq` is not enabled, it uses busy-wait instead.
 pub fn sleep_until(deadline: axhal::time::TimeValue) {
     #[cfg(feature = "irq")]
-    RUN_QUEUE.lock().sleep_until(deadline);
+    current_run_queue().sleep_until(deadline);
     #[cfg(not(feature = "irq"))]
     axhal::time::busy_wait_until(deadline);
 }
 
 /// Exits the current task.
 pub fn exit(exit_code: i32) -> ! {
-    RUN_QUEUE.lock().exit_current(exit_code)
+    current_run_queue().exit_current(exit_code)
 }
 
 /// The idle task routine.
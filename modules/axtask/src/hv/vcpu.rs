@@ -16,7 +16,6 @@ use crate::hv::vm::config::BSP_CPU_ID;
 use crate::hv::vm::VirtMach;
 use crate::hv::vmx::{handle_external_interrupt, handle_msr_read, handle_msr_write, X64VirtDevices};
 use crate::on_timer_tick;
-use crate::run_queue::RUN_QUEUE;
 use crate::utils::CpuSet;
 
 
@@ -281,7 +280,7 @@ impl VirtCpu {
 
     fn handle_vmx_preemption_timer(&self) -> HyperResult {
         // error!("vmx preemption timer");
-        // RUN_QUEUE.lock().hv_scheduler_timer_tick();
+        // crate::current_run_queue().hv_scheduler_timer_tick();
         on_timer_tick();
         self.reset_vmx_preemption_timer()
     }
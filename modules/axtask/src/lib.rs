@@ -13,6 +13,12 @@
 //!    APIs can be used, such as [`sleep`], [`sleep_until`], and
 //!    [`WaitQueue::wait_timeout`].
 //! - `preempt`: Enable preemptive scheduling.
+//! - `tickless`: Program the timer in one-shot mode at the next timer deadline,
+//!   and stop the scheduler tick when the CPU is idle or has only one runnable
+//!   task. It also enables the `irq` feature if it is enabled. With SMP, new
+//!   and woken tasks are not put on other CPUs whose tick is stopped, as they
+//!   cannot be notified yet, so tasks are spread over the CPUs more slowly
+//!   (by work stealing). It is thus disabled by default.
 //! - `sched_fifo`: Use the [FIFO cooperative scheduler][1]. It also enables the
 //!   `multitask` feature if it is enabled. This feature is enabled by default.
 //! - `sched_rr`: Use the [Round-robin preemptive scheduler][2]. It also enables
@@ -35,6 +41,7 @@ cfg_if::cfg_if! {
         extern crate log;
         extern crate alloc;
         mod run_queue;
+        mod stack;
         mod task;
         mod wait_queue;
 
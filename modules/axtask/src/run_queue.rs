@@ -1,13 +1,37 @@
-use alloc::collections::VecDeque;use alloc::sync::Arc;
+use alloc::collections::VecDeque;
+use alloc::sync::Arc;
+use core::ops::Deref;
+use core::sync::atomic::{AtomicPtr, AtomicU64, AtomicUsize, Ordering};
+
+use axhal::cpu::this_cpu_id;
+use kernel_guard::{BaseGuard, NoPreemptIrqSave};
 use lazy_init::LazyInit;
 use scheduler::BaseScheduler;
-use spinlock::SpinNoIrq;
+use spinlock::{SpinNoIrq, SpinNoIrqGuard, SpinRaw};
 
 use crate::task::{CurrentTask, TaskState};
-use crate::{AxTaskRef, current, Scheduler, TaskInner, WaitQueue};
+use crate::{current, AxTask, AxTaskRef, Scheduler, TaskInner, WaitQueue};
 
-// TODO: per-CPU
-pub(crate) static RUN_QUEUE: LazyInit<SpinNoIrq<AxRunQueue>> = LazyInit::new();
+/// The run queue of the current CPU.
+#[percpu::def_percpu]
+static RUN_QUEUE: LazyInit<AxRunQueue> = LazyInit::new();
+
+/// Run queues of all CPUs, indexed by the CPU ID. It's used to access the run
+/// queues of other CPUs (e.g., for task migration and work stealing).
+#[allow(clippy::declare_interior_mutable_const)]
+const NULL_RUN_QUEUE: AtomicPtr<AxRunQueue> = AtomicPtr::new(core::ptr::null_mut());
+static RUN_QUEUES: [AtomicPtr<AxRunQueue>; axconfig::SMP] = [NULL_RUN_QUEUE; axconfig::SMP];
+
+/// IDs of the tasks running on all CPUs, indexed by the CPU ID. They are only
+/// hints for other CPUs, see [`is_task_running`].
+#[allow(clippy::declare_interior_mutable_const)]
+const NO_TASK_ID: AtomicU64 = AtomicU64::new(0);
+static RUNNING_TASK_IDS: [AtomicU64; axconfig::SMP] = [NO_TASK_ID; axconfig::SMP];
+
+/// When each CPU started the last context switch, to trace its latency.
+#[allow(clippy::declare_interior_mutable_const)]
+const NO_STAMP: axtrace::Stamp = axtrace::Stamp::new();
+static SWITCH_STAMPS: [axtrace::Stamp; axconfig::SMP] = [NO_STAMP; axconfig::SMP];
 
 // TODO: per-CPU
 static EXITED_TASKS: SpinNoIrq<VecDeque<AxTaskRef>> = SpinNoIrq::new(VecDeque::new());
@@ -17,66 +41,189 @@ static WAIT_FOR_EXIT: WaitQueue = WaitQueue::new();
 #[percpu::def_percpu]
 static IDLE_TASK: LazyInit<AxTaskRef> = LazyInit::new();
 
+/// The task that was switched out on this CPU, but whose `on_cpu` flag has not
+/// been cleared yet. It holds a strong reference (from [`Arc::into_raw`]).
+#[percpu::def_percpu]
+static PREV_TASK: usize = 0;
+
 pub(crate) struct AxRunQueue {
-    scheduler: Scheduler,
+    cpu_id: usize,
+    scheduler: SpinRaw<Scheduler>, // IRQs and preemption are disabled by `AxRunQueueRef`
+}
+
+/// A reference to a run queue, with both IRQs and preemption disabled on the
+/// current CPU while it's alive.
+///
+/// It does not lock the run queue itself. The inner scheduler is locked only
+/// when it's being manipulated, and never across a context switch.
+pub(crate) struct AxRunQueueRef {
+    inner: &'static AxRunQueue,
+    state: <NoPreemptIrqSave as BaseGuard>::State,
+}
+
+impl Deref for AxRunQueueRef {
+    type Target = AxRunQueue;
+    #[inline]
+    fn deref(&self) -> &Self::Target {
+        self.inner
+    }
+}
+
+impl Drop for AxRunQueueRef {
+    #[inline]
+    fn drop(&mut self) {
+        NoPreemptIrqSave::release(self.state);
+    }
+}
+
+/// Returns the run queue of the current CPU.
+pub(crate) fn current_run_queue() -> AxRunQueueRef {
+    let state = NoPreemptIrqSave::acquire();
+    AxRunQueueRef {
+        inner: local_run_queue(),
+        state,
+    }
+}
+
+/// Selects a run queue to wake up the given task.
+///
+/// The current CPU is preferred as long as the task's CPU affinity allows it,
+/// so the wakee can run as soon as the waker yields.
+pub(crate) fn select_run_queue(task: &AxTaskRef) -> AxRunQueueRef {
+    let state = NoPreemptIrqSave::acquire();
+    let cpu_id = this_cpu_id();
+    let index = if task.cpu_affinity().contains(cpu_id) {
+        cpu_id
+    } else {
+        select_run_queue_index(task)
+    };
+    AxRunQueueRef {
+        inner: get_run_queue(index).unwrap_or_else(local_run_queue),
+        state,
+    }
+}
+
+/// Selects a run queue for a newly spawned task.
+///
+/// New tasks are spread over all CPUs in its affinity in a round-robin manner,
+/// skipping those which would not notice them soon (see
+/// [`picks_up_new_tasks`]) unless there are no others.
+pub(crate) fn select_spawn_run_queue(task: &AxTaskRef) -> AxRunQueueRef {
+    let state = NoPreemptIrqSave::acquire();
+    AxRunQueueRef {
+        inner: get_run_queue(select_run_queue_index(task)).unwrap_or_else(local_run_queue),
+        state,
+    }
+}
+
+fn select_run_queue_index(task: &AxTaskRef) -> usize {
+    static RR_INDEX: AtomicUsize = AtomicUsize::new(0);
+    let mut fallback = None;
+    for _ in 0..axconfig::SMP {
+        let index = RR_INDEX.fetch_add(1, Ordering::Relaxed) % axconfig::SMP;
+        if task.cpu_affinity().contains(index) && get_run_queue(index).is_some() {
+            if picks_up_new_tasks(index) {
+                return index;
+            }
+            fallback.get_or_insert(index);
+        }
+    }
+    fallback.unwrap_or_else(this_cpu_id)
+}
+
+/// Whether the given CPU runs a task added to its run queue by the current CPU
+/// without much delay.
+///
+/// In the tickless mode, a CPU whose scheduler tick is stopped is not notified
+/// (there are no IPIs yet), and may not look at its run queue for a long time.
+fn picks_up_new_tasks(cpu_id: usize) -> bool {
+    #[cfg(feature = "tickless")]
+    {
+        cpu_id == this_cpu_id() || !crate::timers::tickless::is_tick_stopped(cpu_id)
+    }
+    #[cfg(not(feature = "tickless"))]
+    {
+        let _ = cpu_id;
+        true
+    }
+}
+
+fn local_run_queue() -> &'static AxRunQueue {
+    // Safety: the caller has disabled preemption, so we won't be migrated to
+    // other CPUs.
+    unsafe { RUN_QUEUE.current_ref_raw() }.deref()
+}
+
+fn get_run_queue(cpu_id: usize) -> Option<&'static AxRunQueue> {
+    let ptr = RUN_QUEUES.get(cpu_id)?.load(Ordering::Acquire);
+    // Safety: run queues are never freed after initialization.
+    unsafe { ptr.as_ref() }
 }
 
 impl AxRunQueue {
-    pub fn new() -> SpinNoIrq<Self> {
-        let gc_task = TaskInner::new(gc_entry, "gc".into(), axconfig::TASK_STACK_SIZE);
-        let mut scheduler = Scheduler::new();
-        scheduler.add_task(gc_task);
-        SpinNoIrq::new(Self { scheduler })
+    fn new(cpu_id: usize) -> Self {
+        Self {
+            cpu_id,
+            scheduler: SpinRaw::new(Scheduler::new()),
+        }
     }
 
-    pub fn add_task(&mut self, task: AxTaskRef) {
-        debug!("task spawn: {}", task.id_name());
+    pub fn add_task(&self, task: AxTaskRef) {
+        debug!("task spawn: {} on CPU {}", task.id_name(), self.cpu_id);
         assert!(task.is_ready());
-        self.scheduler.add_task(task);
+        self.scheduler.lock().add_task(task);
+        #[cfg(feature = "tickless")]
+        if self.cpu_id == this_cpu_id() && !crate::current().is_idle() {
+            crate::timers::tickless::start_tick();
+        }
+    }
+
+    /// Whether the scheduler tick is needed on this CPU, i.e., the current
+    /// task may be preempted by another runnable task.
+    #[cfg(feature = "tickless")]
+    pub fn needs_tick(&self) -> bool {
+        !crate::current().is_idle() && !self.scheduler.lock().is_empty()
     }
 
     #[cfg(feature = "irq")]
-    pub fn scheduler_timer_tick(&mut self) {
+    pub fn scheduler_timer_tick(&self) {
         let curr = crate::current();
-        if !curr.is_idle() && self.scheduler.task_tick(curr.as_task_ref()) {
+        if !curr.is_idle() && self.scheduler.lock().task_tick(curr.as_task_ref()) {
             #[cfg(feature = "preempt")]
             curr.set_preempt_pending(true);
         }
     }
 
     #[cfg(feature = "hv")]
-    pub fn hv_scheduler_timer_tick(&mut self) {
+    pub fn hv_scheduler_timer_tick(&self) {
         let curr = crate::current();
-        if !curr.is_idle() && self.scheduler.vcpu_task_tick(curr.as_task_ref()) {
+        if !curr.is_idle() && self.scheduler.lock().vcpu_task_tick(curr.as_task_ref()) {
             #[cfg(feature = "preempt")]
             curr.set_preempt_pending(true);
         }
     }
 
-
-
-    pub fn yield_current(&mut self) {
+    pub fn yield_current(&self) {
         let curr = crate::current();
         debug!("task yield: {}", curr.id_name());
         assert!(curr.is_running());
         self.resched(false);
     }
 
-    pub fn set_current_priority(&mut self, prio: isize) -> bool {
+    pub fn set_current_priority(&self, prio: isize) -> bool {
         self.scheduler
+            .lock()
             .set_priority(crate::current().as_task_ref(), prio)
     }
 
     #[cfg(feature = "preempt")]
-    pub fn preempt_resched(&mut self) {
+    pub fn preempt_resched(&self) {
         let curr = crate::current();
         assert!(curr.is_running());
 
-        // When we get the mutable reference of the run queue, we must
-        // have held the `SpinNoIrq` lock with both IRQs and preemption
-        // disabled. So we need to set `current_disable_count` to 1 in
-        // `can_preempt()` to obtain the preemption permission before
-        //  locking the run queue.
+        // When we get the reference of the run queue, we must have both IRQs
+        // and preemption disabled. So we need to set `current_disable_count`
+        // to 1 in `can_preempt()` to obtain the preemption permission.
         let can_preempt = curr.can_preempt(1);
 
         debug!(
@@ -91,7 +238,7 @@ impl AxRunQueue {
         }
     }
 
-    pub fn exit_current(&mut self, exit_code: i32) -> ! {
+    pub fn exit_current(&self, exit_code: i32) -> ! {
         let curr = crate::current();
         debug!("task exit: {}, exit_code={}", curr.id_name(), exit_code);
         assert!(curr.is_running());
@@ -101,46 +248,99 @@ impl AxRunQueue {
             axhal::misc::terminate();
         } else {
             curr.set_state(TaskState::Exited);
-            curr.notify_exit(exit_code, self);
+            curr.notify_exit(exit_code);
             EXITED_TASKS.lock().push_back(curr.clone());
-            WAIT_FOR_EXIT.notify_one_locked(false, self);
+            WAIT_FOR_EXIT.notify_one(false);
             self.resched(false);
         }
         unreachable!("task exited!");
     }
 
-    pub fn block_current<F>(&mut self, wait_queue_push: F)
-    where
-        F: FnOnce(AxTaskRef),
-    {
+    /// Blocks the current task and puts it into the wait queue held by
+    /// `wq_guard`, then reschedules.
+    ///
+    /// The task state is changed while the wait queue is locked, so that
+    /// wakers on other CPUs always see a blocked task in the wait queue.
+    pub fn blocked_resched(&self, wq_guard: SpinNoIrqGuard<VecDeque<AxTaskRef>>) {
+        self.block_current_locked(wq_guard);
+        self.resched(false);
+    }
+
+    /// Like [`blocked_resched`](Self::blocked_resched), but also sets a timer
+    /// to wake up the current task at `deadline` if it's not already set.
+    #[cfg(feature = "irq")]
+    pub fn blocked_timeout_resched(
+        &self,
+        wq_guard: SpinNoIrqGuard<VecDeque<AxTaskRef>>,
+        deadline: axhal::time::TimeValue,
+    ) {
+        let curr = self.block_current_locked(wq_guard);
+        // Set the alarm after the task is blocked, otherwise the wakeup may be
+        // lost if the timer fires on other CPUs in between.
+        if !curr.in_timer_list() {
+            crate::timers::set_alarm_wakeup(deadline, curr.clone());
+        }
+        self.resched(false);
+    }
+
+    fn block_current_locked(
+        &self,
+        mut wq_guard: SpinNoIrqGuard<VecDeque<AxTaskRef>>,
+    ) -> CurrentTask {
         let curr = crate::current();
         debug!("task block: {}", curr.id_name());
         assert!(curr.is_running());
         assert!(!curr.is_idle());
 
         // we must not block current task with preemption disabled.
+        // (one for the run queue reference, one for the wait queue lock)
         #[cfg(feature = "preempt")]
-        assert!(curr.can_preempt(1));
+        assert!(curr.can_preempt(2));
 
         curr.set_state(TaskState::Blocked);
-        wait_queue_push(curr.clone());
-        self.resched(false);
+        curr.set_in_wait_queue(true);
+        wq_guard.push_back(curr.clone());
+        curr
     }
 
-    pub fn unblock_task(&mut self, task: AxTaskRef, resched: bool) {
-        debug!("task unblock: {}", task.id_name());
-        if task.is_blocked() {
-            task.set_state(TaskState::Ready);
-            self.scheduler.add_task(task); // TODO: priority
-            if resched {
-                #[cfg(feature = "preempt")]
-                crate::current().set_preempt_pending(true);
+    pub fn unblock_task(&self, task: AxTaskRef, resched: bool) {
+        // Only one of the wakers (timer or `notify()`) can succeed.
+        if task.transition_state(TaskState::Blocked, TaskState::Ready) {
+            debug!("task unblock: {} on CPU {}", task.id_name(), self.cpu_id);
+            task.wake_stamp().set_now();
+            // The task may still be switching out on its previous CPU, wait
+            // until its context has been saved.
+            while task.on_cpu() {
+                core::hint::spin_loop();
+            }
+            // Hand the task over if it last ran on another CPU.
+            let prev_cpu = task.cpu_id();
+            if prev_cpu != self.cpu_id {
+                if let Some(src) = get_run_queue(prev_cpu) {
+                    src.scheduler.lock().migrate_task_out(&task);
+                }
+                self.scheduler.lock().migrate_task_in(&task);
+            }
+            let mut scheduler = self.scheduler.lock();
+            scheduler.add_task(task.clone()); // TODO: priority
+            if self.cpu_id == this_cpu_id() {
+                let curr = crate::current();
+                if resched
+                    || (!curr.is_idle() && scheduler.check_preempt(curr.as_task_ref(), &task))
+                {
+                    #[cfg(feature = "preempt")]
+                    curr.set_preempt_pending(true);
+                }
+                #[cfg(feature = "tickless")]
+                if !curr.is_idle() {
+                    crate::timers::tickless::start_tick();
+                }
             }
         }
     }
 
     #[cfg(feature = "irq")]
-    pub fn sleep_until(&mut self, deadline: axhal::time::TimeValue) {
+    pub fn sleep_until(&self, deadline: axhal::time::TimeValue) {
         let curr = crate::current();
         debug!("task sleep: {}, deadline={:?}", curr.id_name(), deadline);
         assert!(curr.is_running());
@@ -148,8 +348,8 @@ impl AxRunQueue {
 
         let now = axhal::time::current_time();
         if now < deadline {
-            crate::timers::set_alarm_wakeup(deadline, curr.clone());
             curr.set_state(TaskState::Blocked);
+            crate::timers::set_alarm_wakeup(deadline, curr.clone());
             self.resched(false);
         }
     }
@@ -158,22 +358,67 @@ impl AxRunQueue {
 impl AxRunQueue {
     /// Common reschedule subroutine. If `preempt`, keep current task's time
     /// slice, otherwise reset it.
-    fn resched(&mut self, preempt: bool) {
+    fn resched(&self, preempt: bool) {
         let prev = crate::current();
         if prev.is_running() {
             prev.set_state(TaskState::Ready);
             if !prev.is_idle() {
-                self.scheduler.put_prev_task(prev.clone(), preempt);
+                self.scheduler.lock().put_prev_task(prev.clone(), preempt);
             }
+        } else if !prev.is_idle() {
+            // blocked or exited, account its running time before it's switched out.
+            self.scheduler.lock().task_blocked(prev.as_task_ref());
+        }
+        // Do not hold our own scheduler lock while stealing from others.
+        let next = self.scheduler.lock().pick_next_task();
+        let next = next
+            .or_else(|| self.steal_task())
+            .unwrap_or_else(|| unsafe {
+                // Safety: IRQs must be disabled at this time.
+                IDLE_TASK.current_ref_raw().get_unchecked().clone()
+            });
+        #[cfg(feature = "tickless")]
+        if !next.is_idle() && !self.scheduler.lock().is_empty() {
+            crate::timers::tickless::start_tick();
         }
-        let next = self.scheduler.pick_next_task().unwrap_or_else(|| unsafe {
-            // Safety: IRQs must be disabled at this time.
-            IDLE_TASK.current_ref_raw().get_unchecked().clone()
-        });
         self.switch_to(prev, next);
     }
 
-    fn switch_to(&mut self, prev_task: CurrentTask, next_task: AxTaskRef) {
+    /// Steals a runnable task from other CPUs' run queues when this CPU has
+    /// nothing to run.
+    ///
+    /// Victims are scanned starting from the next CPU, and are skipped if
+    /// their run queues are being used. Tasks that are not allowed to run on
+    /// this CPU, or are still switching out on the victim CPU, are put back.
+    fn steal_task(&self) -> Option<AxTaskRef> {
+        for i in 1..axconfig::SMP {
+            let victim_id = (self.cpu_id + i) % axconfig::SMP;
+            let Some(victim) = get_run_queue(victim_id) else {
+                continue;
+            };
+            let Some(mut sched) = victim.scheduler.try_lock() else {
+                continue;
+            };
+            if let Some(task) = sched.pick_next_task() {
+                if task.cpu_affinity().contains(self.cpu_id) && !task.on_cpu() {
+                    sched.migrate_task_out(&task);
+                    drop(sched);
+                    self.scheduler.lock().migrate_task_in(&task);
+                    debug!(
+                        "task steal: {} from CPU {} to CPU {}",
+                        task.id_name(),
+                        victim_id,
+                        self.cpu_id
+                    );
+                    return Some(task);
+                }
+                sched.add_task(task);
+            }
+        }
+        None
+    }
+
+    fn switch_to(&self, prev_task: CurrentTask, next_task: AxTaskRef) {
         trace!(
             "context switch: {} -> {}",
             prev_task.id_name(),
@@ -182,9 +427,20 @@ impl AxRunQueue {
         #[cfg(feature = "preempt")]
         next_task.set_preempt_pending(false);
         next_task.set_state(TaskState::Running);
+        axtrace::trace_since!("sched.wakeup", next_task.wake_stamp());
         if prev_task.ptr_eq(&next_task) {
             return;
         }
+        if !prev_task.check_stack_guard() {
+            panic!("kernel stack overflow in task {}", prev_task.id_name());
+        }
+        SWITCH_STAMPS[self.cpu_id].set_now();
+
+        // Claim the next task as running on this CPU. It will not be picked
+        // by other CPUs until it's switched out and the flag is cleared.
+        next_task.set_on_cpu(true);
+        next_task.set_cpu_id(self.cpu_id);
+        RUNNING_TASK_IDS[self.cpu_id].store(next_task.id().as_u64(), Ordering::Relaxed);
 
         #[cfg(feature = "hv")]
         {
@@ -201,12 +457,42 @@ impl AxRunQueue {
             assert!(Arc::strong_count(prev_task.as_task_ref()) > 1);
             assert!(Arc::strong_count(&next_task) >= 1);
 
+            // `prev_task` is still on this CPU until the switch is finished.
+            PREV_TASK.write_current_raw(Arc::into_raw(prev_task.clone()) as usize);
+
             CurrentTask::set_current(prev_task, next_task);
             (*prev_ctx_ptr).switch_to(&*next_ctx_ptr);
+
+            finish_task_switch();
         }
     }
 }
 
+/// Clears the `on_cpu` flag of the task that was just switched out on this
+/// CPU. It must be called by the next task right after the context switch.
+///
+/// # Safety
+///
+/// IRQs and preemption must be disabled.
+pub(crate) unsafe fn finish_task_switch() {
+    axtrace::trace_since!("sched.switch", &SWITCH_STAMPS[this_cpu_id()]);
+    let prev_ptr = PREV_TASK.read_current_raw();
+    if prev_ptr != 0 {
+        PREV_TASK.write_current_raw(0);
+        let prev = AxTaskRef::from_raw(prev_ptr as *const AxTask);
+        prev.set_on_cpu(false);
+    }
+}
+
+/// Returns `true` if the task with the given ID is running on some CPU.
+///
+/// It's only a hint, as the task may be switched out right after the check.
+pub(crate) fn is_task_running(task_id: u64) -> bool {
+    RUNNING_TASK_IDS
+        .iter()
+        .any(|id| id.load(Ordering::Relaxed) == task_id)
+}
+
 fn gc_entry() {
     loop {
         // Drop all exited tasks and recycle resources.
@@ -229,6 +515,14 @@ fn gc_entry() {
     }
 }
 
+fn init_run_queue() -> &'static AxRunQueue {
+    let cpu_id = this_cpu_id();
+    RUN_QUEUE.with_current(|rq| rq.init_by(AxRunQueue::new(cpu_id)));
+    let rq = local_run_queue();
+    RUN_QUEUES[cpu_id].store(rq as *const _ as *mut _, Ordering::Release);
+    rq
+}
+
 pub(crate) fn init() {
     const IDLE_TASK_STACK_SIZE: usize = 4096;
     let idle_task = TaskInner::new(|| crate::run_idle(), "idle".into(), IDLE_TASK_STACK_SIZE);
@@ -236,14 +530,24 @@ pub(crate) fn init() {
 
     let main_task = TaskInner::new_init("main".into());
     main_task.set_state(TaskState::Running);
+    main_task.set_on_cpu(true);
 
-    RUN_QUEUE.init_by(AxRunQueue::new());
+    let rq = init_run_queue();
+    main_task.set_cpu_id(rq.cpu_id);
+    RUNNING_TASK_IDS[rq.cpu_id].store(main_task.id().as_u64(), Ordering::Relaxed);
+    let gc_task = TaskInner::new(gc_entry, "gc".into(), axconfig::TASK_STACK_SIZE);
+    rq.scheduler.lock().add_task(gc_task);
     unsafe { CurrentTask::init_current(main_task) }
 }
 
 pub(crate) fn init_secondary() {
     let idle_task = TaskInner::new_init("idle".into());
     idle_task.set_state(TaskState::Running);
+    idle_task.set_on_cpu(true);
     IDLE_TASK.with_current(|i| i.init_by(idle_task.clone()));
+
+    let rq = init_run_queue();
+    idle_task.set_cpu_id(rq.cpu_id);
+    RUNNING_TASK_IDS[rq.cpu_id].store(idle_task.id().as_u64(), Ordering::Relaxed);
     unsafe { CurrentTask::init_current(idle_task) }
 }
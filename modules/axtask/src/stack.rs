@@ -0,0 +1,135 @@
+//! Task kernel stacks, recycled through a pool.
+//!
+//! Stacks are allocated by pages below the heap (i.e., not through the byte
+//! allocator, to avoid fragmenting it). When a task is dropped, its stack is
+//! kept in a pool of stacks of the same size for later tasks, up to
+//! [`MAX_POOLED_STACKS`] for each size.
+//!
+//! The lowest page of each stack is a guard page filled with
+//! [`GUARD_PATTERN`], which is checked when the task is switched out and when
+//! the stack is recycled, to detect stack overflows.
+
+use alloc::{collections::BTreeMap, vec::Vec};
+use core::ptr::NonNull;
+
+use memory_addr::{align_up_4k, VirtAddr, PAGE_SIZE_4K};
+use spinlock::SpinNoIrq;
+
+/// Size of the guard page at the bottom of each stack.
+const GUARD_SIZE: usize = PAGE_SIZE_4K;
+/// The pattern filled in the guard page.
+const GUARD_PATTERN: u64 = 0xdead_beef_dead_beef;
+/// Number of words at the top of the guard page (i.e., the first to be
+/// overwritten by an overflow) that are checked on every context switch.
+const GUARD_CHECK_WORDS: usize = 8;
+/// Maximum number of free stacks kept in the pool for each size.
+const MAX_POOLED_STACKS: usize = 64;
+
+/// Free stacks indexed by the usable size, as the addresses of the guard
+/// pages.
+static STACK_POOL: SpinNoIrq<BTreeMap<usize, Vec<usize>>> = SpinNoIrq::new(BTreeMap::new());
+
+pub(crate) struct TaskStack {
+    /// Start of the guard page, the stack is above it.
+    base: NonNull<u8>,
+    /// Usable size of the stack, not including the guard page.
+    size: usize,
+}
+
+impl TaskStack {
+    /// Takes a stack with at least `size` usable bytes from the pool, or
+    /// allocates a new one.
+    pub fn alloc(size: usize) -> Self {
+        let size = align_up_4k(size);
+        let pooled = STACK_POOL
+            .lock()
+            .get_mut(&size)
+            .and_then(|stacks| stacks.pop());
+        if let Some(base) = pooled {
+            return Self {
+                base: NonNull::new(base as *mut u8).unwrap(),
+                size,
+            };
+        }
+        let base = raw::alloc_pages(GUARD_SIZE + size).expect("failed to allocate task stack");
+        // SAFETY: the guard page is just allocated.
+        unsafe {
+            core::slice::from_raw_parts_mut(base.as_ptr().cast::<u64>(), GUARD_SIZE / 8)
+                .fill(GUARD_PATTERN)
+        };
+        Self { base, size }
+    }
+
+    pub const fn top(&self) -> VirtAddr {
+        unsafe { core::mem::transmute(self.base.as_ptr().add(GUARD_SIZE + self.size)) }
+    }
+
+    fn guard_words(&self) -> &[u64] {
+        // SAFETY: the guard page is owned by this stack, and is only written
+        // by the task if it overflows.
+        unsafe { core::slice::from_raw_parts(self.base.as_ptr().cast(), GUARD_SIZE / 8) }
+    }
+
+    /// Returns `false` if the top of the guard page has been overwritten,
+    /// i.e., the stack has overflowed.
+    pub fn check_guard(&self) -> bool {
+        let words = self.guard_words();
+        words[words.len() - GUARD_CHECK_WORDS..]
+            .iter()
+            .all(|&w| w == GUARD_PATTERN)
+    }
+}
+
+impl Drop for TaskStack {
+    fn drop(&mut self) {
+        // Do not reuse a stack whose guard page is corrupted.
+        if self.guard_words().iter().all(|&w| w == GUARD_PATTERN) {
+            let mut pool = STACK_POOL.lock();
+            let stacks = pool.entry(self.size).or_default();
+            if stacks.len() < MAX_POOLED_STACKS {
+                stacks.push(self.base.as_ptr() as usize);
+                return;
+            }
+        } else {
+            warn!(
+                "task stack at {:#x} overflowed",
+                self.base.as_ptr() as usize
+            );
+        }
+        raw::dealloc_pages(self.base, GUARD_SIZE + self.size);
+    }
+}
+
+#[cfg(not(feature = "test"))]
+mod raw {
+    use core::ptr::NonNull;
+    use memory_addr::PAGE_SIZE_4K;
+
+    pub fn alloc_pages(size: usize) -> Option<NonNull<u8>> {
+        axalloc::global_allocator()
+            .alloc_pages(size / PAGE_SIZE_4K, PAGE_SIZE_4K)
+            .ok()
+            .and_then(|vaddr| NonNull::new(vaddr as *mut u8))
+    }
+
+    pub fn dealloc_pages(ptr: NonNull<u8>, size: usize) {
+        axalloc::global_allocator().dealloc_pages(ptr.as_ptr() as usize, size / PAGE_SIZE_4K)
+    }
+}
+
+/// The global allocator is not [`axalloc`] in tests.
+#[cfg(feature = "test")]
+mod raw {
+    use core::{alloc::Layout, ptr::NonNull};
+    use memory_addr::PAGE_SIZE_4K;
+
+    pub fn alloc_pages(size: usize) -> Option<NonNull<u8>> {
+        let layout = Layout::from_size_align(size, PAGE_SIZE_4K).unwrap();
+        NonNull::new(unsafe { alloc::alloc::alloc(layout) })
+    }
+
+    pub fn dealloc_pages(ptr: NonNull<u8>, size: usize) {
+        let layout = Layout::from_size_align(size, PAGE_SIZE_4K).unwrap();
+        unsafe { alloc::alloc::dealloc(ptr.as_ptr(), layout) }
+    }
+}
@@ -1,10 +1,7 @@
 use alloc::{boxed::Box, string::String, sync::Arc};
 use core::ops::Deref;
-use core::sync::atomic::{AtomicBool, AtomicI32, AtomicU64, AtomicU8, Ordering};
-use core::{alloc::Layout, cell::UnsafeCell, fmt, ptr::NonNull};
-
-#[cfg(feature = "preempt")]
-use core::sync::atomic::AtomicUsize;
+use core::sync::atomic::{AtomicBool, AtomicI32, AtomicU64, AtomicU8, AtomicUsize, Ordering};
+use core::{cell::UnsafeCell, fmt};
 
 use axhal::arch::TaskContext;
 use memory_addr::{align_up_4k, PhysAddr, VirtAddr};
@@ -16,8 +13,11 @@ use axhal::mem::virt_to_phys;
 use hypercraft::HyperError;
 #[cfg(feature = "hv")]
 use crate::hv::vcpu::VirtCpu;
+#[cfg(feature = "irq")]
+use crate::timers::TimerTicket;
+use crate::stack::TaskStack;
 use crate::utils::CpuSet;
-use crate::{AxRunQueue, AxTask, AxTaskRef, WaitQueue};
+use crate::{AxTask, AxTaskRef, WaitQueue};
 
 /// A unique identifier for a thread.
 #[derive(Debug, Clone, Copy, Eq, PartialEq)]
@@ -70,10 +70,19 @@ pub struct TaskInner {
 
     task_type: TaskType,
     state: AtomicU8,
+    /// Whether the task is running on a CPU, or is still being switched out.
+    on_cpu: AtomicBool,
+    /// The CPU that the task last ran on, whose run queue its scheduling state
+    /// (e.g., vruntime) is relative to.
+    cpu_id: AtomicUsize,
+    /// When the task was woken up, to trace the delay until it runs.
+    wake_stamp: axtrace::Stamp,
 
     in_wait_queue: AtomicBool,
     #[cfg(feature = "irq")]
     in_timer_list: AtomicBool,
+    #[cfg(feature = "irq")]
+    timer_ticket: UnsafeCell<Option<TimerTicket>>,
     #[cfg(feature = "preempt")]
     need_resched: AtomicBool,
     #[cfg(feature = "preempt")]
@@ -152,9 +161,14 @@ impl TaskInner {
             cpu_affinity: CpuSet::new_full(),
             task_type: TaskType::Task { entry: None },
             state: AtomicU8::new(TaskState::Ready as u8),
+            on_cpu: AtomicBool::new(false),
+            cpu_id: AtomicUsize::new(0),
+            wake_stamp: axtrace::Stamp::new(),
             in_wait_queue: AtomicBool::new(false),
             #[cfg(feature = "irq")]
             in_timer_list: AtomicBool::new(false),
+            #[cfg(feature = "irq")]
+            timer_ticket: UnsafeCell::new(None),
             #[cfg(feature = "preempt")]
             need_resched: AtomicBool::new(false),
             #[cfg(feature = "preempt")]
@@ -204,6 +218,21 @@ impl TaskInner {
         self.state.store(state as u8, Ordering::Release)
     }
 
+    /// Changes the task state from `current_state` to `new_state` atomically.
+    ///
+    /// Returns `false` if the task is not in `current_state`.
+    #[inline]
+    pub(crate) fn transition_state(&self, current_state: TaskState, new_state: TaskState) -> bool {
+        self.state
+            .compare_exchange(
+                current_state as u8,
+                new_state as u8,
+                Ordering::AcqRel,
+                Ordering::Acquire,
+            )
+            .is_ok()
+    }
+
     #[inline]
     pub(crate) fn is_running(&self) -> bool {
         matches!(self.state(), TaskState::Running)
@@ -229,6 +258,43 @@ impl TaskInner {
         self.is_idle
     }
 
+    #[inline]
+    pub(crate) fn on_cpu(&self) -> bool {
+        self.on_cpu.load(Ordering::Acquire)
+    }
+
+    #[inline]
+    pub(crate) fn set_on_cpu(&self, on_cpu: bool) {
+        self.on_cpu.store(on_cpu, Ordering::Release);
+    }
+
+    #[inline]
+    pub(crate) fn cpu_id(&self) -> usize {
+        self.cpu_id.load(Ordering::Acquire)
+    }
+
+    #[inline]
+    pub(crate) fn set_cpu_id(&self, cpu_id: usize) {
+        self.cpu_id.store(cpu_id, Ordering::Release);
+    }
+
+    /// Returns `false` if the kernel stack has overflowed (see
+    /// [`TaskStack::check_guard`]).
+    #[inline]
+    pub(crate) fn check_stack_guard(&self) -> bool {
+        self.kstack.as_ref().map_or(true, |kstack| kstack.check_guard())
+    }
+
+    #[inline]
+    pub(crate) fn wake_stamp(&self) -> &axtrace::Stamp {
+        &self.wake_stamp
+    }
+
+    #[inline]
+    pub(crate) fn cpu_affinity(&self) -> &CpuSet {
+        &self.cpu_affinity
+    }
+
     #[inline]
     pub(crate) fn in_wait_queue(&self) -> bool {
         self.in_wait_queue.load(Ordering::Acquire)
@@ -251,6 +317,17 @@ impl TaskInner {
         self.in_timer_list.store(in_timer_list, Ordering::Release);
     }
 
+    /// Replaces the ticket of the wakeup timer, returns the old one.
+    ///
+    /// # Safety
+    ///
+    /// It must be called only by the task itself.
+    #[inline]
+    #[cfg(feature = "irq")]
+    pub(crate) unsafe fn set_timer_ticket(&self, ticket: Option<TimerTicket>) -> Option<TimerTicket> {
+        core::mem::replace(&mut *self.timer_ticket.get(), ticket)
+    }
+
     #[inline]
     #[cfg(feature = "preempt")]
     pub(crate) fn set_preempt_pending(&self, pending: bool) {
@@ -282,16 +359,16 @@ impl TaskInner {
     fn current_check_preempt_pending() {
         let curr = crate::current();
         if curr.need_resched.load(Ordering::Acquire) && curr.can_preempt(0) {
-            let mut rq = crate::RUN_QUEUE.lock();
+            let rq = crate::current_run_queue();
             if curr.need_resched.load(Ordering::Acquire) {
                 rq.preempt_resched();
             }
         }
     }
 
-    pub(crate) fn notify_exit(&self, exit_code: i32, rq: &mut AxRunQueue) {
+    pub(crate) fn notify_exit(&self, exit_code: i32) {
         self.exit_code.store(exit_code, Ordering::Release);
-        self.wait_for_exit.notify_all_locked(false, rq);
+        self.wait_for_exit.notify_all(false);
     }
 
     #[inline]
@@ -357,31 +434,6 @@ impl Drop for TaskInner {
     }
 }
 
-struct TaskStack {
-    ptr: NonNull<u8>,
-    layout: Layout,
-}
-
-impl TaskStack {
-    pub fn alloc(size: usize) -> Self {
-        let layout = Layout::from_size_align(size, 16).unwrap();
-        Self {
-            ptr: NonNull::new(unsafe { alloc::alloc::alloc(layout) }).unwrap(),
-            layout,
-        }
-    }
-
-    pub const fn top(&self) -> VirtAddr {
-        unsafe { core::mem::transmute(self.ptr.as_ptr().add(self.layout.size())) }
-    }
-}
-
-impl Drop for TaskStack {
-    fn drop(&mut self) {
-        unsafe { alloc::alloc::dealloc(self.ptr.as_ptr(), self.layout) }
-    }
-}
-
 
 /// A wrapper of [`AxTaskRef`] as the current task.
 pub struct CurrentTask(ManuallyDrop<AxTaskRef>);
@@ -434,8 +486,8 @@ impl Deref for CurrentTask {
 }
 
 extern "C" fn task_entry() -> ! {
-    // release the lock that was implicitly held across the rescheduling
-    unsafe { crate::RUN_QUEUE.force_unlock() };
+    // finish the context switch started by the previous task on this CPU
+    unsafe { crate::run_queue::finish_task_switch() };
     #[cfg(feature = "irq")]
     axhal::arch::enable_irqs();
     let task = crate::current();
@@ -128,3 +128,19 @@ fn test_task_join() {
         assert_eq!(tasks[i].join(), Some(i as _));
     }
 }
+
+#[test]
+fn test_stack_pool() {
+    use crate::stack::TaskStack;
+    let _lock = SERIAL.lock();
+
+    let stack = TaskStack::alloc(0x2800); // rounded up to 0x3000
+    let top = stack.top();
+    assert!(stack.check_guard());
+    drop(stack);
+
+    // reuses the stack of the same size
+    let stack = TaskStack::alloc(0x3000);
+    assert_eq!(stack.top(), top);
+    assert!(stack.check_guard());
+}
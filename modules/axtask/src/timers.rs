@@ -1,40 +1,78 @@
-use alloc::sync::Arc;
+use axhal::cpu::this_cpu_id;
 use axhal::time::current_time;
-use lazy_init::LazyInit;
 use spinlock::SpinNoIrq;
-use timer_list::{TimeValue, TimerEvent, TimerList};
+use timer_list::{TimeValue, TimerEvent, TimerHandle, TimerWheel};
 
-use crate::{AxTaskRef, RUN_QUEUE};
+use crate::run_queue::select_run_queue;
+use crate::AxTaskRef;
 
-// TODO: per-CPU
-static TIMER_LIST: LazyInit<SpinNoIrq<TimerList<TaskWakeupEvent>>> = LazyInit::new();
+/// Granularity of the timer wheels. Timers are delayed by at most one
+/// granularity after their deadlines.
+///
+/// In the tickless mode, the timer interrupt is programmed at the deadline of
+/// the next timer rather than the next tick, so a finer granularity is used.
+#[cfg(not(feature = "tickless"))]
+const TIMER_GRANULARITY: TimeValue = TimeValue::from_micros(100);
+#[cfg(feature = "tickless")]
+const TIMER_GRANULARITY: TimeValue = TimeValue::from_micros(10);
+
+/// Timer wheels of all CPUs, indexed by the CPU ID. A timer is always set on
+/// the current CPU's wheel, and is expired by the timer ticks of that CPU.
+#[allow(clippy::declare_interior_mutable_const)]
+const EMPTY_TIMER_WHEEL: SpinNoIrq<TimerWheel<TaskWakeupEvent>> =
+    SpinNoIrq::new(TimerWheel::new(TIMER_GRANULARITY));
+static TIMER_WHEELS: [SpinNoIrq<TimerWheel<TaskWakeupEvent>>; axconfig::SMP] =
+    [EMPTY_TIMER_WHEEL; axconfig::SMP];
+
+/// Where the wakeup timer of a task is set, used to cancel it without
+/// scanning.
+#[derive(Clone, Copy)]
+pub(crate) struct TimerTicket {
+    cpu_id: usize,
+    handle: TimerHandle,
+}
 
 struct TaskWakeupEvent(AxTaskRef);
 
 impl TimerEvent for TaskWakeupEvent {
     fn callback(self, _now: TimeValue) {
-        let mut rq = RUN_QUEUE.lock();
         self.0.set_in_timer_list(false);
-        rq.unblock_task(self.0, true);
+        select_run_queue(&self.0).unblock_task(self.0, true);
     }
 }
 
 pub fn set_alarm_wakeup(deadline: TimeValue, task: AxTaskRef) {
-    let mut timers = TIMER_LIST.lock();
+    let cpu_id = this_cpu_id();
+    let mut timers = TIMER_WHEELS[cpu_id].lock();
     task.set_in_timer_list(true);
-    timers.set(deadline, TaskWakeupEvent(task));
+    let ticket = TimerTicket {
+        cpu_id,
+        handle: timers.set(deadline, TaskWakeupEvent(task.clone())),
+    };
+    drop(timers);
+    // Safety: only the task itself sets or cancels its own timer.
+    unsafe { task.set_timer_ticket(Some(ticket)) };
+    #[cfg(feature = "tickless")]
+    tickless::program_timer(false);
 }
 
 pub fn cancel_alarm(task: &AxTaskRef) {
-    let mut timers = TIMER_LIST.lock();
-    task.set_in_timer_list(false);
-    timers.cancel(|t| Arc::ptr_eq(&t.0, task));
+    // Safety: only the task itself sets or cancels its own timer.
+    if let Some(ticket) = unsafe { task.set_timer_ticket(None) } {
+        let event = {
+            let mut timers = TIMER_WHEELS[ticket.cpu_id].lock();
+            task.set_in_timer_list(false);
+            timers.cancel(ticket.handle)
+        };
+        drop(event); // drop the task reference outside the critical section.
+    }
 }
 
 pub fn check_events() {
+    let timers = &TIMER_WHEELS[this_cpu_id()];
     loop {
         let now = current_time();
-        let event = TIMER_LIST.lock().expire_one(now);
+        let event = timers.lock().expire_one(now);
         if let Some((_deadline, event)) = event {
             event.callback(now);
         } else {
@@ -43,6 +81,119 @@ pub fn check_events() {
     }
 }
 
-pub fn init() {
-    TIMER_LIST.init_by(SpinNoIrq::new(TimerList::new()));
+/// The tickless mode: instead of interrupting at every tick, the timer of each
+/// CPU is programmed in one-shot mode at the earliest of the next timer
+/// deadline and the next scheduler tick. The scheduler tick is stopped when
+/// the CPU is idle or has only one runnable task, as there is nothing to
+/// preempt for.
+///
+/// All functions must be called with IRQs disabled.
+#[cfg(feature = "tickless")]
+pub(crate) mod tickless {
+    use axhal::time::{current_time_nanos, NANOS_PER_MILLIS, NANOS_PER_SEC};
+    use core::sync::atomic::{AtomicBool, Ordering};
+
+    use super::TIMER_WHEELS;
+    use crate::run_queue::current_run_queue;
+
+    /// Interval of the scheduler tick.
+    const TICK_NANOS: u64 = NANOS_PER_SEC / axconfig::TICKS_PER_SEC as u64;
+
+    /// Longest time a CPU goes without the timer interrupt when its tick is
+    /// stopped. Other CPUs avoid adding tasks to its run queue, as they cannot
+    /// notify it (there are no IPIs yet), but may still race with the tick
+    /// being stopped, so it must check again within this time.
+    const MAX_TICKLESS_NANOS: u64 = if axconfig::SMP > 1 {
+        100 * NANOS_PER_MILLIS
+    } else {
+        u64::MAX
+    };
+
+    /// The deadline programmed in the timer of the current CPU, `u64::MAX` if
+    /// there is none (e.g., it has fired).
+    #[percpu::def_percpu]
+    static PROGRAMMED_DEADLINE: u64 = u64::MAX;
+
+    /// When the next scheduler tick of the current CPU is due, `u64::MAX` if
+    /// the tick is stopped.
+    #[percpu::def_percpu]
+    static NEXT_TICK: u64 = 0;
+
+    /// Whether the scheduler tick of each CPU is stopped, indexed by the CPU
+    /// ID, for other CPUs to check.
+    #[allow(clippy::declare_interior_mutable_const)]
+    const TICK_RUNNING: AtomicBool = AtomicBool::new(false);
+    static TICK_STOPPED: [AtomicBool; axconfig::SMP] = [TICK_RUNNING; axconfig::SMP];
+
+    /// Whether the scheduler tick of the given CPU is stopped, so that it may
+    /// not look at its run queue for up to [`MAX_TICKLESS_NANOS`].
+    pub fn is_tick_stopped(cpu_id: usize) -> bool {
+        TICK_STOPPED[cpu_id].load(Ordering::Relaxed)
+    }
+
+    /// Sets when the next scheduler tick of the current CPU is due.
+    ///
+    /// # Safety
+    ///
+    /// IRQs must be disabled.
+    unsafe fn set_next_tick(next_tick: u64) {
+        NEXT_TICK.write_current_raw(next_tick);
+        TICK_STOPPED[axhal::cpu::this_cpu_id()].store(next_tick == u64::MAX, Ordering::Relaxed);
+    }
+
+    /// Handles the timer interrupt: expires the timers, ticks the scheduler if
+    /// the tick is due, and programs the timer for the next event.
+    pub fn on_timer_irq() {
+        // Safety: IRQs are disabled in the IRQ handler.
+        unsafe { PROGRAMMED_DEADLINE.write_current_raw(u64::MAX) };
+        super::check_events();
+
+        let now = current_time_nanos();
+        if now >= unsafe { NEXT_TICK.read_current_raw() } {
+            let rq = current_run_queue();
+            rq.scheduler_timer_tick();
+            let next_tick = if rq.needs_tick() {
+                now + TICK_NANOS
+            } else {
+                u64::MAX
+            };
+            unsafe { set_next_tick(next_tick) };
+        }
+        program_timer(true);
+    }
+
+    /// Restarts the scheduler tick if it's stopped, called when there may be
+    /// more than one runnable task on the current CPU.
+    pub fn start_tick() {
+        // Safety: IRQs are disabled by the caller.
+        unsafe {
+            if NEXT_TICK.read_current_raw() == u64::MAX {
+                set_next_tick(current_time_nanos() + TICK_NANOS);
+                program_timer(false);
+            }
+        }
+    }
+
+    /// Programs the timer at the earliest deadline of the timers and the tick.
+    ///
+    /// Unless `force`, it's only re-programmed if the deadline is earlier than
+    /// the programmed one. A later deadline just causes a spurious interrupt,
+    /// which is cheaper than re-programming whenever a timer is canceled.
+    pub fn program_timer(force: bool) {
+        let now = current_time_nanos();
+        let next_timer = TIMER_WHEELS[axhal::cpu::this_cpu_id()]
+            .lock()
+            .next_deadline()
+            .map_or(u64::MAX, |d| d.as_nanos() as u64);
+        // Safety: IRQs are disabled by the caller.
+        unsafe {
+            let deadline = next_timer
+                .min(NEXT_TICK.read_current_raw())
+                .min(now.saturating_add(MAX_TICKLESS_NANOS));
+            if force || deadline < PROGRAMMED_DEADLINE.read_current_raw() {
+                PROGRAMMED_DEADLINE.write_current_raw(deadline);
+                axhal::time::set_oneshot_timer(deadline);
+            }
+        }
+    }
 }
@@ -1,8 +1,9 @@
 use alloc::collections::VecDeque;
 use alloc::sync::Arc;
-use spinlock::SpinRaw;
+use spinlock::SpinNoIrq;
 
-use crate::{AxRunQueue, AxTaskRef, CurrentTask, RUN_QUEUE};
+use crate::run_queue::{current_run_queue, select_run_queue};
+use crate::{AxTaskRef, CurrentTask};
 
 /// A queue to store sleeping tasks.
 ///
@@ -27,21 +28,21 @@ use crate::{AxRunQueue, AxTaskRef, CurrentTask, RUN_QUEUE};
 /// assert_eq!(VALUE.load(Ordering::Relaxed), 1);
 /// ```
 pub struct WaitQueue {
-    queue: SpinRaw<VecDeque<AxTaskRef>>, // we already disabled IRQs when lock the `RUN_QUEUE`
+    queue: SpinNoIrq<VecDeque<AxTaskRef>>,
 }
 
 impl WaitQueue {
     /// Creates an empty wait queue.
     pub const fn new() -> Self {
         Self {
-            queue: SpinRaw::new(VecDeque::new()),
+            queue: SpinNoIrq::new(VecDeque::new()),
         }
     }
 
     /// Creates an empty wait queue with space for at least `capacity` elements.
     pub fn with_capacity(capacity: usize) -> Self {
         Self {
-            queue: SpinRaw::new(VecDeque::with_capacity(capacity)),
+            queue: SpinNoIrq::new(VecDeque::with_capacity(capacity)),
         }
     }
 
@@ -50,8 +51,6 @@ impl WaitQueue {
         // the event from another queue.
         if curr.in_wait_queue() {
             // wake up by timer (timeout).
-            // `RUN_QUEUE` is not locked here, so disable IRQs.
-            let _guard = kernel_guard::IrqSave::new();
             self.queue.lock().retain(|t| !curr.ptr_eq(t));
             curr.set_in_wait_queue(false);
         }
@@ -65,10 +64,7 @@ impl WaitQueue {
     /// Blocks the current task and put it into the wait queue, until other task
     /// notifies it.
     pub fn wait(&self) {
-        RUN_QUEUE.lock().block_current(|task| {
-            task.set_in_wait_queue(true);
-            self.queue.lock().push_back(task)
-        });
+        current_run_queue().blocked_resched(self.queue.lock());
         self.cancel_events(crate::current());
     }
 
@@ -82,14 +78,14 @@ impl WaitQueue {
         F: Fn() -> bool,
     {
         loop {
-            let mut rq = RUN_QUEUE.lock();
+            let rq = current_run_queue();
+            // Check the condition with the wait queue locked, so that a
+            // notification between the check and blocking is not lost.
+            let wq = self.queue.lock();
             if condition() {
                 break;
             }
-            rq.block_current(|task| {
-                task.set_in_wait_queue(true);
-                self.queue.lock().push_back(task);
-            });
+            rq.blocked_resched(wq);
         }
         self.cancel_events(crate::current());
     }
@@ -105,12 +101,8 @@ impl WaitQueue {
             curr.id_name(),
             deadline
         );
-        crate::timers::set_alarm_wakeup(deadline, curr.clone());
 
-        RUN_QUEUE.lock().block_current(|task| {
-            task.set_in_wait_queue(true);
-            self.queue.lock().push_back(task)
-        });
+        current_run_queue().blocked_timeout_resched(self.queue.lock(), deadline);
         let timeout = curr.in_wait_queue(); // still in the wait queue, must have timed out
         self.cancel_events(curr);
         timeout
@@ -133,19 +125,16 @@ impl WaitQueue {
             curr.id_name(),
             deadline
         );
-        crate::timers::set_alarm_wakeup(deadline, curr.clone());
 
         let mut timeout = true;
         while axhal::time::current_time() < deadline {
-            let mut rq = RUN_QUEUE.lock();
+            let rq = current_run_queue();
+            let wq = self.queue.lock();
             if condition() {
                 timeout = false;
                 break;
             }
-            rq.block_current(|task| {
-                task.set_in_wait_queue(true);
-                self.queue.lock().push_back(task);
-            });
+            rq.blocked_timeout_resched(wq, deadline);
         }
         self.cancel_events(curr);
         timeout
@@ -156,9 +145,39 @@ impl WaitQueue {
     /// If `resched` is true, the current task will be preempted when the
     /// preemption is enabled.
     pub fn notify_one(&self, resched: bool) -> bool {
-        let mut rq = RUN_QUEUE.lock();
-        if !self.queue.lock().is_empty() {
-            self.notify_one_locked(resched, &mut rq)
+        // we must unlock `self.queue` before unblocking the task.
+        let task = self.queue.lock().pop_front();
+        if let Some(task) = task {
+            unblock_one_task(task, resched);
+            true
+        } else {
+            false
+        }
+    }
+
+    /// Wakes up the first task in the wait queue, if any, after calling `f`
+    /// with it and the number of tasks left in the queue.
+    ///
+    /// `f` is called with the wait queue locked, so it's atomic with respect
+    /// to the `condition` checks of [`wait_until`](Self::wait_until). It's
+    /// also called (with [`None`]) if the queue is empty. It can be used to
+    /// hand a resource over to the woken task.
+    ///
+    /// If `resched` is true, the current task will be preempted when the
+    /// preemption is enabled.
+    pub fn notify_one_with<F>(&self, resched: bool, f: F) -> bool
+    where
+        F: FnOnce(Option<&AxTaskRef>, usize),
+    {
+        let task = {
+            let mut wq = self.queue.lock();
+            let task = wq.pop_front();
+            f(task.as_ref(), wq.len());
+            task
+        };
+        if let Some(task) = task {
+            unblock_one_task(task, resched);
+            true
         } else {
             false
         }
@@ -170,14 +189,12 @@ impl WaitQueue {
     /// preemption is enabled.
     pub fn notify_all(&self, resched: bool) {
         loop {
-            let mut rq = RUN_QUEUE.lock();
-            if let Some(task) = self.queue.lock().pop_front() {
-                task.set_in_wait_queue(false);
-                rq.unblock_task(task, resched);
+            let task = self.queue.lock().pop_front();
+            if let Some(task) = task {
+                unblock_one_task(task, resched);
             } else {
                 break;
             }
-            drop(rq); // we must unlock `RUN_QUEUE` after unlocking `self.queue`.
         }
     }
 
@@ -186,31 +203,19 @@ impl WaitQueue {
     /// If `resched` is true, the current task will be preempted when the
     /// preemption is enabled.
     pub fn notify_task(&mut self, resched: bool, task: &AxTaskRef) -> bool {
-        let mut rq = RUN_QUEUE.lock();
         let mut wq = self.queue.lock();
         if let Some(index) = wq.iter().position(|t| Arc::ptr_eq(t, task)) {
-            task.set_in_wait_queue(false);
-            rq.unblock_task(wq.remove(index).unwrap(), resched);
-            true
-        } else {
-            false
-        }
-    }
-
-    pub(crate) fn notify_one_locked(&self, resched: bool, rq: &mut AxRunQueue) -> bool {
-        if let Some(task) = self.queue.lock().pop_front() {
-            task.set_in_wait_queue(false);
-            rq.unblock_task(task, resched);
+            let task = wq.remove(index).unwrap();
+            drop(wq);
+            unblock_one_task(task, resched);
             true
         } else {
             false
         }
     }
+}
 
-    pub(crate) fn notify_all_locked(&self, resched: bool, rq: &mut AxRunQueue) {
-        while let Some(task) = self.queue.lock().pop_front() {
-            task.set_in_wait_queue(false);
-            rq.unblock_task(task, resched);
-        }
-    }
+fn unblock_one_task(task: AxTaskRef, resched: bool) {
+    task.set_in_wait_queue(false);
+    select_run_queue(&task).unblock_task(task, resched);
 }
@@ -0,0 +1,414 @@
+//! Static tracepoints with per-CPU latency histograms and event counters for
+//! [ArceOS](https://github.com/rcore-os/arceos).
+//!
+//! A tracepoint is defined in place by one of the macros:
+//!
+//! - [`trace_scope!`]: Measures the time until the end of the enclosing block.
+//! - [`trace_since!`]: Measures the time since a [`Stamp`] was set.
+//! - [`trace_latency!`]: Records a latency measured by the caller.
+//! - [`trace_event!`]: Counts the times it is reached.
+//!
+//! Latencies are counted in log2 buckets of nanoseconds, one histogram per
+//! CPU, so that recording does not contend with other CPUs. Tracepoints are
+//! registered when they are first reached, and can be listed by [`report`]
+//! or printed by [`dump`].
+//!
+//! If it is used in `no_std` environment, the users need to implement the
+//! [`TraceIf`] to provide the clock and the CPU ID.
+//!
+//! # Cargo features:
+//!
+//! - `enable`: Enable the tracepoints. If it is disabled (by default), the
+//!   macros expand to nothing, and [`Stamp`] takes no space.
+
+#![no_std]
+
+use core::fmt::{self, Write};
+use core::ptr;
+use core::sync::atomic::{AtomicBool, AtomicPtr, AtomicU64, Ordering};
+
+#[cfg(feature = "enable")]
+use crate_interface::call_interface;
+
+/// Whether the tracepoints are enabled (by the `enable` feature).
+pub const ENABLED: bool = cfg!(feature = "enable");
+
+/// Number of histogram buckets, the `i`-th bucket counts the latencies in
+/// `[2^i, 2^(i+1))` nanoseconds (the 0-th one also counts 0).
+const NUM_BUCKETS: usize = 64;
+
+/// Extern interfaces that must be implemented in other crates.
+#[crate_interface::def_interface]
+pub trait TraceIf {
+    /// Gets current clock time in nanoseconds.
+    fn current_time_nanos() -> u64;
+
+    /// Gets current CPU ID.
+    fn current_cpu_id() -> usize;
+}
+
+#[cfg(feature = "enable")]
+fn now_nanos() -> u64 {
+    call_interface!(TraceIf::current_time_nanos)
+}
+
+/// What a tracepoint records.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum TraceKind {
+    /// Latencies in nanoseconds.
+    Latency,
+    /// Only the number of events.
+    Event,
+}
+
+struct CpuStats {
+    count: AtomicU64,
+    sum_ns: AtomicU64,
+    max_ns: AtomicU64,
+    buckets: [AtomicU64; NUM_BUCKETS],
+}
+
+impl CpuStats {
+    #[allow(clippy::declare_interior_mutable_const)]
+    const EMPTY: Self = {
+        const ZERO: AtomicU64 = AtomicU64::new(0);
+        Self {
+            count: ZERO,
+            sum_ns: ZERO,
+            max_ns: ZERO,
+            buckets: [ZERO; NUM_BUCKETS],
+        }
+    };
+}
+
+/// A static tracepoint, defined by the macros such as [`trace_scope!`].
+pub struct Tracepoint {
+    name: &'static str,
+    kind: TraceKind,
+    registered: AtomicBool,
+    /// Next registered tracepoint.
+    next: AtomicPtr<Tracepoint>,
+    cpus: [CpuStats; axconfig::SMP],
+}
+
+/// The list of the registered tracepoints, newest first.
+static TRACEPOINTS: AtomicPtr<Tracepoint> = AtomicPtr::new(ptr::null_mut());
+
+impl Tracepoint {
+    /// Creates a tracepoint, which should be stored in a `static`.
+    pub const fn new(name: &'static str, kind: TraceKind) -> Self {
+        Self {
+            name,
+            kind,
+            registered: AtomicBool::new(false),
+            next: AtomicPtr::new(ptr::null_mut()),
+            cpus: [CpuStats::EMPTY; axconfig::SMP],
+        }
+    }
+
+    /// Returns the name of the tracepoint.
+    pub fn name(&self) -> &'static str {
+        self.name
+    }
+
+    /// Returns what the tracepoint records.
+    pub fn kind(&self) -> TraceKind {
+        self.kind
+    }
+
+    fn register(&'static self) {
+        if self.registered.swap(true, Ordering::Relaxed) {
+            return;
+        }
+        let this = self as *const _ as *mut Tracepoint;
+        let mut head = TRACEPOINTS.load(Ordering::Relaxed);
+        loop {
+            self.next.store(head, Ordering::Relaxed);
+            match TRACEPOINTS.compare_exchange_weak(
+                head,
+                this,
+                Ordering::Release,
+                Ordering::Relaxed,
+            ) {
+                Ok(_) => break,
+                Err(h) => head = h,
+            }
+        }
+    }
+
+    fn local_stats(&'static self) -> Option<&'static CpuStats> {
+        self.register();
+        #[cfg(feature = "enable")]
+        let cpu_id = call_interface!(TraceIf::current_cpu_id);
+        #[cfg(not(feature = "enable"))]
+        let cpu_id = 0;
+        self.cpus.get(cpu_id)
+    }
+
+    /// Counts an event.
+    pub fn hit(&'static self) {
+        if let Some(stats) = self.local_stats() {
+            stats.count.fetch_add(1, Ordering::Relaxed);
+        }
+    }
+
+    /// Records a latency in nanoseconds.
+    pub fn record(&'static self, ns: u64) {
+        if let Some(stats) = self.local_stats() {
+            let bucket = (u64::BITS - 1).saturating_sub(ns.leading_zeros()) as usize;
+            stats.count.fetch_add(1, Ordering::Relaxed);
+            stats.sum_ns.fetch_add(ns, Ordering::Relaxed);
+            stats.max_ns.fetch_max(ns, Ordering::Relaxed);
+            stats.buckets[bucket].fetch_add(1, Ordering::Relaxed);
+        }
+    }
+
+    /// Returns the number of records on the CPU `cpu_id`.
+    pub fn count_on(&self, cpu_id: usize) -> u64 {
+        self.cpus
+            .get(cpu_id)
+            .map_or(0, |s| s.count.load(Ordering::Relaxed))
+    }
+
+    /// Returns the number of records on all CPUs.
+    pub fn count(&self) -> u64 {
+        (0..axconfig::SMP).map(|cpu_id| self.count_on(cpu_id)).sum()
+    }
+
+    /// Writes the statistics of the tracepoint, merging all CPUs.
+    fn report(&self, w: &mut impl Write) -> fmt::Result {
+        let count = self.count();
+        write!(w, "{}: count={}", self.name, count)?;
+        if axconfig::SMP > 1 {
+            w.write_str(" (")?;
+            for cpu_id in 0..axconfig::SMP {
+                let sep = if cpu_id == 0 { "" } else { " " };
+                write!(w, "{}cpu{}={}", sep, cpu_id, self.count_on(cpu_id))?;
+            }
+            w.write_str(")")?;
+        }
+        if self.kind == TraceKind::Event || count == 0 {
+            return w.write_str("\n");
+        }
+
+        let sum_ns: u64 = self
+            .cpus
+            .iter()
+            .map(|s| s.sum_ns.load(Ordering::Relaxed))
+            .sum();
+        let max_ns = self
+            .cpus
+            .iter()
+            .map(|s| s.max_ns.load(Ordering::Relaxed))
+            .max();
+        writeln!(w, " avg={}ns max={}ns", sum_ns / count, max_ns.unwrap_or(0))?;
+        for i in 0..NUM_BUCKETS {
+            let n: u64 = self
+                .cpus
+                .iter()
+                .map(|s| s.buckets[i].load(Ordering::Relaxed))
+                .sum();
+            if n > 0 {
+                let low = if i == 0 { 0 } else { 1u64 << i };
+                writeln!(w, "  [{:>12}, {:>12}) ns: {}", low, 1u128 << (i + 1), n)?;
+            }
+        }
+        Ok(())
+    }
+}
+
+/// A timestamp to measure latencies across functions or tasks with
+/// [`trace_since!`], e.g., from a task is woken up until it runs.
+///
+/// It takes no space if the tracepoints are disabled.
+#[derive(Default)]
+pub struct Stamp {
+    #[cfg(feature = "enable")]
+    nanos: AtomicU64,
+}
+
+impl Stamp {
+    /// Creates an unset timestamp.
+    #[allow(clippy::new_without_default)]
+    pub const fn new() -> Self {
+        Self {
+            #[cfg(feature = "enable")]
+            nanos: AtomicU64::new(0),
+        }
+    }
+
+    /// Sets the timestamp to now.
+    #[inline]
+    pub fn set_now(&self) {
+        #[cfg(feature = "enable")]
+        self.nanos.store(now_nanos(), Ordering::Relaxed);
+    }
+
+    /// Returns the nanoseconds elapsed since the timestamp was set, and unsets
+    /// it. Returns [`None`] if it was not set.
+    #[inline]
+    pub fn take_elapsed(&self) -> Option<u64> {
+        #[cfg(feature = "enable")]
+        let elapsed = match self.nanos.swap(0, Ordering::Relaxed) {
+            0 => None,
+            start => Some(now_nanos().saturating_sub(start)),
+        };
+        #[cfg(not(feature = "enable"))]
+        let elapsed = None;
+        elapsed
+    }
+}
+
+/// Records the time from its creation to its drop, see [`trace_scope!`].
+#[cfg(feature = "enable")]
+pub struct TraceScope {
+    tp: &'static Tracepoint,
+    start: u64,
+}
+
+#[cfg(feature = "enable")]
+impl TraceScope {
+    #[doc(hidden)]
+    pub fn new(tp: &'static Tracepoint) -> Self {
+        Self {
+            tp,
+            start: now_nanos(),
+        }
+    }
+}
+
+#[cfg(feature = "enable")]
+impl Drop for TraceScope {
+    fn drop(&mut self) {
+        self.tp.record(now_nanos().saturating_sub(self.start));
+    }
+}
+
+/// Calls `f` on each tracepoint that has been reached, newest first.
+pub fn for_each_tracepoint(mut f: impl FnMut(&'static Tracepoint)) {
+    let mut ptr = TRACEPOINTS.load(Ordering::Acquire);
+    while !ptr.is_null() {
+        // SAFETY: only `&'static Tracepoint`s are linked into the list.
+        let tp = unsafe { &*ptr };
+        f(tp);
+        ptr = tp.next.load(Ordering::Relaxed);
+    }
+}
+
+/// Writes the statistics of all reached tracepoints in text.
+pub fn report(w: &mut impl Write) -> fmt::Result {
+    if !ENABLED {
+        return w.write_str("tracepoints are disabled\n");
+    }
+    let mut res = Ok(());
+    for_each_tracepoint(|tp| {
+        if res.is_ok() {
+            res = tp.report(w);
+        }
+    });
+    res
+}
+
+/// Prints the statistics of all reached tracepoints to the console, if the
+/// tracepoints are enabled.
+pub fn dump() {
+    struct Console;
+
+    impl Write for Console {
+        fn write_str(&mut self, s: &str) -> fmt::Result {
+            axlog::ax_print!("{}", s);
+            Ok(())
+        }
+    }
+
+    if ENABLED {
+        axlog::ax_println!("Tracepoints:");
+        report(&mut Console).ok();
+    }
+}
+
+/// Defines a latency tracepoint named `$name`, that measures the time from
+/// here to the end of the enclosing block.
+///
+/// # Examples
+///
+/// ```ignore
+/// fn handle_irq(irq_num: usize) {
+///     axtrace::trace_scope!("irq.dispatch");
+///     // ...
+/// }
+/// ```
+#[cfg(feature = "enable")]
+#[macro_export]
+macro_rules! trace_scope {
+    ($name:literal) => {
+        let _trace_scope = {
+            static TP: $crate::Tracepoint =
+                $crate::Tracepoint::new($name, $crate::TraceKind::Latency);
+            $crate::TraceScope::new(&TP)
+        };
+    };
+}
+
+/// Defines a latency tracepoint named `$name`, that records the time elapsed
+/// since the [`Stamp`] `$stamp` was set, and unsets it. Nothing is recorded if
+/// it was not set.
+#[cfg(feature = "enable")]
+#[macro_export]
+macro_rules! trace_since {
+    ($name:literal, $stamp:expr) => {
+        if let Some(ns) = $crate::Stamp::take_elapsed($stamp) {
+            static TP: $crate::Tracepoint =
+                $crate::Tracepoint::new($name, $crate::TraceKind::Latency);
+            TP.record(ns);
+        }
+    };
+}
+
+/// Defines a latency tracepoint named `$name`, and records `$ns` nanoseconds.
+#[cfg(feature = "enable")]
+#[macro_export]
+macro_rules! trace_latency {
+    ($name:literal, $ns:expr) => {{
+        static TP: $crate::Tracepoint = $crate::Tracepoint::new($name, $crate::TraceKind::Latency);
+        TP.record($ns);
+    }};
+}
+
+/// Defines an event tracepoint named `$name`, and counts the event.
+#[cfg(feature = "enable")]
+#[macro_export]
+macro_rules! trace_event {
+    ($name:literal) => {{
+        static TP: $crate::Tracepoint = $crate::Tracepoint::new($name, $crate::TraceKind::Event);
+        TP.hit();
+    }};
+}
+
+#[cfg(not(feature = "enable"))]
+#[macro_export]
+macro_rules! trace_scope {
+    ($name:literal) => {};
+}
+
+#[cfg(not(feature = "enable"))]
+#[macro_export]
+macro_rules! trace_since {
+    ($name:literal, $stamp:expr) => {{
+        let _ = || $stamp;
+    }};
+}
+
+#[cfg(not(feature = "enable"))]
+#[macro_export]
+macro_rules! trace_latency {
+    ($name:literal, $ns:expr) => {{
+        let _ = || $ns;
+    }};
+}
+
+#[cfg(not(feature = "enable"))]
+#[macro_export]
+macro_rules! trace_event {
+    ($name:literal) => {};
+}
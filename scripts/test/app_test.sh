@@ -111,17 +111,20 @@ if [ -z "$1" ]; then
         "apps/exception"
         "apps/task/yield"
         "apps/task/parallel"
+        "apps/task/mutex"
         "apps/task/sleep"
         "apps/task/priority"
         "apps/net/httpclient"
         "apps/c/helloworld"
         "apps/c/memtest"
+        "apps/c/membench"
         "apps/c/sqlite3"
         "apps/c/httpclient"
         "apps/c/pthread/basic"
         "apps/c/pthread/sleep"
         "apps/c/pthread/pipe"
         "apps/c/pthread/parallel"
+        "apps/c/pthread/sync"
     )
 else
     test_list="$@"
@@ -0,0 +1,11 @@
+#ifndef __MALLOC_H__
+#define __MALLOC_H__
+
+#include <stdlib.h>
+
+#ifdef AX_CONFIG_ALLOC
+void *memalign(size_t alignment, size_t size);
+size_t malloc_usable_size(void *memblock);
+#endif
+
+#endif //__MALLOC_H__
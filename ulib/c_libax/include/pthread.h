@@ -4,6 +4,7 @@
 #include <signal.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <time.h>
 
 #define PTHREAD_CANCEL_ENABLE  0
 #define PTHREAD_CANCEL_DISABLE 1
@@ -43,8 +44,48 @@ typedef struct {
 #define _c_clock  __u.__i[4]
 #define _c_shared __u.__p[0]
 
+typedef struct {
+    union {
+        int __i[sizeof(long) == 8 ? 14 : 8];
+        volatile int __vi[sizeof(long) == 8 ? 14 : 8];
+        void *__p[sizeof(long) == 8 ? 7 : 8];
+    } __u;
+} pthread_rwlock_t;
+
+typedef struct {
+    unsigned __attr[2];
+} pthread_rwlockattr_t;
+
+typedef struct {
+    union {
+        int __i[sizeof(long) == 8 ? 8 : 5];
+        volatile int __vi[sizeof(long) == 8 ? 8 : 5];
+        void *__p[sizeof(long) == 8 ? 4 : 5];
+    } __u;
+} pthread_barrier_t;
+
+typedef struct {
+    unsigned __attr;
+} pthread_barrierattr_t;
+
+typedef int pthread_once_t;
+typedef int pthread_spinlock_t;
+
 typedef void *pthread_t;
 
+#define PTHREAD_COND_INITIALIZER   {{{0}}}
+#define PTHREAD_RWLOCK_INITIALIZER {{{0}}}
+#define PTHREAD_ONCE_INIT          0
+
+#define PTHREAD_BARRIER_SERIAL_THREAD (-1)
+
+#define PTHREAD_PROCESS_PRIVATE 0
+#define PTHREAD_PROCESS_SHARED  1
+
+#define PTHREAD_RWLOCK_PREFER_READER_NP                0
+#define PTHREAD_RWLOCK_PREFER_WRITER_NP                1
+#define PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP   2
+
 #define PTHREAD_CANCELED ((void *)-1)
 #define SIGCANCEL        33
 
@@ -63,6 +104,40 @@ int pthread_mutex_init(pthread_mutex_t *__restrict, const pthread_mutexattr_t *_
 int pthread_mutex_lock(pthread_mutex_t *);
 int pthread_mutex_unlock(pthread_mutex_t *);
 
+int pthread_cond_init(pthread_cond_t *__restrict, const pthread_condattr_t *__restrict);
+int pthread_cond_destroy(pthread_cond_t *);
+int pthread_cond_wait(pthread_cond_t *__restrict, pthread_mutex_t *__restrict);
+int pthread_cond_timedwait(pthread_cond_t *__restrict, pthread_mutex_t *__restrict,
+                           const struct timespec *__restrict);
+int pthread_cond_signal(pthread_cond_t *);
+int pthread_cond_broadcast(pthread_cond_t *);
+
+int pthread_rwlockattr_init(pthread_rwlockattr_t *);
+int pthread_rwlockattr_destroy(pthread_rwlockattr_t *);
+int pthread_rwlockattr_setkind_np(pthread_rwlockattr_t *, int);
+int pthread_rwlockattr_getkind_np(const pthread_rwlockattr_t *__restrict, int *__restrict);
+
+int pthread_rwlock_init(pthread_rwlock_t *__restrict, const pthread_rwlockattr_t *__restrict);
+int pthread_rwlock_destroy(pthread_rwlock_t *);
+int pthread_rwlock_rdlock(pthread_rwlock_t *);
+int pthread_rwlock_tryrdlock(pthread_rwlock_t *);
+int pthread_rwlock_wrlock(pthread_rwlock_t *);
+int pthread_rwlock_trywrlock(pthread_rwlock_t *);
+int pthread_rwlock_unlock(pthread_rwlock_t *);
+
+int pthread_barrier_init(pthread_barrier_t *__restrict, const pthread_barrierattr_t *__restrict,
+                         unsigned);
+int pthread_barrier_destroy(pthread_barrier_t *);
+int pthread_barrier_wait(pthread_barrier_t *);
+
+int pthread_spin_init(pthread_spinlock_t *, int);
+int pthread_spin_destroy(pthread_spinlock_t *);
+int pthread_spin_lock(pthread_spinlock_t *);
+int pthread_spin_trylock(pthread_spinlock_t *);
+int pthread_spin_unlock(pthread_spinlock_t *);
+
+int pthread_once(pthread_once_t *, void (*)(void));
+
 #endif // AX_CONFIG_MULTITASK
 
 #endif // _PTHREAD_H
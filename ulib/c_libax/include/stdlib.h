@@ -11,6 +11,8 @@ void *malloc(size_t size);
 void free(void *addr);
 void *calloc(size_t nmemb, size_t size);
 void *realloc(void *memblock, size_t size);
+int posix_memalign(void **memptr, size_t alignment, size_t size);
+void *aligned_alloc(size_t alignment, size_t size);
 #endif
 
 _Noreturn void abort(void);
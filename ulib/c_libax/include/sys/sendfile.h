@@ -0,0 +1,8 @@
+#ifndef __SYS_SENDFILE_H__
+#define __SYS_SENDFILE_H__
+
+#include <sys/types.h>
+
+ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count);
+
+#endif
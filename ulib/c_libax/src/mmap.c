@@ -1,24 +1,46 @@
 #include <stddef.h>
 #include <stdio.h>
+#include <sys/mman.h>
+
+#include <libax.h>
+
+#ifdef AX_CONFIG_ALLOC
+
+void *mmap(void *addr, size_t len, int prot, int flags, int fildes, off_t off)
+{
+    return ax_mmap(addr, len, prot, flags, fildes, off);
+}
+
+int munmap(void *addr, size_t length)
+{
+    return ax_munmap(addr, length);
+}
+
+void *mremap(void *old_address, size_t old_size, size_t new_size, int flags,
+             ... /* void *new_address */)
+{
+    return ax_mremap(old_address, old_size, new_size, flags);
+}
+
+#else
 
-// TODO:
 void *mmap(void *addr, size_t len, int prot, int flags, int fildes, off_t off)
 {
     unimplemented();
-    return NULL;
+    return MAP_FAILED;
 }
 
-// TODO:
 int munmap(void *addr, size_t length)
 {
     unimplemented();
     return 0;
 }
 
-// TODO:
 void *mremap(void *old_address, size_t old_size, size_t new_size, int flags,
              ... /* void *new_address */)
 {
     unimplemented();
-    return NULL;
+    return MAP_FAILED;
 }
+
+#endif // AX_CONFIG_ALLOC
@@ -1,9 +1,17 @@
+#include <errno.h>
 #include <libax.h>
 #include <pthread.h>
 #include <unistd.h>
 
 #if defined(AX_CONFIG_MULTITASK)
 
+// The ax_* functions return -1 and set `errno` on failure, but the pthread
+// functions return the error number.
+static inline int pthread_ret(int ret)
+{
+    return ret < 0 ? errno : ret;
+}
+
 _Noreturn void pthread_exit(void *result)
 {
     ax_pthread_exit(result);
@@ -55,4 +63,143 @@ int pthread_mutex_unlock(pthread_mutex_t *m)
     return 0;
 }
 
+int pthread_cond_init(pthread_cond_t *restrict c, const pthread_condattr_t *restrict a)
+{
+    return pthread_ret(ax_pthread_cond_init(c, a));
+}
+
+int pthread_cond_destroy(pthread_cond_t *c)
+{
+    return pthread_ret(ax_pthread_cond_destroy(c));
+}
+
+int pthread_cond_wait(pthread_cond_t *restrict c, pthread_mutex_t *restrict m)
+{
+    return pthread_ret(ax_pthread_cond_wait(c, m));
+}
+
+int pthread_cond_timedwait(pthread_cond_t *restrict c, pthread_mutex_t *restrict m,
+                           const struct timespec *restrict ts)
+{
+    return pthread_ret(ax_pthread_cond_timedwait(c, m, ts));
+}
+
+int pthread_cond_signal(pthread_cond_t *c)
+{
+    return pthread_ret(ax_pthread_cond_signal(c));
+}
+
+int pthread_cond_broadcast(pthread_cond_t *c)
+{
+    return pthread_ret(ax_pthread_cond_broadcast(c));
+}
+
+int pthread_rwlockattr_init(pthread_rwlockattr_t *a)
+{
+    *a = (pthread_rwlockattr_t){0};
+    return 0;
+}
+
+int pthread_rwlockattr_destroy(pthread_rwlockattr_t *a)
+{
+    return 0;
+}
+
+int pthread_rwlockattr_setkind_np(pthread_rwlockattr_t *a, int kind)
+{
+    if (kind < PTHREAD_RWLOCK_PREFER_READER_NP ||
+        kind > PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP)
+        return EINVAL;
+    a->__attr[0] = kind;
+    return 0;
+}
+
+int pthread_rwlockattr_getkind_np(const pthread_rwlockattr_t *restrict a, int *restrict kind)
+{
+    *kind = a->__attr[0];
+    return 0;
+}
+
+int pthread_rwlock_init(pthread_rwlock_t *restrict rw, const pthread_rwlockattr_t *restrict a)
+{
+    return pthread_ret(ax_pthread_rwlock_init(rw, a));
+}
+
+int pthread_rwlock_destroy(pthread_rwlock_t *rw)
+{
+    return pthread_ret(ax_pthread_rwlock_destroy(rw));
+}
+
+int pthread_rwlock_rdlock(pthread_rwlock_t *rw)
+{
+    return pthread_ret(ax_pthread_rwlock_rdlock(rw));
+}
+
+int pthread_rwlock_tryrdlock(pthread_rwlock_t *rw)
+{
+    return pthread_ret(ax_pthread_rwlock_tryrdlock(rw));
+}
+
+int pthread_rwlock_wrlock(pthread_rwlock_t *rw)
+{
+    return pthread_ret(ax_pthread_rwlock_wrlock(rw));
+}
+
+int pthread_rwlock_trywrlock(pthread_rwlock_t *rw)
+{
+    return pthread_ret(ax_pthread_rwlock_trywrlock(rw));
+}
+
+int pthread_rwlock_unlock(pthread_rwlock_t *rw)
+{
+    return pthread_ret(ax_pthread_rwlock_unlock(rw));
+}
+
+int pthread_barrier_init(pthread_barrier_t *restrict b, const pthread_barrierattr_t *restrict a,
+                         unsigned count)
+{
+    return pthread_ret(ax_pthread_barrier_init(b, a, count));
+}
+
+int pthread_barrier_destroy(pthread_barrier_t *b)
+{
+    return pthread_ret(ax_pthread_barrier_destroy(b));
+}
+
+int pthread_barrier_wait(pthread_barrier_t *b)
+{
+    int ret = pthread_ret(ax_pthread_barrier_wait(b));
+    return ret == 1 ? PTHREAD_BARRIER_SERIAL_THREAD : ret;
+}
+
+int pthread_spin_init(pthread_spinlock_t *s, int shared)
+{
+    return pthread_ret(ax_pthread_spin_init(s, shared));
+}
+
+int pthread_spin_destroy(pthread_spinlock_t *s)
+{
+    return 0;
+}
+
+int pthread_spin_lock(pthread_spinlock_t *s)
+{
+    return pthread_ret(ax_pthread_spin_lock(s));
+}
+
+int pthread_spin_trylock(pthread_spinlock_t *s)
+{
+    return pthread_ret(ax_pthread_spin_trylock(s));
+}
+
+int pthread_spin_unlock(pthread_spinlock_t *s)
+{
+    return pthread_ret(ax_pthread_spin_unlock(s));
+}
+
+int pthread_once(pthread_once_t *control, void (*init)(void))
+{
+    return pthread_ret(ax_pthread_once(control, init));
+}
+
 #endif // AX_CONFIG_MULTITASK
@@ -1,5 +1,6 @@
 #include <libax.h>
 #include <stdio.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 
@@ -70,8 +71,7 @@ int getsockopt(int fd, int level, int optname, void *restrict optval, socklen_t
 
 int setsockopt(int fd, int level, int optname, const void *optval, socklen_t optlen)
 {
-    unimplemented();
-    return 0;
+    return ax_setsockopt(fd, level, optname, optval, optlen);
 }
 
 int getsockname(int sockfd, struct sockaddr *restrict addr, socklen_t *restrict addrlen)
@@ -84,3 +84,10 @@ int getpeername(int sockfd, struct sockaddr *restrict addr, socklen_t *restrict
     return ax_getpeername(sockfd, addr, addrlen);
 }
 #endif
+
+#if defined(AX_CONFIG_NET) && defined(AX_CONFIG_FS)
+ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count)
+{
+    return ax_sendfile(out_fd, in_fd, offset, count);
+}
+#endif
@@ -30,25 +30,47 @@ void *malloc(size_t size)
 
 void *calloc(size_t m, size_t n)
 {
+    if (n && m > (size_t)-1 / n) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
     void *mem = ax_malloc(m * n);
+    if (!mem)
+        return NULL;
 
     return memset(mem, 0, n * m);
 }
 
 void *realloc(void *memblock, size_t size)
 {
-    if (!memblock)
-        return malloc(size);
+    return ax_realloc(memblock, size);
+}
 
-    size_t o_size = *(size_t *)(memblock - 8);
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    return ax_posix_memalign(memptr, alignment, size);
+}
 
-    void *mem = ax_malloc(size);
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    void *mem;
+    int ret = ax_posix_memalign(&mem, alignment, size);
+    if (ret) {
+        errno = ret;
+        return NULL;
+    }
+    return mem;
+}
 
-    for (int i = 0; i < (o_size < size ? o_size : size); i++)
-        ((char *)mem)[i] = ((char *)memblock)[i];
+void *memalign(size_t alignment, size_t size)
+{
+    return aligned_alloc(alignment, size);
+}
 
-    ax_free(memblock);
-    return mem;
+size_t malloc_usable_size(void *memblock)
+{
+    return ax_malloc_usable_size(memblock);
 }
 
 void free(void *addr)
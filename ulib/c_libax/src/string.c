@@ -1,14 +1,88 @@
 #include <ctype.h>
+#include <limits.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <string.h>
 
 #include <libax.h>
 
+/* Memory and string routines work a word at a time, or a vector at a time if
+ * SIMD is available: AVX2 or SSE2 on x86_64, NEON on aarch64. SIMD registers
+ * are only usable with the "fp_simd" feature, which decides whether the
+ * compiler defines the macros below. */
+
+typedef size_t __attribute__((__may_alias__)) word_t;
+
+#define WS          sizeof(word_t)
+#define ONES        ((size_t)-1 / UCHAR_MAX)
+#define HIGHS       (ONES * (UCHAR_MAX / 2 + 1))
+#define HASZERO(x)  (((x) - ONES) & ~(x) & HIGHS)
+#define ALIGNED(p)  (((uintptr_t)(p) & (WS - 1)) == 0)
+
+#if defined(__AVX2__)
+#define VEC_SIZE 32
+#elif defined(__SSE2__) || defined(__ARM_NEON)
+#define VEC_SIZE 16
+#endif
+
+#ifdef VEC_SIZE
+typedef unsigned char __attribute__((__vector_size__(VEC_SIZE), __may_alias__)) vec_t;
+typedef uint64_t __attribute__((__vector_size__(VEC_SIZE))) vec64_t;
+typedef char __attribute__((__vector_size__(VEC_SIZE))) vec_mask_t;
+
+/* Unaligned vector loads and stores. */
+static inline vec_t vec_load(const void *p)
+{
+    vec_t v;
+    __builtin_memcpy(&v, p, VEC_SIZE);
+    return v;
+}
+
+static inline void vec_store(void *p, vec_t v)
+{
+    __builtin_memcpy(p, &v, VEC_SIZE);
+}
+
+static inline vec_t vec_splat(unsigned char c)
+{
+    return (vec_t){0} + c;
+}
+
+/* Whether any byte of `v` equals to `c`. */
+static inline int vec_has_byte(vec_t v, unsigned char c)
+{
+#if defined(__AVX2__)
+    return __builtin_ia32_pmovmskb256((vec_mask_t)(v == vec_splat(c))) != 0;
+#elif defined(__SSE2__)
+    return __builtin_ia32_pmovmskb128((vec_mask_t)(v == vec_splat(c))) != 0;
+#else
+    vec64_t m = (vec64_t)(v == vec_splat(c));
+    return (m[0] | m[1]) != 0;
+#endif
+}
+#endif
+
 size_t strlen(const char *s)
 {
     const char *a = s;
-    for (; *s; s++)
+    const word_t *w;
+    for (; !ALIGNED(s); s++)
+        if (!*s)
+            return s - a;
+    /* Aligned loads never cross a page boundary, so it's safe to read past
+     * the terminator. */
+    w = (const void *)s;
+#ifdef VEC_SIZE
+    for (; (uintptr_t)w % VEC_SIZE && !HASZERO(*w); w++)
+        ;
+    if ((uintptr_t)w % VEC_SIZE == 0) {
+        for (; !vec_has_byte(*(const vec_t *)w, 0); w += VEC_SIZE / WS)
+            ;
+    }
+#endif
+    for (; !HASZERO(*w); w++)
+        ;
+    for (s = (const void *)w; *s; s++)
         ;
     return s - a;
 }
@@ -38,6 +112,24 @@ void *memchr(const void *src, int c, size_t n)
 {
     const unsigned char *s = src;
     c = (unsigned char)c;
+    for (; !ALIGNED(s) && n && *s != c; s++, n--)
+        ;
+    if (n && *s != c) {
+        const word_t *w = (const void *)s;
+        size_t k = ONES * c;
+#ifdef VEC_SIZE
+        for (; (uintptr_t)w % VEC_SIZE && n >= WS && !HASZERO(*w ^ k); w++, n -= WS)
+            ;
+        if ((uintptr_t)w % VEC_SIZE == 0) {
+            for (; n >= VEC_SIZE && !vec_has_byte(*(const vec_t *)w, c);
+                 w += VEC_SIZE / WS, n -= VEC_SIZE)
+                ;
+        }
+#endif
+        for (; n >= WS && !HASZERO(*w ^ k); w++, n -= WS)
+            ;
+        s = (const void *)w;
+    }
     for (; n && *s != c; s++, n--)
         ;
     return n ? (void *)s : 0;
@@ -68,19 +160,38 @@ void *memset(void *dest, int c, size_t n)
     s[n - 4] = c;
     if (n <= 8)
         return dest;
+    s[4] = c;
+    s[5] = c;
+    s[6] = c;
+    s[n - 5] = c;
+    s[n - 6] = c;
+    s[n - 7] = c;
+    if (n <= 14)
+        return dest;
 
-    /* Advance pointer to align it at a 4-byte boundary,
-     * and truncate n to a multiple of 4. The previous code
-     * already took care of any head/tail that get cut off
-     * by the alignment. */
+    /* Advance pointer to align it at a word boundary,
+     * and truncate n to a multiple of the word size. The
+     * previous code already took care of any head/tail that
+     * get cut off by the alignment. */
 
-    k = -(uintptr_t)s & 3;
+    k = -(uintptr_t)s & (WS - 1);
     s += k;
     n -= k;
-    n &= -4;
+    n &= -WS;
+
+#ifdef VEC_SIZE
+    vec_t v = vec_splat(c);
+    for (; n >= 4 * VEC_SIZE; n -= 4 * VEC_SIZE, s += 4 * VEC_SIZE) {
+        vec_store(s, v);
+        vec_store(s + VEC_SIZE, v);
+        vec_store(s + 2 * VEC_SIZE, v);
+        vec_store(s + 3 * VEC_SIZE, v);
+    }
+    for (; n >= VEC_SIZE; n -= VEC_SIZE, s += VEC_SIZE) vec_store(s, v);
+#endif
 
-    /* Pure C fallback with no aliasing violations. */
-    for (; n; n--, s++) *s = c;
+    word_t w = ONES * (unsigned char)c;
+    for (; n; n -= WS, s += WS) *(word_t *)s = w;
 
     return dest;
 }
@@ -224,29 +335,75 @@ char *strerror(int e)
     return ax_errno_string(e);
 }
 
-void *memcpy(void *restrict dest, const void *restrict src, size_t n)
+/* Copies from low to high addresses, it's also correct for overlapping
+ * buffers if `d` is below `s`: every chunk is loaded before it's stored. */
+static void copy_forward(unsigned char *d, const unsigned char *s, size_t n)
 {
-    unsigned char *d = dest;
-    const unsigned char *s = src;
+#ifdef VEC_SIZE
+    if (n >= VEC_SIZE) {
+        /* The last vector may overlap the previous one. */
+        vec_t tail = vec_load(s + n - VEC_SIZE);
+        for (; n > 4 * VEC_SIZE; n -= 4 * VEC_SIZE, s += 4 * VEC_SIZE, d += 4 * VEC_SIZE) {
+            vec_t v0 = vec_load(s);
+            vec_t v1 = vec_load(s + VEC_SIZE);
+            vec_t v2 = vec_load(s + 2 * VEC_SIZE);
+            vec_t v3 = vec_load(s + 3 * VEC_SIZE);
+            vec_store(d, v0);
+            vec_store(d + VEC_SIZE, v1);
+            vec_store(d + 2 * VEC_SIZE, v2);
+            vec_store(d + 3 * VEC_SIZE, v3);
+        }
+        for (; n > VEC_SIZE; n -= VEC_SIZE, s += VEC_SIZE, d += VEC_SIZE)
+            vec_store(d, vec_load(s));
+        vec_store(d + n - VEC_SIZE, tail);
+        return;
+    }
+#endif
+    if ((((uintptr_t)d ^ (uintptr_t)s) & (WS - 1)) == 0) {
+        for (; !ALIGNED(s) && n; n--) *d++ = *s++;
+        for (; n >= WS; n -= WS, s += WS, d += WS) *(word_t *)d = *(const word_t *)s;
+    }
     for (; n; n--) *d++ = *s++;
+}
+
+/* Copies from high to low addresses, for overlapping buffers with `d` above
+ * `s`. */
+static void copy_backward(unsigned char *d, const unsigned char *s, size_t n)
+{
+#ifdef VEC_SIZE
+    if (n >= VEC_SIZE) {
+        /* The first vector may overlap the next one. */
+        vec_t head = vec_load(s);
+        for (; n > VEC_SIZE; n -= VEC_SIZE)
+            vec_store(d + n - VEC_SIZE, vec_load(s + n - VEC_SIZE));
+        vec_store(d, head);
+        return;
+    }
+#endif
+    if ((((uintptr_t)d ^ (uintptr_t)s) & (WS - 1)) == 0) {
+        for (; !ALIGNED(s + n) && n; n--) d[n - 1] = s[n - 1];
+        for (; n >= WS; n -= WS) *(word_t *)(d + n - WS) = *(const word_t *)(s + n - WS);
+    }
+    for (; n; n--) d[n - 1] = s[n - 1];
+}
+
+void *memcpy(void *restrict dest, const void *restrict src, size_t n)
+{
+    copy_forward(dest, src, n);
     return dest;
 }
 
 void *memmove(void *dest, const void *src, size_t n)
 {
-    char *d = dest;
-    const char *s = src;
+    unsigned char *d = dest;
+    const unsigned char *s = src;
 
     if (d == s)
         return d;
-    if ((uintptr_t)s - (uintptr_t)d - n <= -2 * n)
-        return memcpy(d, s, n);
-
-    if (d < s) {
-        for (; n; n--) *d++ = *s++;
-    } else {
-        while (n) n--, d[n] = s[n];
-    }
+    if (d < s)
+        copy_forward(d, s, n);
+    else
+        copy_backward(d, s, n);
 
     return dest;
 }
@@ -82,6 +82,9 @@ typedef struct {{
             "SOL_.*",
             "EPOLL_CTL_.*",
             "EPOLL.*",
+            "PROT_.*",
+            "MAP_.*",
+            "MREMAP_.*",
         ];
 
         #[derive(Debug)]
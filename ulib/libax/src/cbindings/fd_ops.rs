@@ -4,6 +4,7 @@ use alloc::sync::Arc;
 use axerrno::{LinuxError, LinuxResult};
 
 use core::ffi::{c_int, c_void};
+use core::task::Waker;
 use flatten_objects::FlattenObjects;
 use spin::RwLock;
 
@@ -16,6 +17,19 @@ pub trait FileLike: Send + Sync {
     fn into_any(self: Arc<Self>) -> Arc<dyn core::any::Any + Send + Sync>;
     fn poll(&self) -> LinuxResult<PollState>;
     fn set_nonblocking(&self, nonblocking: bool) -> LinuxResult;
+
+    /// Registers a waker that is woken up whenever the result of
+    /// [`poll`](Self::poll) may have changed, until it is unregistered.
+    ///
+    /// Returns `false` if the file can not notify its readiness changes, in
+    /// which case it must be polled.
+    fn register_poll_waker(&self, _waker: &Waker) -> bool {
+        false
+    }
+
+    /// Unregisters a waker registered by
+    /// [`register_poll_waker`](Self::register_poll_waker).
+    fn unregister_poll_waker(&self, _waker: &Waker) {}
 }
 
 lazy_static::lazy_static! {
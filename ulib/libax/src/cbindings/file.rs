@@ -72,6 +72,30 @@ impl FileLike for File {
     }
 }
 
+/// Read the file indicated by `fd` at `offset` into `buf`, without moving its
+/// cursor. Return the number of bytes read, which is less than the size of
+/// `buf` only at the end of the file.
+pub(super) fn read_file_at(fd: c_int, offset: u64, buf: &mut [u8]) -> LinuxResult<usize> {
+    let file = File::from_fd(fd)?;
+    let file = file.0.lock();
+    let mut read_len = 0;
+    while read_len < buf.len() {
+        match file.read_at(&mut buf[read_len..], offset + read_len as u64)? {
+            0 => break,
+            n => read_len += n,
+        }
+    }
+    Ok(read_len)
+}
+
+/// Run `f` on the file indicated by `fd`, with the file locked.
+pub(super) fn with_file<R, F>(fd: c_int, f: F) -> LinuxResult<R>
+where
+    F: FnOnce(&mut crate::fs::File) -> LinuxResult<R>,
+{
+    f(&mut File::from_fd(fd)?.0.lock())
+}
+
 /// Convert open flags to [`OpenOptions`].
 fn flags_to_options(flags: c_int, _mode: ctypes::mode_t) -> OpenOptions {
     let flags = flags as u32;
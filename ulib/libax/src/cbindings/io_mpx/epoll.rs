@@ -1,6 +1,15 @@
 //! `epoll` implementation.
 //!
-//! TODO: do not support `EPOLLET` flag
+//! Files that can notify their readiness changes (see
+//! [`FileLike::register_poll_waker`]) push their interest items onto the ready
+//! list of the epoll instance, so that [`ax_epoll_wait`] only checks the items
+//! that may be ready, and sleeps until there are some. Other files are polled
+//! on every wait.
+//!
+//! Level-triggered items stay on the ready list until they are found not
+//! ready. Edge-triggered (`EPOLLET`) items leave it once reported, and come
+//! back on the next notification. `EPOLLONESHOT` items are disabled once
+//! reported, until re-armed by `EPOLL_CTL_MOD`.
 
 use crate::cbindings::{
     ctypes,
@@ -9,25 +18,137 @@ use crate::cbindings::{
 use crate::debug;
 use crate::sync::Mutex;
 use axerrno::{LinuxError, LinuxResult};
-use axhal::time::current_time;
+use axhal::time::{current_time, TimeValue};
+use spinlock::SpinNoIrq;
 
 use alloc::collections::btree_map::Entry;
-use alloc::collections::BTreeMap;
-use alloc::sync::Arc;
+use alloc::collections::{BTreeMap, VecDeque};
+use alloc::sync::{Arc, Weak};
+use alloc::task::Wake;
+use alloc::vec::Vec;
+use core::sync::atomic::{AtomicBool, Ordering};
+use core::task::Waker;
 use core::{ffi::c_int, time::Duration};
 
+/// Flags that are kept when an `EPOLLONESHOT` item is disabled.
+const EPOLL_PRIVATE_BITS: u32 =
+    ctypes::EPOLLWAKEUP | ctypes::EPOLLONESHOT | ctypes::EPOLLET | ctypes::EPOLLEXCLUSIVE;
+
+/// A file descriptor registered to an epoll instance, with the events of
+/// interest.
+struct EpollItem {
+    file: Weak<dyn FileLike>,
+    event: SpinNoIrq<ctypes::epoll_event>,
+    ready_list: Weak<ReadyList>,
+    /// Whether the item is on the ready list.
+    queued: AtomicBool,
+    /// Whether the item has been removed from the epoll instance.
+    removed: AtomicBool,
+}
+
+/// Items that may be ready, and the tasks waiting for them.
+struct ReadyList {
+    items: SpinNoIrq<VecDeque<Arc<EpollItem>>>,
+    #[cfg(all(feature = "multitask", feature = "irq"))]
+    wq: crate::sync::WaitQueue,
+}
+
 pub struct EpollInstance {
-    events: Mutex<BTreeMap<usize, ctypes::epoll_event>>,
+    interests: Mutex<BTreeMap<usize, Arc<EpollItem>>>,
+    /// Items of the files that can not notify, polled on every wait.
+    polled: Mutex<Vec<Arc<EpollItem>>>,
+    ready_list: Arc<ReadyList>,
 }
 
 unsafe impl Send for ctypes::epoll_event {}
 unsafe impl Sync for ctypes::epoll_event {}
 
+impl EpollItem {
+    fn waker(self: &Arc<Self>) -> Waker {
+        Waker::from(self.clone())
+    }
+
+    /// Polls the file, returns the event to report if it is ready for any of
+    /// the events of interest.
+    fn poll(&self) -> Option<ctypes::epoll_event> {
+        let file = self.file.upgrade()?; // closed
+        let interest = *self.event.lock();
+        let events = match file.poll() {
+            Ok(state) => {
+                let mut events = 0;
+                if state.readable {
+                    events |= ctypes::EPOLLIN;
+                }
+                if state.writable {
+                    events |= ctypes::EPOLLOUT;
+                }
+                events
+            }
+            Err(_) => ctypes::EPOLLERR,
+        } & interest.events;
+        if events == 0 {
+            return None;
+        }
+        if interest.events & ctypes::EPOLLONESHOT != 0 {
+            let mut event = self.event.lock();
+            event.events = event.events & EPOLL_PRIVATE_BITS;
+        }
+        Some(ctypes::epoll_event {
+            events,
+            data: interest.data,
+        })
+    }
+
+    fn is_level_triggered(&self) -> bool {
+        self.event.lock().events & (ctypes::EPOLLET | ctypes::EPOLLONESHOT) == 0
+    }
+}
+
+impl Wake for EpollItem {
+    fn wake(self: Arc<Self>) {
+        self.wake_by_ref();
+    }
+
+    fn wake_by_ref(self: &Arc<Self>) {
+        if let Some(ready_list) = self.ready_list.upgrade() {
+            ready_list.push(self);
+        }
+    }
+}
+
+impl ReadyList {
+    fn new() -> Self {
+        Self {
+            items: SpinNoIrq::new(VecDeque::new()),
+            #[cfg(all(feature = "multitask", feature = "irq"))]
+            wq: crate::sync::WaitQueue::new(),
+        }
+    }
+
+    /// Puts the item onto the ready list if it is not, and wakes up a waiter.
+    fn push(&self, item: &Arc<EpollItem>) {
+        if !item.queued.swap(true, Ordering::AcqRel) {
+            self.items.lock().push_back(item.clone());
+            #[cfg(all(feature = "multitask", feature = "irq"))]
+            self.wq.notify_one(false);
+        }
+    }
+
+    fn pop(&self) -> Option<Arc<EpollItem>> {
+        let item = self.items.lock().pop_front()?;
+        // cleared before polling, so that later notifications are not lost.
+        item.queued.store(false, Ordering::Release);
+        Some(item)
+    }
+}
+
 impl EpollInstance {
     // TODO: parse flags
     pub fn new(_flags: usize) -> Self {
         Self {
-            events: Mutex::new(BTreeMap::new()),
+            interests: Mutex::new(BTreeMap::new()),
+            polled: Mutex::new(Vec::new()),
+            ready_list: Arc::new(ReadyList::new()),
         }
     }
 
@@ -39,31 +160,41 @@ impl EpollInstance {
     }
 
     fn control(&self, op: usize, fd: usize, event: &ctypes::epoll_event) -> LinuxResult<usize> {
-        match get_file_like(fd as c_int) {
-            Ok(_) => {}
-            Err(e) => return Err(e),
-        }
+        let file = get_file_like(fd as c_int)?;
 
         match op as u32 {
             ctypes::EPOLL_CTL_ADD => {
-                if let Entry::Vacant(e) = self.events.lock().entry(fd) {
-                    e.insert(*event);
+                if let Entry::Vacant(e) = self.interests.lock().entry(fd) {
+                    let item = Arc::new(EpollItem {
+                        file: Arc::downgrade(&file),
+                        event: SpinNoIrq::new(*event),
+                        ready_list: Arc::downgrade(&self.ready_list),
+                        queued: AtomicBool::new(false),
+                        removed: AtomicBool::new(false),
+                    });
+                    if file.register_poll_waker(&item.waker()) {
+                        self.ready_list.push(&item); // check the initial state
+                    } else {
+                        self.polled.lock().push(item.clone());
+                    }
+                    e.insert(item);
                 } else {
                     return Err(LinuxError::EEXIST);
                 }
             }
             ctypes::EPOLL_CTL_MOD => {
-                let mut events = self.events.lock();
-                if let Entry::Occupied(mut ocp) = events.entry(fd) {
-                    ocp.insert(*event);
+                if let Some(item) = self.interests.lock().get(&fd) {
+                    *item.event.lock() = *event;
+                    self.ready_list.push(item); // check with the new events
                 } else {
                     return Err(LinuxError::ENOENT);
                 }
             }
             ctypes::EPOLL_CTL_DEL => {
-                let mut events = self.events.lock();
-                if let Entry::Occupied(ocp) = events.entry(fd) {
-                    ocp.remove_entry();
+                if let Some(item) = self.interests.lock().remove(&fd) {
+                    item.removed.store(true, Ordering::Release);
+                    file.unregister_poll_waker(&item.waker());
+                    self.polled.lock().retain(|i| !Arc::ptr_eq(i, &item));
                 } else {
                     return Err(LinuxError::ENOENT);
                 }
@@ -75,35 +206,69 @@ impl EpollInstance {
         Ok(0)
     }
 
-    fn poll_all(&self, events: &mut [ctypes::epoll_event]) -> LinuxResult<usize> {
-        let ready_list = self.events.lock();
+    /// Checks the polled items and the items on the ready list, fills `events`
+    /// with the ready ones, and returns the number of them.
+    fn poll_ready(&self, events: &mut [ctypes::epoll_event]) -> LinuxResult<usize> {
         let mut events_num = 0;
+        for item in self.polled.lock().iter() {
+            if events_num == events.len() {
+                return Ok(events_num);
+            }
+            if let Some(ev) = item.poll() {
+                events[events_num] = ev;
+                events_num += 1;
+            }
+        }
 
-        for (infd, ev) in ready_list.iter() {
-            match get_file_like(*infd as c_int)?.poll() {
-                Err(_) => {
-                    if (ev.events & ctypes::EPOLLERR) != 0 {
-                        events[events_num].events = ctypes::EPOLLERR;
-                        events[events_num].data = ev.data;
-                        events_num += 1;
-                    }
+        let mut still_ready = Vec::new();
+        while events_num < events.len() {
+            let Some(item) = self.ready_list.pop() else {
+                break;
+            };
+            if item.removed.load(Ordering::Acquire) {
+                continue;
+            }
+            if let Some(ev) = item.poll() {
+                events[events_num] = ev;
+                events_num += 1;
+                if item.is_level_triggered() {
+                    still_ready.push(item);
                 }
-                Ok(state) => {
-                    if state.readable && (ev.events & ctypes::EPOLLIN != 0) {
-                        events[events_num].events = ctypes::EPOLLIN;
-                        events[events_num].data = ev.data;
-                        events_num += 1;
-                    }
+            }
+        }
+        for item in still_ready.iter() {
+            self.ready_list.push(item);
+        }
+        Ok(events_num)
+    }
 
-                    if state.writable && (ev.events & ctypes::EPOLLOUT != 0) {
-                        events[events_num].events = ctypes::EPOLLOUT;
-                        events[events_num].data = ev.data;
-                        events_num += 1;
-                    }
+    /// Blocks until some items may be ready, or the deadline is reached.
+    fn wait(&self, _deadline: Option<TimeValue>) {
+        #[cfg(all(feature = "multitask", feature = "irq"))]
+        if self.polled.lock().is_empty() {
+            let ready_list = &self.ready_list;
+            let condition = || !ready_list.items.lock().is_empty();
+            match _deadline {
+                Some(ddl) => {
+                    let dur = ddl.saturating_sub(current_time());
+                    ready_list.wq.wait_timeout_until(dur, condition);
                 }
+                None => ready_list.wq.wait_until(condition),
+            }
+            return;
+        }
+        crate::thread::yield_now();
+    }
+}
+
+impl Drop for EpollInstance {
+    fn drop(&mut self) {
+        for item in self.interests.lock().values() {
+            item.removed.store(true, Ordering::Release);
+            if let Some(file) = item.file.upgrade() {
+                file.unregister_poll_waker(&item.waker());
             }
         }
-        Ok(events_num)
     }
 }
 
@@ -192,7 +357,7 @@ pub unsafe extern "C" fn ax_epoll_wait(
             .then(|| current_time() + Duration::from_millis(timeout as u64));
         let epoll_instance = EpollInstance::from_fd(epfd)?;
         loop {
-            let events_num = epoll_instance.poll_all(events)?;
+            let events_num = epoll_instance.poll_ready(events)?;
             if events_num > 0 {
                 return Ok(events_num as c_int);
             }
@@ -201,7 +366,7 @@ pub unsafe extern "C" fn ax_epoll_wait(
                 debug!("    timeout!");
                 return Ok(0);
             }
-            crate::thread::yield_now();
+            epoll_instance.wait(deadline);
         }
     })
 }
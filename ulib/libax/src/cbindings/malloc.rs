@@ -6,13 +6,69 @@
 //! order to maintain consistency, C user programs also choose to share the kernel heap,
 //! skipping the sys_brk step.
 
-use core::result::Result::{Err, Ok};
-use core::{ffi::c_void, mem::size_of};
+use alloc::collections::BTreeMap;
+use core::{ffi::c_int, ffi::c_void, mem::size_of};
+use spin::Mutex;
+
+use axerrno::LinuxError;
 
 const BYTES_OF_USIZE: usize = 0x8;
 
+/// Alignment of the regions allocated by [`ax_malloc`]. The user address is
+/// [`BYTES_OF_USIZE`] bytes after the start of them, so it's never aligned to
+/// this, unlike the addresses returned by [`ax_posix_memalign`].
+const MALLOC_ALIGN: usize = 2 * BYTES_OF_USIZE;
+
+/// Regions allocated by [`ax_posix_memalign`] with an alignment larger than
+/// [`BYTES_OF_USIZE`], from the user address (which is the start of the
+/// region) to the size and alignment of the region. They have no control
+/// block, so that they take no more than `size` rounded to the size class.
+static ALIGNED_REGIONS: Mutex<BTreeMap<usize, (usize, usize)>> = Mutex::new(BTreeMap::new());
+
+/// Stored right before the address returned by [`ax_malloc`].
 struct MemoryControlBlock {
+    /// Size of the whole allocated region, including the control block.
+    size: usize,
+}
+
+/// The region allocated from the global allocator for a user address.
+struct Region {
+    start: usize,
     size: usize,
+    align: usize,
+    /// Offset of the user address from the start of the region.
+    offset: usize,
+}
+
+impl Region {
+    /// Finds the allocated region from the control block before `addr`, or
+    /// from [`ALIGNED_REGIONS`] if `addr` is aligned.
+    unsafe fn from_addr(addr: *mut c_void) -> Self {
+        let addr = addr as usize;
+        if addr % MALLOC_ALIGN == 0 {
+            let (size, align) = ALIGNED_REGIONS.lock()[&addr];
+            Self {
+                start: addr,
+                size,
+                align,
+                offset: 0,
+            }
+        } else {
+            let control_block =
+                &*((addr - size_of::<MemoryControlBlock>()) as *const MemoryControlBlock);
+            Self {
+                start: addr - size_of::<MemoryControlBlock>(),
+                size: control_block.size,
+                align: MALLOC_ALIGN,
+                offset: size_of::<MemoryControlBlock>(),
+            }
+        }
+    }
+
+    /// Number of bytes that can be used by the user program.
+    fn usable_size(&self) -> usize {
+        axalloc::global_allocator().usable_size(self.size, self.align) - self.offset
+    }
 }
 
 /// Allocate memory and return the memory address.
@@ -23,8 +79,10 @@ pub unsafe extern "C" fn ax_malloc(size: usize) -> *mut c_void {
     // Allocate `(actual length) + 8`. The lowest 8 Bytes are stored in the actual allocated space size.
     // This is because free(uintptr_t) has only one parameter representing the address,
     // So we need to save in advance to know the size of the memory space that needs to be released
-    match axalloc::global_allocator().alloc(size + size_of::<MemoryControlBlock>(), BYTES_OF_USIZE)
-    {
+    let Some(size) = size.checked_add(size_of::<MemoryControlBlock>()) else {
+        return core::ptr::null_mut();
+    };
+    match axalloc::global_allocator().alloc(size, MALLOC_ALIGN) {
         Ok(addr) => {
             let control_block = unsafe { &mut *(addr as *mut MemoryControlBlock) };
             control_block.size = size;
@@ -34,6 +92,45 @@ pub unsafe extern "C" fn ax_malloc(size: usize) -> *mut c_void {
     }
 }
 
+/// Allocate memory aligned to `align`, and store its address in `*memptr`.
+///
+/// Returns 0 on success, `EINVAL` if `align` is not a power of two multiple of
+/// `sizeof(void *)`, or `ENOMEM` if there is no memory.
+///
+/// Alignments up to 8 are served by [`ax_malloc`]. Otherwise, the user address
+/// is the start of a region allocated with `align`, and its size is recorded
+/// in [`ALIGNED_REGIONS`] instead of a control block, so no padding is needed.
+#[no_mangle]
+pub unsafe extern "C" fn ax_posix_memalign(
+    memptr: *mut *mut c_void,
+    align: usize,
+    size: usize,
+) -> c_int {
+    if !align.is_power_of_two() || align % size_of::<usize>() != 0 {
+        return LinuxError::EINVAL as _;
+    }
+    let addr = if align <= BYTES_OF_USIZE {
+        ax_malloc(size)
+    } else {
+        // No region is smaller than its alignment in the allocator, so this
+        // costs nothing, but keeps the slabs from serving alignments larger
+        // than their block size.
+        let size = size.max(align);
+        match axalloc::global_allocator().alloc(size, align) {
+            Ok(addr) => {
+                ALIGNED_REGIONS.lock().insert(addr, (size, align));
+                addr as *mut c_void
+            }
+            Err(_) => core::ptr::null_mut(),
+        }
+    };
+    if addr.is_null() {
+        return LinuxError::ENOMEM as _;
+    }
+    *memptr = addr;
+    0
+}
+
 /// Deallocate memory.
 ///
 /// (WARNING) If the address to be released does not match the allocated address, an error should
@@ -41,15 +138,60 @@ pub unsafe extern "C" fn ax_malloc(size: usize) -> *mut c_void {
 /// (currently used) does not check the validity of address to be released.
 #[no_mangle]
 pub unsafe extern "C" fn ax_free(addr: *mut c_void) {
-    let size = {
-        let control_block = unsafe {
-            &mut *((addr as usize - size_of::<MemoryControlBlock>()) as *mut MemoryControlBlock)
-        };
-        control_block.size
+    let region = Region::from_addr(addr);
+    if region.offset == 0 {
+        ALIGNED_REGIONS.lock().remove(&region.start);
+    }
+    axalloc::global_allocator().dealloc(region.start, region.size, region.align)
+}
+
+/// Resize the memory at `addr` to `size` bytes, and return the new address.
+///
+/// If the new size still fits in the size class of the allocator that the
+/// region belongs to (e.g., a 100 bytes block grown to 120 bytes, both in the
+/// 128 bytes slab), the memory is resized in place without copying. Otherwise,
+/// a new region is allocated, the data is copied, and the old one is freed.
+///
+/// Returns 0 on failure, in which case the memory at `addr` is left untouched.
+#[no_mangle]
+pub unsafe extern "C" fn ax_realloc(addr: *mut c_void, size: usize) -> *mut c_void {
+    if addr.is_null() {
+        return ax_malloc(size);
+    }
+    let region = Region::from_addr(addr);
+    let Some(new_size) = size.checked_add(region.offset) else {
+        return core::ptr::null_mut();
+    };
+    let allocator = axalloc::global_allocator();
+    if allocator.usable_size(new_size, region.align)
+        == allocator.usable_size(region.size, region.align)
+    {
+        // Same size class: keep the control block (or the recorded size), so
+        // that the region is still freed with its original size.
+        return addr;
+    }
+
+    let new_addr = if region.offset == 0 {
+        let mut new_addr = core::ptr::null_mut();
+        ax_posix_memalign(&mut new_addr, region.align, size);
+        new_addr
+    } else {
+        ax_malloc(size)
     };
-    axalloc::global_allocator().dealloc(
-        addr as usize - size_of::<MemoryControlBlock>(),
-        size + size_of::<MemoryControlBlock>(),
-        BYTES_OF_USIZE,
-    )
+    if !new_addr.is_null() {
+        let copy_size = size.min(region.usable_size());
+        core::ptr::copy_nonoverlapping(addr as *const u8, new_addr as *mut u8, copy_size);
+        ax_free(addr);
+    }
+    new_addr
+}
+
+/// Returns the number of usable bytes in the memory at `addr`, which is at
+/// least the size requested when it was allocated.
+#[no_mangle]
+pub unsafe extern "C" fn ax_malloc_usable_size(addr: *mut c_void) -> usize {
+    if addr.is_null() {
+        return 0;
+    }
+    Region::from_addr(addr).usable_size()
 }
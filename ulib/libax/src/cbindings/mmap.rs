@@ -0,0 +1,196 @@
+//! Memory mappings backed by the page allocator.
+//!
+//! There is only one address space, so a mapping is just a run of contiguous
+//! pages allocated from [`axalloc`]. Large buffers thus bypass the byte
+//! allocator, and are given back to the page allocator once unmapped.
+//!
+//! File-backed mappings are filled with the file content when mapped, and
+//! later changes are not written back. So only private or read-only shared
+//! mappings of files are supported.
+
+use alloc::collections::BTreeMap;
+use axerrno::{LinuxError, LinuxResult};
+use core::ffi::{c_int, c_void};
+use spin::Mutex;
+
+use super::ctypes;
+
+const PAGE_SIZE: usize = 0x1000;
+
+/// Live mappings, from the start address to the number of pages. Only the
+/// pages in them are given back to the page allocator, so unmapping a range
+/// twice or one that was never mapped cannot free other allocations.
+static MAPPINGS: Mutex<BTreeMap<usize, usize>> = Mutex::new(BTreeMap::new());
+
+const fn num_pages(len: usize) -> usize {
+    (len + PAGE_SIZE - 1) / PAGE_SIZE
+}
+
+fn alloc_pages(num_pages: usize) -> LinuxResult<usize> {
+    axalloc::global_allocator()
+        .alloc_pages(num_pages, PAGE_SIZE)
+        .map_err(|_| LinuxError::ENOMEM)
+}
+
+/// Fills the pages of a file-backed mapping, the part beyond the end of the
+/// file is zeroed.
+fn fill_from_file(fd: c_int, offset: u64, buf: &mut [u8]) -> LinuxResult {
+    #[cfg(feature = "fs")]
+    {
+        let read_len = super::file::read_file_at(fd, offset, buf)?;
+        buf[read_len..].fill(0);
+        Ok(())
+    }
+    #[cfg(not(feature = "fs"))]
+    {
+        let _ = (fd, offset, buf);
+        Err(LinuxError::EBADF)
+    }
+}
+
+/// Map pages of memory, either anonymous (zeroed) or filled with a file.
+///
+/// Return the start address of the mapping if success.
+#[no_mangle]
+pub unsafe extern "C" fn ax_mmap(
+    addr: *mut c_void,
+    len: ctypes::size_t,
+    prot: c_int,
+    flags: c_int,
+    fd: c_int,
+    off: ctypes::off_t,
+) -> *mut c_void {
+    debug!(
+        "ax_mmap <= {:#x} {:#x} {:#x} {:#x} {} {}",
+        addr as usize, len, prot, flags, fd, off
+    );
+    ax_call_body!(ax_mmap, {
+        let (prot, flags) = (prot as u32, flags as u32);
+        let len = len as usize;
+        if len == 0 || off < 0 || off as usize % PAGE_SIZE != 0 {
+            return Err(LinuxError::EINVAL);
+        }
+        if flags & ctypes::MAP_FIXED != 0 {
+            return Err(LinuxError::EINVAL); // cannot map at the given address
+        }
+        let shared = match flags & ctypes::MAP_TYPE {
+            ctypes::MAP_SHARED | ctypes::MAP_SHARED_VALIDATE => true,
+            ctypes::MAP_PRIVATE => false,
+            _ => return Err(LinuxError::EINVAL),
+        };
+        let anonymous = flags & ctypes::MAP_ANONYMOUS != 0;
+        if !anonymous && shared && prot & ctypes::PROT_WRITE != 0 {
+            return Err(LinuxError::ENODEV); // writes cannot be written back
+        }
+
+        let num_pages = num_pages(len);
+        let start = alloc_pages(num_pages)?;
+        let buf =
+            unsafe { core::slice::from_raw_parts_mut(start as *mut u8, num_pages * PAGE_SIZE) };
+        if anonymous {
+            buf.fill(0);
+        } else if let Err(e) = fill_from_file(fd, off as u64, buf) {
+            axalloc::global_allocator().dealloc_pages(start, num_pages);
+            return Err(e);
+        }
+        MAPPINGS.lock().insert(start, num_pages);
+        Ok(start as *mut c_void)
+    })
+}
+
+/// Unmap pages of memory mapped by `ax_mmap`. The range may be a part of a
+/// mapping, but must not span several ones.
+///
+/// Return 0 if success.
+#[no_mangle]
+pub unsafe extern "C" fn ax_munmap(addr: *mut c_void, len: ctypes::size_t) -> c_int {
+    debug!("ax_munmap <= {:#x} {:#x}", addr as usize, len);
+    ax_call_body!(ax_munmap, {
+        let addr = addr as usize;
+        if addr % PAGE_SIZE != 0 || len == 0 {
+            return Err(LinuxError::EINVAL);
+        }
+        let pages = num_pages(len as usize);
+        let mut mappings = MAPPINGS.lock();
+        let (start, total) = match mappings.range(..=addr).next_back() {
+            Some((&start, &total)) if addr + pages * PAGE_SIZE <= start + total * PAGE_SIZE => {
+                (start, total)
+            }
+            _ => return Err(LinuxError::EINVAL),
+        };
+        // split the mapping into the parts before and after the range
+        let head = (addr - start) / PAGE_SIZE;
+        let tail = total - head - pages;
+        mappings.remove(&start);
+        if head > 0 {
+            mappings.insert(start, head);
+        }
+        if tail > 0 {
+            mappings.insert(addr + pages * PAGE_SIZE, tail);
+        }
+        axalloc::global_allocator().dealloc_pages(addr, pages);
+        Ok(0)
+    })
+}
+
+/// Resize a mapping. It's grown in place if the following pages are free,
+/// otherwise it's moved if `MREMAP_MAYMOVE` is specified. `old_addr` and
+/// `old_size` must be those of a whole mapping.
+///
+/// Return the start address of the mapping after resizing if success.
+#[no_mangle]
+pub unsafe extern "C" fn ax_mremap(
+    old_addr: *mut c_void,
+    old_size: ctypes::size_t,
+    new_size: ctypes::size_t,
+    flags: c_int,
+) -> *mut c_void {
+    debug!(
+        "ax_mremap <= {:#x} {:#x} {:#x} {:#x}",
+        old_addr as usize, old_size, new_size, flags
+    );
+    ax_call_body!(ax_mremap, {
+        let old_addr = old_addr as usize;
+        let flags = flags as u32;
+        if old_addr % PAGE_SIZE != 0 || new_size == 0 || flags & !ctypes::MREMAP_MAYMOVE != 0 {
+            return Err(LinuxError::EINVAL);
+        }
+        let allocator = axalloc::global_allocator();
+        let old_pages = num_pages(old_size as usize);
+        let new_pages = num_pages(new_size as usize);
+        let mut mappings = MAPPINGS.lock();
+        if mappings.get(&old_addr) != Some(&old_pages) {
+            return Err(LinuxError::EINVAL);
+        }
+        if new_pages <= old_pages {
+            if new_pages < old_pages {
+                allocator.dealloc_pages(old_addr + new_pages * PAGE_SIZE, old_pages - new_pages);
+                mappings.insert(old_addr, new_pages);
+            }
+            return Ok(old_addr as *mut c_void);
+        }
+
+        let old_len = old_pages * PAGE_SIZE;
+        let new_len = new_pages * PAGE_SIZE;
+        let new_addr = if allocator
+            .alloc_pages_at(old_addr + old_len, new_pages - old_pages)
+            .is_ok()
+        {
+            old_addr
+        } else if flags & ctypes::MREMAP_MAYMOVE != 0 {
+            let new_addr = alloc_pages(new_pages)?;
+            unsafe {
+                core::ptr::copy_nonoverlapping(old_addr as *const u8, new_addr as *mut u8, old_len)
+            };
+            allocator.dealloc_pages(old_addr, old_pages);
+            mappings.remove(&old_addr);
+            new_addr
+        } else {
+            return Err(LinuxError::ENOMEM);
+        };
+        mappings.insert(new_addr, new_pages);
+        // the grown part of an anonymous mapping is zeroed.
+        unsafe { core::ptr::write_bytes((new_addr + old_len) as *mut u8, 0, new_len - old_len) };
+        Ok(new_addr as *mut c_void)
+    })
+}
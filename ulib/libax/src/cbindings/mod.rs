@@ -19,6 +19,8 @@ mod file;
 mod io_mpx;
 #[cfg(feature = "alloc")]
 mod malloc;
+#[cfg(feature = "alloc")]
+mod mmap;
 #[cfg(feature = "pipe")]
 mod pipe;
 #[cfg(feature = "multitask")]
@@ -59,7 +61,9 @@ pub unsafe extern "C" fn ax_exit(exit_code: core::ffi::c_int) -> ! {
 }
 
 #[cfg(feature = "alloc")]
-pub use self::malloc::{ax_free, ax_malloc};
+pub use self::malloc::{ax_free, ax_malloc, ax_malloc_usable_size, ax_posix_memalign, ax_realloc};
+#[cfg(feature = "alloc")]
+pub use self::mmap::{ax_mmap, ax_mremap, ax_munmap};
 
 #[cfg(feature = "alloc")]
 pub use self::fd_ops::{ax_close, ax_dup, ax_dup3, ax_fcntl, ax_fstat, ax_read, ax_write};
@@ -70,14 +74,37 @@ pub use self::file::{ax_getcwd, ax_lseek, ax_lstat, ax_open, ax_stat};
 #[cfg(feature = "net")]
 pub use self::socket::{
     ax_accept, ax_bind, ax_connect, ax_getpeername, ax_getsockname, ax_listen, ax_recv,
-    ax_recvfrom, ax_resolve_sockaddr, ax_send, ax_sendto, ax_shutdown, ax_socket,
+    ax_recvfrom, ax_resolve_sockaddr, ax_send, ax_sendto, ax_setsockopt, ax_shutdown, ax_socket,
 };
+#[cfg(all(feature = "net", feature = "fs"))]
+pub use self::socket::ax_sendfile;
 
+#[cfg(feature = "multitask")]
+pub use self::pthread::barrier::{
+    ax_pthread_barrier_destroy, ax_pthread_barrier_init, ax_pthread_barrier_wait,
+};
+#[cfg(feature = "multitask")]
+pub use self::pthread::condvar::{
+    ax_pthread_cond_broadcast, ax_pthread_cond_destroy, ax_pthread_cond_init,
+    ax_pthread_cond_signal, ax_pthread_cond_timedwait, ax_pthread_cond_wait,
+};
 #[cfg(feature = "multitask")]
 pub use self::pthread::mutex::{
     ax_pthread_mutex_init, ax_pthread_mutex_lock, ax_pthread_mutex_unlock,
 };
 #[cfg(feature = "multitask")]
+pub use self::pthread::once::ax_pthread_once;
+#[cfg(feature = "multitask")]
+pub use self::pthread::rwlock::{
+    ax_pthread_rwlock_destroy, ax_pthread_rwlock_init, ax_pthread_rwlock_rdlock,
+    ax_pthread_rwlock_tryrdlock, ax_pthread_rwlock_trywrlock, ax_pthread_rwlock_unlock,
+    ax_pthread_rwlock_wrlock,
+};
+#[cfg(feature = "multitask")]
+pub use self::pthread::spin::{
+    ax_pthread_spin_init, ax_pthread_spin_lock, ax_pthread_spin_trylock, ax_pthread_spin_unlock,
+};
+#[cfg(feature = "multitask")]
 pub use self::pthread::{ax_getpid, ax_pthread_create, ax_pthread_exit, ax_pthread_join};
 
 #[cfg(feature = "pipe")]
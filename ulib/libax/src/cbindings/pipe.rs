@@ -1,93 +1,189 @@
-use alloc::sync::Arc;
+use alloc::{boxed::Box, sync::Arc, vec, vec::Vec};
 use axerrno::{LinuxError, LinuxResult};
 use core::ffi::c_int;
+use core::sync::atomic::{AtomicBool, AtomicUsize, Ordering};
+use core::task::Waker;
 
 use super::{ctypes, fd_ops::FileLike};
 use crate::io::PollState;
 use crate::sync::Mutex;
-use crate::thread::yield_now;
 
-#[derive(Copy, Clone, PartialEq)]
-enum RingBufferStatus {
-    Full,
-    Empty,
-    Normal,
-}
-
-const RING_BUFFER_SIZE: usize = 256;
+/// Capacity of the ring buffer of a pipe, in bytes.
+const PIPE_BUF_SIZE: usize = 0x1000; // one page
 
+/// A ring buffer that copies data in slices.
 pub struct PipeRingBuffer {
-    arr: [u8; RING_BUFFER_SIZE],
+    arr: Box<[u8]>,
     head: usize,
-    tail: usize,
-    status: RingBufferStatus,
+    len: usize,
 }
 
 impl PipeRingBuffer {
-    pub const fn new() -> Self {
+    pub fn new(capacity: usize) -> Self {
         Self {
-            arr: [0; RING_BUFFER_SIZE],
+            arr: vec![0; capacity].into_boxed_slice(),
             head: 0,
-            tail: 0,
-            status: RingBufferStatus::Empty,
+            len: 0,
         }
     }
 
-    pub fn write_byte(&mut self, byte: u8) {
-        self.status = RingBufferStatus::Normal;
-        self.arr[self.tail] = byte;
-        self.tail = (self.tail + 1) % RING_BUFFER_SIZE;
-        if self.tail == self.head {
-            self.status = RingBufferStatus::Full;
-        }
+    pub const fn capacity(&self) -> usize {
+        self.arr.len()
+    }
+
+    /// Get the length of remaining data in the buffer
+    pub const fn available_read(&self) -> usize {
+        self.len
     }
 
-    pub fn read_byte(&mut self) -> u8 {
-        self.status = RingBufferStatus::Normal;
-        let c = self.arr[self.head];
-        self.head = (self.head + 1) % RING_BUFFER_SIZE;
-        if self.head == self.tail {
-            self.status = RingBufferStatus::Empty;
+    /// Get the length of remaining space in the buffer
+    pub const fn available_write(&self) -> usize {
+        self.capacity() - self.len
+    }
+
+    /// Reads as much data as possible into `buf`, returns the number of bytes
+    /// read.
+    pub fn read(&mut self, buf: &mut [u8]) -> usize {
+        let count = buf.len().min(self.len);
+        // at most two parts: to the end of the array, and from its start.
+        let first = count.min(self.capacity() - self.head);
+        buf[..first].copy_from_slice(&self.arr[self.head..self.head + first]);
+        buf[first..count].copy_from_slice(&self.arr[..count - first]);
+        self.head = (self.head + count) % self.capacity();
+        self.len -= count;
+        count
+    }
+
+    /// Writes as much data as possible from `buf`, returns the number of bytes
+    /// written.
+    pub fn write(&mut self, buf: &[u8]) -> usize {
+        let count = buf.len().min(self.available_write());
+        let tail = (self.head + self.len) % self.capacity();
+        let first = count.min(self.capacity() - tail);
+        self.arr[tail..tail + first].copy_from_slice(&buf[..first]);
+        self.arr[..count - first].copy_from_slice(&buf[first..count]);
+        self.len += count;
+        count
+    }
+}
+
+/// Wakers registered by [`FileLike::register_poll_waker`], shared by both
+/// ends. Unlike the wakers of futures, they are kept after being woken up.
+struct PollWakers(spin::Mutex<Vec<Waker>>);
+
+impl PollWakers {
+    const fn new() -> Self {
+        Self(spin::Mutex::new(Vec::new()))
+    }
+
+    fn register(&self, waker: &Waker) {
+        self.0.lock().push(waker.clone());
+    }
+
+    fn unregister(&self, waker: &Waker) {
+        self.0.lock().retain(|w| !w.will_wake(waker));
+    }
+
+    fn wake_all(&self) {
+        for waker in self.0.lock().iter() {
+            waker.wake_by_ref();
         }
-        c
     }
+}
 
-    /// Get the length of remaining data in the buffer
-    pub const fn available_read(&self) -> usize {
-        if matches!(self.status, RingBufferStatus::Empty) {
-            0
-        } else if self.tail > self.head {
-            self.tail - self.head
+/// The state shared by both ends of a pipe.
+struct PipeInner {
+    buffer: Mutex<PipeRingBuffer>,
+    /// Copy of the data length of the buffer, for checking it without
+    /// locking the buffer.
+    len: AtomicUsize,
+    capacity: usize,
+    read_closed: AtomicBool,
+    write_closed: AtomicBool,
+    /// Readers waiting for data.
+    #[cfg(feature = "multitask")]
+    read_wq: crate::sync::WaitQueue,
+    /// Writers waiting for space.
+    #[cfg(feature = "multitask")]
+    write_wq: crate::sync::WaitQueue,
+    poll_wakers: PollWakers,
+}
+
+impl PipeInner {
+    /// Runs `f` on the locked buffer, and updates the copy of its length.
+    fn with_buffer<T>(&self, f: impl FnOnce(&mut PipeRingBuffer) -> T) -> T {
+        let mut ring_buffer = self.buffer.lock();
+        let ret = f(&mut ring_buffer);
+        self.len
+            .store(ring_buffer.available_read(), Ordering::Release);
+        ret
+    }
+
+    /// Blocks until `condition` becomes true, it's woken up by the other end.
+    fn wait_until(&self, _reader: bool, condition: impl Fn() -> bool) {
+        #[cfg(feature = "multitask")]
+        if _reader {
+            self.read_wq.wait_until(condition);
         } else {
-            self.tail + RING_BUFFER_SIZE - self.head
+            self.write_wq.wait_until(condition);
+        }
+        #[cfg(not(feature = "multitask"))]
+        while !condition() {
+            crate::thread::yield_now();
         }
     }
 
-    /// Get the length of remaining space in the buffer
-    pub const fn available_write(&self) -> usize {
-        if matches!(self.status, RingBufferStatus::Full) {
-            0
+    /// Wakes up the tasks blocked on the reader (or the writer) end.
+    fn notify(&self, _reader: bool) {
+        #[cfg(feature = "multitask")]
+        if _reader {
+            self.read_wq.notify_all(false);
         } else {
-            RING_BUFFER_SIZE - self.available_read()
+            self.write_wq.notify_all(false);
         }
+        self.poll_wakers.wake_all();
     }
 }
 
+/// One end of a pipe.
+///
+/// Blocking reads and writes sleep until the other end makes progress. A read
+/// returns as soon as some data is available, or returns 0 (EOF) once the
+/// write end is closed. Writes to a pipe whose read end is closed fail with
+/// `EPIPE`.
 pub struct Pipe {
     readable: bool,
-    buffer: Arc<Mutex<PipeRingBuffer>>,
+    nonblocking: AtomicBool,
+    inner: Arc<PipeInner>,
 }
 
 impl Pipe {
     pub fn new() -> (Pipe, Pipe) {
-        let buffer = Arc::new(Mutex::new(PipeRingBuffer::new()));
+        Self::with_capacity(PIPE_BUF_SIZE)
+    }
+
+    pub fn with_capacity(capacity: usize) -> (Pipe, Pipe) {
+        let inner = Arc::new(PipeInner {
+            buffer: Mutex::new(PipeRingBuffer::new(capacity)),
+            len: AtomicUsize::new(0),
+            capacity,
+            read_closed: AtomicBool::new(false),
+            write_closed: AtomicBool::new(false),
+            #[cfg(feature = "multitask")]
+            read_wq: crate::sync::WaitQueue::new(),
+            #[cfg(feature = "multitask")]
+            write_wq: crate::sync::WaitQueue::new(),
+            poll_wakers: PollWakers::new(),
+        });
         let read_end = Pipe {
             readable: true,
-            buffer: buffer.clone(),
+            nonblocking: AtomicBool::new(false),
+            inner: inner.clone(),
         };
         let write_end = Pipe {
             readable: false,
-            buffer,
+            nonblocking: AtomicBool::new(false),
+            inner,
         };
         (read_end, write_end)
     }
@@ -101,7 +197,24 @@ impl Pipe {
     }
 
     pub fn write_end_close(&self) -> bool {
-        Arc::strong_count(&self.buffer) == 1
+        self.inner.write_closed.load(Ordering::Acquire)
+    }
+
+    pub fn read_end_close(&self) -> bool {
+        self.inner.read_closed.load(Ordering::Acquire)
+    }
+}
+
+impl Drop for Pipe {
+    fn drop(&mut self) {
+        // wake up the other end to see EOF or EPIPE.
+        if self.readable {
+            self.inner.read_closed.store(true, Ordering::Release);
+            self.inner.notify(false);
+        } else {
+            self.inner.write_closed.store(true, Ordering::Release);
+            self.inner.notify(true);
+        }
     }
 }
 
@@ -110,27 +223,29 @@ impl FileLike for Pipe {
         if !self.readable() {
             return Err(LinuxError::EPERM);
         }
-        let mut read_size = 0usize;
-        let max_len = buf.len();
+        if buf.is_empty() {
+            return Ok(0);
+        }
+        let inner = &self.inner;
         loop {
-            let mut ring_buffer = self.buffer.lock();
-            let loop_read = ring_buffer.available_read();
-            if loop_read == 0 {
-                if self.write_end_close() {
-                    return Ok(read_size);
+            let read_size = inner.with_buffer(|ring_buffer| ring_buffer.read(buf));
+            if read_size > 0 {
+                inner.notify(false); // the write end may become writable
+                return Ok(read_size);
+            }
+            if self.write_end_close() {
+                // check again, the writer may write just before closing.
+                if inner.len.load(Ordering::Acquire) == 0 {
+                    return Ok(0);
                 }
-                drop(ring_buffer);
-                // Data not ready, wait for write end
-                yield_now(); // TODO: use synconize primitive
                 continue;
             }
-            for _ in 0..loop_read {
-                if read_size == max_len {
-                    return Ok(read_size);
-                }
-                buf[read_size] = ring_buffer.read_byte();
-                read_size += 1;
+            if self.nonblocking.load(Ordering::Relaxed) {
+                return Err(LinuxError::EAGAIN);
             }
+            inner.wait_until(true, || {
+                inner.len.load(Ordering::Acquire) > 0 || self.write_end_close()
+            });
         }
     }
 
@@ -138,25 +253,34 @@ impl FileLike for Pipe {
         if !self.writable() {
             return Err(LinuxError::EPERM);
         }
+        let inner = &self.inner;
         let mut write_size = 0usize;
-        let max_len = buf.len();
-        loop {
-            let mut ring_buffer = self.buffer.lock();
-            let loop_write = ring_buffer.available_write();
-            if loop_write == 0 {
-                drop(ring_buffer);
-                // Buffer is full, wait for read end to consume
-                yield_now(); // TODO: use synconize primitive
+        while write_size < buf.len() {
+            if self.read_end_close() {
+                return if write_size > 0 {
+                    Ok(write_size)
+                } else {
+                    Err(LinuxError::EPIPE)
+                };
+            }
+            let n = inner.with_buffer(|ring_buffer| ring_buffer.write(&buf[write_size..]));
+            if n > 0 {
+                write_size += n;
+                inner.notify(true); // the read end may become readable
                 continue;
             }
-            for _ in 0..loop_write {
-                if write_size == max_len {
-                    return Ok(write_size);
-                }
-                ring_buffer.write_byte(buf[write_size]);
-                write_size += 1;
+            if self.nonblocking.load(Ordering::Relaxed) {
+                return if write_size > 0 {
+                    Ok(write_size)
+                } else {
+                    Err(LinuxError::EAGAIN)
+                };
             }
+            inner.wait_until(false, || {
+                inner.len.load(Ordering::Acquire) < inner.capacity || self.read_end_close()
+            });
         }
+        Ok(write_size)
     }
 
     fn stat(&self) -> LinuxResult<ctypes::stat> {
@@ -177,16 +301,27 @@ impl FileLike for Pipe {
     }
 
     fn poll(&self) -> LinuxResult<PollState> {
-        let buf = self.buffer.lock();
+        let len = self.inner.len.load(Ordering::Acquire);
         Ok(PollState {
-            readable: self.readable() && buf.available_read() > 0,
-            writable: self.writable() && buf.available_write() > 0,
+            // EOF and EPIPE are also reported as ready.
+            readable: self.readable() && (len > 0 || self.write_end_close()),
+            writable: self.writable() && (len < self.inner.capacity || self.read_end_close()),
         })
     }
 
-    fn set_nonblocking(&self, _nonblocking: bool) -> LinuxResult {
+    fn set_nonblocking(&self, nonblocking: bool) -> LinuxResult {
+        self.nonblocking.store(nonblocking, Ordering::Relaxed);
         Ok(())
     }
+
+    fn register_poll_waker(&self, waker: &Waker) -> bool {
+        self.inner.poll_wakers.register(waker);
+        true
+    }
+
+    fn unregister_poll_waker(&self, waker: &Waker) {
+        self.inner.poll_wakers.unregister(waker);
+    }
 }
 
 /// Create a pipe
@@ -0,0 +1,111 @@
+use crate::cbindings::{ctypes, utils::check_null_mut_ptr};
+use axerrno::{LinuxError, LinuxResult};
+use core::ffi::{c_int, c_uint};
+use core::mem::size_of;
+use core::sync::atomic::{AtomicU32, Ordering};
+
+use super::futex;
+
+static_assertions::const_assert!(
+    size_of::<PthreadBarrier>() <= size_of::<ctypes::pthread_barrier_t>()
+);
+
+/// A barrier for a fixed number of tasks.
+#[repr(C)]
+pub struct PthreadBarrier {
+    count: u32,
+    /// Number of tasks arrived in the current round.
+    arrived: AtomicU32,
+    /// Incremented when all tasks have arrived, to release them.
+    generation: AtomicU32,
+}
+
+impl PthreadBarrier {
+    const fn new(count: u32) -> Self {
+        Self {
+            count,
+            arrived: AtomicU32::new(0),
+            generation: AtomicU32::new(0),
+        }
+    }
+
+    fn key(&self) -> usize {
+        self as *const _ as usize
+    }
+
+    /// Whether some tasks are waiting on the barrier.
+    fn is_waited(&self) -> bool {
+        self.arrived.load(Ordering::Acquire) != 0
+    }
+
+    /// Blocks until `count` tasks have called it. Returns `true` in exactly
+    /// one of them (the last one to arrive).
+    fn wait(&self) -> LinuxResult<bool> {
+        let generation = self.generation.load(Ordering::Acquire);
+        if self.arrived.fetch_add(1, Ordering::AcqRel) + 1 == self.count {
+            // The others cannot enter the next round before the generation
+            // changes, so it's safe to reset the counter first.
+            self.arrived.store(0, Ordering::Relaxed);
+            self.generation.fetch_add(1, Ordering::Release);
+            futex::wake_all(self.key());
+            Ok(true)
+        } else {
+            futex::wait_until(self.key(), || {
+                self.generation.load(Ordering::Acquire) != generation
+            });
+            Ok(false)
+        }
+    }
+}
+
+/// Initialize a barrier for `count` tasks.
+#[no_mangle]
+pub unsafe extern "C" fn ax_pthread_barrier_init(
+    barrier: *mut ctypes::pthread_barrier_t,
+    _attr: *const ctypes::pthread_barrierattr_t,
+    count: c_uint,
+) -> c_int {
+    debug!(
+        "ax_pthread_barrier_init <= {:#x}, {}",
+        barrier as usize, count
+    );
+    ax_call_body!(ax_pthread_barrier_init, {
+        check_null_mut_ptr(barrier)?;
+        if count == 0 {
+            return Err(LinuxError::EINVAL);
+        }
+        barrier
+            .cast::<PthreadBarrier>()
+            .write(PthreadBarrier::new(count));
+        Ok(0)
+    })
+}
+
+/// Destroy a barrier.
+#[no_mangle]
+pub unsafe extern "C" fn ax_pthread_barrier_destroy(
+    barrier: *mut ctypes::pthread_barrier_t,
+) -> c_int {
+    debug!("ax_pthread_barrier_destroy <= {:#x}", barrier as usize);
+    ax_call_body!(ax_pthread_barrier_destroy, {
+        check_null_mut_ptr(barrier)?;
+        if (*barrier.cast::<PthreadBarrier>()).is_waited() {
+            return Err(LinuxError::EBUSY);
+        }
+        Ok(0)
+    })
+}
+
+/// Wait on a barrier until all tasks have arrived.
+///
+/// Returns 1 in one of the tasks and 0 in the others, on which the C library
+/// returns `PTHREAD_BARRIER_SERIAL_THREAD` and 0 respectively.
+#[no_mangle]
+pub unsafe extern "C" fn ax_pthread_barrier_wait(barrier: *mut ctypes::pthread_barrier_t) -> c_int {
+    debug!("ax_pthread_barrier_wait <= {:#x}", barrier as usize);
+    ax_call_body!(ax_pthread_barrier_wait, {
+        check_null_mut_ptr(barrier)?;
+        let serial = (*barrier.cast::<PthreadBarrier>()).wait()?;
+        Ok(serial as c_int)
+    })
+}
@@ -0,0 +1,165 @@
+use crate::cbindings::{ctypes, utils::check_null_mut_ptr};
+use axerrno::{LinuxError, LinuxResult};
+use core::ffi::c_int;
+use core::mem::size_of;
+use core::sync::atomic::{AtomicU32, Ordering};
+use core::time::Duration;
+
+use super::{futex, mutex::PthreadMutex};
+
+static_assertions::const_assert!(size_of::<PthreadCond>() <= size_of::<ctypes::pthread_cond_t>());
+
+/// A condition variable, whose initial state is all zeros.
+#[repr(C)]
+pub struct PthreadCond {
+    /// Incremented by every signal, so that a waiter can tell whether it has
+    /// been signaled since it released the mutex.
+    seq: AtomicU32,
+    /// Number of waiters, to skip the wakeups if there are none.
+    waiters: AtomicU32,
+}
+
+impl PthreadCond {
+    const fn new() -> Self {
+        Self {
+            seq: AtomicU32::new(0),
+            waiters: AtomicU32::new(0),
+        }
+    }
+
+    fn key(&self) -> usize {
+        self as *const _ as usize
+    }
+
+    /// Releases `mutex` and blocks until signaled, or the monotonic clock
+    /// reaches `deadline` if given. Re-acquires `mutex` before returning.
+    fn wait(&self, mutex: &PthreadMutex, deadline: Option<Duration>) -> LinuxResult {
+        let seq = self.seq.load(Ordering::SeqCst);
+        self.waiters.fetch_add(1, Ordering::SeqCst);
+        mutex.unlock()?;
+
+        let signaled = || self.seq.load(Ordering::SeqCst) != seq;
+        let timeout = match deadline {
+            Some(deadline) => futex::wait_until_deadline(self.key(), deadline, signaled),
+            None => {
+                futex::wait_until(self.key(), signaled);
+                false
+            }
+        };
+
+        self.waiters.fetch_sub(1, Ordering::SeqCst);
+        mutex.lock()?;
+        if timeout {
+            Err(LinuxError::ETIMEDOUT)
+        } else {
+            Ok(())
+        }
+    }
+
+    fn signal(&self) {
+        self.seq.fetch_add(1, Ordering::SeqCst);
+        if self.waiters.load(Ordering::SeqCst) > 0 {
+            futex::wake_one(self.key());
+        }
+    }
+
+    fn broadcast(&self) {
+        self.seq.fetch_add(1, Ordering::SeqCst);
+        if self.waiters.load(Ordering::SeqCst) > 0 {
+            futex::wake_all(self.key());
+        }
+    }
+}
+
+/// Initialize a condition variable.
+#[no_mangle]
+pub unsafe extern "C" fn ax_pthread_cond_init(
+    cond: *mut ctypes::pthread_cond_t,
+    _attr: *const ctypes::pthread_condattr_t,
+) -> c_int {
+    debug!("ax_pthread_cond_init <= {:#x}", cond as usize);
+    ax_call_body!(ax_pthread_cond_init, {
+        check_null_mut_ptr(cond)?;
+        cond.cast::<PthreadCond>().write(PthreadCond::new());
+        Ok(0)
+    })
+}
+
+/// Destroy a condition variable.
+#[no_mangle]
+pub unsafe extern "C" fn ax_pthread_cond_destroy(cond: *mut ctypes::pthread_cond_t) -> c_int {
+    debug!("ax_pthread_cond_destroy <= {:#x}", cond as usize);
+    ax_call_body!(ax_pthread_cond_destroy, {
+        check_null_mut_ptr(cond)?;
+        if (*cond.cast::<PthreadCond>()).waiters.load(Ordering::SeqCst) > 0 {
+            return Err(LinuxError::EBUSY);
+        }
+        Ok(0)
+    })
+}
+
+/// Release the mutex and wait on the condition variable.
+#[no_mangle]
+pub unsafe extern "C" fn ax_pthread_cond_wait(
+    cond: *mut ctypes::pthread_cond_t,
+    mutex: *mut ctypes::pthread_mutex_t,
+) -> c_int {
+    debug!(
+        "ax_pthread_cond_wait <= {:#x}, {:#x}",
+        cond as usize, mutex as usize
+    );
+    ax_call_body!(ax_pthread_cond_wait, {
+        check_null_mut_ptr(cond)?;
+        check_null_mut_ptr(mutex)?;
+        (*cond.cast::<PthreadCond>()).wait(&*mutex.cast::<PthreadMutex>(), None)?;
+        Ok(0)
+    })
+}
+
+/// Release the mutex and wait on the condition variable, until the absolute
+/// time `abstime` (of `clock_gettime`) is reached.
+///
+/// Fails with `ETIMEDOUT` if it timed out, with the mutex re-acquired.
+#[no_mangle]
+pub unsafe extern "C" fn ax_pthread_cond_timedwait(
+    cond: *mut ctypes::pthread_cond_t,
+    mutex: *mut ctypes::pthread_mutex_t,
+    abstime: *const ctypes::timespec,
+) -> c_int {
+    debug!(
+        "ax_pthread_cond_timedwait <= {:#x}, {:#x}",
+        cond as usize, mutex as usize
+    );
+    ax_call_body!(ax_pthread_cond_timedwait, {
+        check_null_mut_ptr(cond)?;
+        check_null_mut_ptr(mutex)?;
+        if abstime.is_null() || (*abstime).tv_nsec < 0 || (*abstime).tv_nsec > 999_999_999 {
+            return Err(LinuxError::EINVAL);
+        }
+        let deadline = Duration::from(*abstime);
+        (*cond.cast::<PthreadCond>()).wait(&*mutex.cast::<PthreadMutex>(), Some(deadline))?;
+        Ok(0)
+    })
+}
+
+/// Wake up one task waiting on the condition variable.
+#[no_mangle]
+pub unsafe extern "C" fn ax_pthread_cond_signal(cond: *mut ctypes::pthread_cond_t) -> c_int {
+    debug!("ax_pthread_cond_signal <= {:#x}", cond as usize);
+    ax_call_body!(ax_pthread_cond_signal, {
+        check_null_mut_ptr(cond)?;
+        (*cond.cast::<PthreadCond>()).signal();
+        Ok(0)
+    })
+}
+
+/// Wake up all tasks waiting on the condition variable.
+#[no_mangle]
+pub unsafe extern "C" fn ax_pthread_cond_broadcast(cond: *mut ctypes::pthread_cond_t) -> c_int {
+    debug!("ax_pthread_cond_broadcast <= {:#x}", cond as usize);
+    ax_call_body!(ax_pthread_cond_broadcast, {
+        check_null_mut_ptr(cond)?;
+        (*cond.cast::<PthreadCond>()).broadcast();
+        Ok(0)
+    })
+}
@@ -0,0 +1,91 @@
+//! Wait queues keyed by addresses, in the way of Linux futexes.
+//!
+//! The pthread objects are plain words in the memory of the C program, which
+//! can be initialized with zeros (e.g., `PTHREAD_COND_INITIALIZER`), so they
+//! cannot embed a [`WaitQueue`]. Instead, tasks waiting on an object sleep in
+//! the wait queue of the object's address, which is created by the first
+//! waiter and removed after the last one leaves.
+
+use alloc::{collections::BTreeMap, sync::Arc};
+use core::time::Duration;
+
+use axtask::WaitQueue;
+use spinlock::SpinNoIrq;
+
+static QUEUES: SpinNoIrq<BTreeMap<usize, Arc<WaitQueue>>> = SpinNoIrq::new(BTreeMap::new());
+
+fn get_queue(key: usize) -> Arc<WaitQueue> {
+    QUEUES
+        .lock()
+        .entry(key)
+        .or_insert_with(|| Arc::new(WaitQueue::new()))
+        .clone()
+}
+
+fn find_queue(key: usize) -> Option<Arc<WaitQueue>> {
+    QUEUES.lock().get(&key).cloned()
+}
+
+fn put_queue(key: usize, wq: Arc<WaitQueue>) {
+    let mut queues = QUEUES.lock();
+    // Only referenced by the map and us, no other tasks can be waiting on it.
+    if Arc::strong_count(&wq) == 2 {
+        queues.remove(&key);
+    }
+}
+
+/// Blocks the current task until `condition` becomes true, which must be made
+/// true before calling [`wake_one`] or [`wake_all`] with the same `key`.
+pub fn wait_until<F>(key: usize, condition: F)
+where
+    F: Fn() -> bool,
+{
+    let wq = get_queue(key);
+    wq.wait_until(condition);
+    put_queue(key, wq);
+}
+
+/// Blocks the current task until `condition` becomes true, or the monotonic
+/// clock reaches `deadline`. Returns `true` if it timed out.
+pub fn wait_until_deadline<F>(key: usize, deadline: Duration, condition: F) -> bool
+where
+    F: Fn() -> bool,
+{
+    let now = || crate::time::Instant::now().as_duration();
+    let wq = get_queue(key);
+    let timeout = loop {
+        if condition() {
+            break false;
+        }
+        let Some(dur) = deadline.checked_sub(now()).filter(|d| !d.is_zero()) else {
+            break true;
+        };
+        #[cfg(feature = "irq")]
+        if !wq.wait_timeout_until(dur, &condition) {
+            break false;
+        }
+        #[cfg(not(feature = "irq"))]
+        {
+            let _ = dur;
+            axtask::yield_now(); // no timers, poll until the deadline
+        }
+    };
+    put_queue(key, wq);
+    timeout
+}
+
+/// Wakes up one task waiting on `key`.
+pub fn wake_one(key: usize) {
+    if let Some(wq) = find_queue(key) {
+        wq.notify_one(true);
+        put_queue(key, wq);
+    }
+}
+
+/// Wakes up all tasks waiting on `key`.
+pub fn wake_all(key: usize) {
+    if let Some(wq) = find_queue(key) {
+        wq.notify_all(true);
+        put_queue(key, wq);
+    }
+}
@@ -8,7 +8,14 @@ use spin::RwLock;
 
 use super::ctypes;
 
+mod futex;
+
+pub mod barrier;
+pub mod condvar;
 pub mod mutex;
+pub mod once;
+pub mod rwlock;
+pub mod spin;
 
 lazy_static::lazy_static! {
     static ref TID_TO_PTHREAD: RwLock<BTreeMap<u64, ForceSendSync<ctypes::pthread_t>>> = {
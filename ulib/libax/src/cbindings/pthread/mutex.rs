@@ -17,12 +17,12 @@ impl PthreadMutex {
         Self(Mutex::new(()))
     }
 
-    fn lock(&self) -> LinuxResult {
+    pub(super) fn lock(&self) -> LinuxResult {
         let _guard = ManuallyDrop::new(self.0.lock());
         Ok(())
     }
 
-    fn unlock(&self) -> LinuxResult {
+    pub(super) fn unlock(&self) -> LinuxResult {
         unsafe { self.0.force_unlock() };
         Ok(())
     }
@@ -0,0 +1,40 @@
+use crate::cbindings::{ctypes, utils::check_null_mut_ptr};
+use core::ffi::c_int;
+use core::mem::size_of;
+use core::sync::atomic::{AtomicI32, Ordering};
+
+use super::futex;
+
+static_assertions::const_assert_eq!(size_of::<AtomicI32>(), size_of::<ctypes::pthread_once_t>());
+
+/// The initial state, `PTHREAD_ONCE_INIT`.
+const INCOMPLETE: i32 = 0;
+const RUNNING: i32 = 1;
+const COMPLETE: i32 = 2;
+
+/// Call `init_routine` exactly once for the given `once` control.
+///
+/// Other tasks calling it at the same time sleep until `init_routine` returns.
+#[no_mangle]
+pub unsafe extern "C" fn ax_pthread_once(
+    once: *mut ctypes::pthread_once_t,
+    init_routine: extern "C" fn(),
+) -> c_int {
+    ax_call_body_no_debug!({
+        check_null_mut_ptr(once)?;
+        let state = &*once.cast::<AtomicI32>();
+        if state.load(Ordering::Acquire) == COMPLETE {
+            return Ok(0);
+        }
+        let key = once as usize;
+        match state.compare_exchange(INCOMPLETE, RUNNING, Ordering::Acquire, Ordering::Acquire) {
+            Ok(_) => {
+                init_routine();
+                state.store(COMPLETE, Ordering::Release);
+                futex::wake_all(key);
+            }
+            Err(_) => futex::wait_until(key, || state.load(Ordering::Acquire) == COMPLETE),
+        }
+        Ok(0)
+    })
+}
@@ -0,0 +1,225 @@
+use crate::cbindings::{ctypes, utils::check_null_mut_ptr};
+use axerrno::{LinuxError, LinuxResult};
+use core::ffi::c_int;
+use core::mem::size_of;
+use core::sync::atomic::{AtomicU32, Ordering};
+
+use super::futex;
+
+static_assertions::const_assert!(
+    size_of::<PthreadRwlock>() <= size_of::<ctypes::pthread_rwlock_t>()
+);
+
+/// Set in [`PthreadRwlock::state`] if a writer holds the lock.
+const WRITER: u32 = 1 << 31;
+/// Maximum number of readers that can hold the lock at the same time.
+const MAX_READERS: u32 = WRITER - 1;
+
+/// A readers-writer lock, whose initial state is all zeros (reader-preferring).
+///
+/// A reader-preferring lock lets new readers in as long as it's not held by a
+/// writer, which maximizes the concurrency but may starve writers. A
+/// writer-preferring lock blocks new readers once a writer is waiting.
+#[repr(C)]
+pub struct PthreadRwlock {
+    /// [`WRITER`] or the number of readers holding the lock.
+    state: AtomicU32,
+    /// Number of writers waiting for the lock.
+    writers_waiting: AtomicU32,
+    /// Number of tasks sleeping on the lock, to skip the wakeups if none.
+    sleepers: AtomicU32,
+    /// Whether waiting writers block new readers.
+    prefer_writer: u32,
+}
+
+impl PthreadRwlock {
+    const fn new(prefer_writer: bool) -> Self {
+        Self {
+            state: AtomicU32::new(0),
+            writers_waiting: AtomicU32::new(0),
+            sleepers: AtomicU32::new(0),
+            prefer_writer: prefer_writer as u32,
+        }
+    }
+
+    fn key(&self) -> usize {
+        self as *const _ as usize
+    }
+
+    fn is_locked(&self) -> bool {
+        self.state.load(Ordering::SeqCst) != 0
+    }
+
+    fn can_read(&self) -> bool {
+        self.state.load(Ordering::SeqCst) & WRITER == 0
+            && (self.prefer_writer == 0 || self.writers_waiting.load(Ordering::SeqCst) == 0)
+    }
+
+    fn try_read(&self) -> LinuxResult {
+        let mut state = self.state.load(Ordering::Relaxed);
+        loop {
+            if !self.can_read() {
+                return Err(LinuxError::EBUSY);
+            }
+            if state == MAX_READERS {
+                return Err(LinuxError::EAGAIN);
+            }
+            match self.state.compare_exchange_weak(
+                state,
+                state + 1,
+                Ordering::Acquire,
+                Ordering::Relaxed,
+            ) {
+                Ok(_) => return Ok(()),
+                Err(s) => state = s,
+            }
+        }
+    }
+
+    fn try_write(&self) -> LinuxResult {
+        self.state
+            .compare_exchange(0, WRITER, Ordering::Acquire, Ordering::Relaxed)
+            .map(|_| ())
+            .map_err(|_| LinuxError::EBUSY)
+    }
+
+    /// Sleeps until `condition` becomes true.
+    fn sleep_until<F: Fn() -> bool>(&self, condition: F) {
+        self.sleepers.fetch_add(1, Ordering::SeqCst);
+        futex::wait_until(self.key(), condition);
+        self.sleepers.fetch_sub(1, Ordering::SeqCst);
+    }
+
+    fn read(&self) -> LinuxResult {
+        loop {
+            match self.try_read() {
+                Err(LinuxError::EBUSY) => self.sleep_until(|| self.can_read()),
+                res => return res,
+            }
+        }
+    }
+
+    fn write(&self) -> LinuxResult {
+        if self.try_write().is_ok() {
+            return Ok(());
+        }
+        self.writers_waiting.fetch_add(1, Ordering::SeqCst);
+        while self.try_write().is_err() {
+            self.sleep_until(|| self.state.load(Ordering::SeqCst) == 0);
+        }
+        self.writers_waiting.fetch_sub(1, Ordering::SeqCst);
+        Ok(())
+    }
+
+    fn unlock(&self) -> LinuxResult {
+        let state = self.state.load(Ordering::Relaxed);
+        let released = if state == WRITER {
+            self.state.store(0, Ordering::SeqCst);
+            true
+        } else if state != 0 {
+            self.state.fetch_sub(1, Ordering::SeqCst) == 1
+        } else {
+            return Err(LinuxError::EPERM);
+        };
+        // Wake up all sleepers: readers may all get the lock, and writers
+        // will race for it.
+        if released && self.sleepers.load(Ordering::SeqCst) > 0 {
+            futex::wake_all(self.key());
+        }
+        Ok(())
+    }
+}
+
+/// Initialize a readers-writer lock.
+///
+/// The lock prefers writers if the kind set by `pthread_rwlockattr_setkind_np`
+/// in `attr` is not `PTHREAD_RWLOCK_PREFER_READER_NP`.
+#[no_mangle]
+pub unsafe extern "C" fn ax_pthread_rwlock_init(
+    rwlock: *mut ctypes::pthread_rwlock_t,
+    attr: *const ctypes::pthread_rwlockattr_t,
+) -> c_int {
+    debug!("ax_pthread_rwlock_init <= {:#x}", rwlock as usize);
+    ax_call_body!(ax_pthread_rwlock_init, {
+        check_null_mut_ptr(rwlock)?;
+        let prefer_writer = !attr.is_null() && (*attr).__attr[0] != 0;
+        rwlock
+            .cast::<PthreadRwlock>()
+            .write(PthreadRwlock::new(prefer_writer));
+        Ok(0)
+    })
+}
+
+/// Destroy a readers-writer lock.
+#[no_mangle]
+pub unsafe extern "C" fn ax_pthread_rwlock_destroy(rwlock: *mut ctypes::pthread_rwlock_t) -> c_int {
+    debug!("ax_pthread_rwlock_destroy <= {:#x}", rwlock as usize);
+    ax_call_body!(ax_pthread_rwlock_destroy, {
+        check_null_mut_ptr(rwlock)?;
+        if (*rwlock.cast::<PthreadRwlock>()).is_locked() {
+            return Err(LinuxError::EBUSY);
+        }
+        Ok(0)
+    })
+}
+
+/// Lock a readers-writer lock for reading.
+#[no_mangle]
+pub unsafe extern "C" fn ax_pthread_rwlock_rdlock(rwlock: *mut ctypes::pthread_rwlock_t) -> c_int {
+    debug!("ax_pthread_rwlock_rdlock <= {:#x}", rwlock as usize);
+    ax_call_body!(ax_pthread_rwlock_rdlock, {
+        check_null_mut_ptr(rwlock)?;
+        (*rwlock.cast::<PthreadRwlock>()).read()?;
+        Ok(0)
+    })
+}
+
+/// Try to lock a readers-writer lock for reading, fails with `EBUSY` if it
+/// would block.
+#[no_mangle]
+pub unsafe extern "C" fn ax_pthread_rwlock_tryrdlock(
+    rwlock: *mut ctypes::pthread_rwlock_t,
+) -> c_int {
+    debug!("ax_pthread_rwlock_tryrdlock <= {:#x}", rwlock as usize);
+    ax_call_body!(ax_pthread_rwlock_tryrdlock, {
+        check_null_mut_ptr(rwlock)?;
+        (*rwlock.cast::<PthreadRwlock>()).try_read()?;
+        Ok(0)
+    })
+}
+
+/// Lock a readers-writer lock for writing.
+#[no_mangle]
+pub unsafe extern "C" fn ax_pthread_rwlock_wrlock(rwlock: *mut ctypes::pthread_rwlock_t) -> c_int {
+    debug!("ax_pthread_rwlock_wrlock <= {:#x}", rwlock as usize);
+    ax_call_body!(ax_pthread_rwlock_wrlock, {
+        check_null_mut_ptr(rwlock)?;
+        (*rwlock.cast::<PthreadRwlock>()).write()?;
+        Ok(0)
+    })
+}
+
+/// Try to lock a readers-writer lock for writing, fails with `EBUSY` if it
+/// would block.
+#[no_mangle]
+pub unsafe extern "C" fn ax_pthread_rwlock_trywrlock(
+    rwlock: *mut ctypes::pthread_rwlock_t,
+) -> c_int {
+    debug!("ax_pthread_rwlock_trywrlock <= {:#x}", rwlock as usize);
+    ax_call_body!(ax_pthread_rwlock_trywrlock, {
+        check_null_mut_ptr(rwlock)?;
+        (*rwlock.cast::<PthreadRwlock>()).try_write()?;
+        Ok(0)
+    })
+}
+
+/// Unlock a readers-writer lock held for either reading or writing.
+#[no_mangle]
+pub unsafe extern "C" fn ax_pthread_rwlock_unlock(rwlock: *mut ctypes::pthread_rwlock_t) -> c_int {
+    debug!("ax_pthread_rwlock_unlock <= {:#x}", rwlock as usize);
+    ax_call_body!(ax_pthread_rwlock_unlock, {
+        check_null_mut_ptr(rwlock)?;
+        (*rwlock.cast::<PthreadRwlock>()).unlock()?;
+        Ok(0)
+    })
+}
@@ -0,0 +1,113 @@
+use crate::cbindings::{ctypes, utils::check_null_mut_ptr};
+use axerrno::{LinuxError, LinuxResult};
+use core::ffi::c_int;
+use core::mem::size_of;
+use core::sync::atomic::{AtomicI32, Ordering};
+
+use super::futex;
+
+static_assertions::const_assert_eq!(
+    size_of::<PthreadSpinlock>(),
+    size_of::<ctypes::pthread_spinlock_t>()
+);
+
+const UNLOCKED: i32 = 0;
+const LOCKED: i32 = 1;
+/// Locked, and some tasks may be sleeping on it.
+const LOCKED_SLEEPING: i32 = 2;
+/// Maximum number of times to spin on the lock before going to sleep.
+const MAX_SPINS: usize = 100;
+
+/// A spin lock, whose initial state is zero (unlocked).
+///
+/// It spins for a short while, as the critical sections protected by a spin
+/// lock are expected to be short, then sleeps. Pure spinning would never end
+/// if the holder is not running (e.g., preempted, or on a single CPU).
+#[repr(C)]
+pub struct PthreadSpinlock(AtomicI32);
+
+impl PthreadSpinlock {
+    const fn new() -> Self {
+        Self(AtomicI32::new(UNLOCKED))
+    }
+
+    fn key(&self) -> usize {
+        self as *const _ as usize
+    }
+
+    fn try_lock(&self) -> LinuxResult {
+        self.0
+            .compare_exchange(UNLOCKED, LOCKED, Ordering::Acquire, Ordering::Relaxed)
+            .map(|_| ())
+            .map_err(|_| LinuxError::EBUSY)
+    }
+
+    fn lock(&self) -> LinuxResult {
+        for _ in 0..MAX_SPINS {
+            if self.try_lock().is_ok() {
+                return Ok(());
+            }
+            core::hint::spin_loop();
+        }
+        // Once a task sleeps, the lock keeps `LOCKED_SLEEPING` until unlocked,
+        // so that the unlocker knows to wake it up.
+        while self.0.swap(LOCKED_SLEEPING, Ordering::Acquire) != UNLOCKED {
+            futex::wait_until(self.key(), || {
+                self.0.load(Ordering::Acquire) != LOCKED_SLEEPING
+            });
+        }
+        Ok(())
+    }
+
+    fn unlock(&self) -> LinuxResult {
+        match self.0.swap(UNLOCKED, Ordering::Release) {
+            UNLOCKED => return Err(LinuxError::EPERM),
+            LOCKED_SLEEPING => futex::wake_one(self.key()),
+            _ => {}
+        }
+        Ok(())
+    }
+}
+
+/// Initialize a spin lock.
+#[no_mangle]
+pub unsafe extern "C" fn ax_pthread_spin_init(
+    lock: *mut ctypes::pthread_spinlock_t,
+    _pshared: c_int,
+) -> c_int {
+    ax_call_body!(ax_pthread_spin_init, {
+        check_null_mut_ptr(lock)?;
+        lock.cast::<PthreadSpinlock>().write(PthreadSpinlock::new());
+        Ok(0)
+    })
+}
+
+/// Lock a spin lock.
+#[no_mangle]
+pub unsafe extern "C" fn ax_pthread_spin_lock(lock: *mut ctypes::pthread_spinlock_t) -> c_int {
+    ax_call_body_no_debug!({
+        check_null_mut_ptr(lock)?;
+        (*lock.cast::<PthreadSpinlock>()).lock()?;
+        Ok(0)
+    })
+}
+
+/// Try to lock a spin lock, fails with `EBUSY` if it's locked.
+#[no_mangle]
+pub unsafe extern "C" fn ax_pthread_spin_trylock(lock: *mut ctypes::pthread_spinlock_t) -> c_int {
+    ax_call_body_no_debug!({
+        check_null_mut_ptr(lock)?;
+        (*lock.cast::<PthreadSpinlock>()).try_lock()?;
+        Ok(0)
+    })
+}
+
+/// Unlock a spin lock.
+#[no_mangle]
+pub unsafe extern "C" fn ax_pthread_spin_unlock(lock: *mut ctypes::pthread_spinlock_t) -> c_int {
+    ax_call_body_no_debug!({
+        check_null_mut_ptr(lock)?;
+        (*lock.cast::<PthreadSpinlock>()).unlock()?;
+        Ok(0)
+    })
+}
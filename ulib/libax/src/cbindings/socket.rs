@@ -1,5 +1,6 @@
 use core::ffi::{c_char, c_int, c_void};
 use core::mem::size_of;
+use core::task::Waker;
 
 use alloc::sync::Arc;
 use alloc::vec;
@@ -10,6 +11,8 @@ use super::ctypes;
 use super::fd_ops::FileLike;
 use super::utils::char_ptr_to_str;
 use crate::io::PollState;
+#[cfg(feature = "fs")]
+use crate::io::{Seek, SeekFrom};
 use crate::sync::Mutex;
 
 pub enum Socket {
@@ -117,6 +120,16 @@ impl Socket {
         }
     }
 
+    fn set_reuse_port(&self, reuse_port: bool) -> LinuxResult {
+        match self {
+            Socket::Udp(_) => Err(LinuxError::ENOPROTOOPT),
+            Socket::Tcp(tcpsocket) => {
+                tcpsocket.lock().set_reuse_port(reuse_port);
+                Ok(())
+            }
+        }
+    }
+
     fn shutdown(&self) -> LinuxResult {
         match self {
             Socket::Udp(udpsocket) => {
@@ -174,6 +187,19 @@ impl FileLike for Socket {
         }
         Ok(())
     }
+
+    fn register_poll_waker(&self, waker: &Waker) -> bool {
+        match self {
+            Socket::Udp(_) => false, // TODO: readiness notification of UDP sockets
+            Socket::Tcp(tcpsocket) => tcpsocket.lock().register_poll_waker(waker),
+        }
+    }
+
+    fn unregister_poll_waker(&self, waker: &Waker) {
+        if let Socket::Tcp(tcpsocket) = self {
+            tcpsocket.lock().unregister_poll_waker(waker);
+        }
+    }
 }
 
 fn as_c_sockaddr(addr: &SocketAddr) -> ctypes::sockaddr {
@@ -322,6 +348,80 @@ pub unsafe extern "C" fn ax_send(
     })
 }
 
+/// Maximum number of bytes read from the file at a time by [`ax_sendfile`].
+#[cfg(feature = "fs")]
+const SENDFILE_CHUNK_SIZE: usize = 0x4000;
+
+/// Send at most `count` bytes of the file `in_fd` to the TCP socket `out_fd`,
+/// through a buffer of at most [`SENDFILE_CHUNK_SIZE`] bytes.
+///
+/// If `offset` is not null, the file is read from `*offset`, which is updated
+/// to the end of the bytes sent, and the file position is left unchanged.
+/// Otherwise the file is read from, and updates the file position.
+///
+/// Return the number of bytes sent if success.
+#[cfg(feature = "fs")]
+#[no_mangle]
+pub unsafe extern "C" fn ax_sendfile(
+    out_fd: c_int,
+    in_fd: c_int,
+    offset: *mut ctypes::off_t,
+    count: ctypes::size_t,
+) -> ctypes::ssize_t {
+    debug!(
+        "ax_sendfile <= {} {} {:#x} {}",
+        out_fd, in_fd, offset as usize, count
+    );
+    ax_call_body!(ax_sendfile, {
+        let socket = Socket::from_fd(out_fd)?;
+        let Socket::Tcp(tcpsocket) = socket.as_ref() else {
+            return Err(LinuxError::EINVAL);
+        };
+        let tcpsocket = tcpsocket.lock();
+        super::file::with_file(in_fd, |file| {
+            let start = if offset.is_null() {
+                file.seek(SeekFrom::Current(0))?
+            } else if *offset < 0 {
+                return Err(LinuxError::EINVAL);
+            } else {
+                *offset as u64
+            };
+            // The file is not read in `send_with`, which would keep all
+            // sockets locked during the read.
+            let mut chunk = vec![0; count.min(SENDFILE_CHUNK_SIZE)];
+            let mut sent = 0;
+            while sent < count {
+                let len = chunk.len().min(count - sent);
+                let read_len = match file.read_at(&mut chunk[..len], start + sent as u64) {
+                    Ok(0) => break, // end of file
+                    Ok(read_len) => read_len,
+                    Err(_) if sent > 0 => break,
+                    Err(e) => return Err(e.into()),
+                };
+                let mut chunk_sent = 0;
+                while chunk_sent < read_len {
+                    match tcpsocket.send(&chunk[chunk_sent..read_len]) {
+                        Ok(len) => chunk_sent += len,
+                        Err(_) if sent + chunk_sent > 0 => break,
+                        Err(e) => return Err(e.into()),
+                    }
+                }
+                sent += chunk_sent;
+                if chunk_sent < read_len {
+                    break;
+                }
+            }
+            let end = start + sent as u64;
+            if offset.is_null() {
+                file.seek(SeekFrom::Start(end))?;
+            } else {
+                *offset = end as _;
+            }
+            Ok(sent)
+        })
+    })
+}
+
 /// Receive a message on a socket and get its source address.
 ///
 /// Return the number of bytes received if success.
@@ -530,3 +630,42 @@ pub unsafe extern "C" fn ax_getpeername(
         Ok(0)
     })
 }
+
+/// Set options on a socket.
+///
+/// Only `SO_REUSEPORT` of TCP sockets takes effect. Other options are ignored
+/// with a warning.
+///
+/// Return 0 if success.
+#[no_mangle]
+pub unsafe extern "C" fn ax_setsockopt(
+    socket_fd: c_int,
+    level: c_int,
+    optname: c_int,
+    optval: *const c_void,
+    optlen: ctypes::socklen_t,
+) -> c_int {
+    debug!(
+        "ax_setsockopt <= {} {} {} {:#x} {}",
+        socket_fd, level, optname, optval as usize, optlen
+    );
+    ax_call_body!(ax_setsockopt, {
+        let socket = Socket::from_fd(socket_fd)?;
+        match (level as u32, optname as u32) {
+            (ctypes::SOL_SOCKET, ctypes::SO_REUSEPORT) => {
+                if optval.is_null() {
+                    return Err(LinuxError::EFAULT);
+                }
+                if (optlen as usize) < size_of::<c_int>() {
+                    return Err(LinuxError::EINVAL);
+                }
+                socket.set_reuse_port(*(optval as *const c_int) != 0)?;
+            }
+            _ => warn!(
+                "ax_setsockopt: ignored option {} at level {}",
+                optname, level
+            ),
+        }
+        Ok(0)
+    })
+}
@@ -18,6 +18,10 @@
 //!     - `multitask`: Enable multi-threading support.
 //!     - `sched_fifo`: Use the FIFO cooperative scheduler.
 //!     - `sched_rr`: Use the Round-robin preemptive scheduler.
+//!     - `tickless`: Stop the periodic timer tick when a CPU is idle or has
+//!       only one runnable task, and program the timer at the next deadline.
+//!       Not recommended with `smp`, as tasks are then spread over the CPUs
+//!       more slowly.
 //! - Device and upperlayer stack
 //!     - `fs`: Enable file system support.
 //!     - `net`: Enable networking support.
@@ -28,6 +32,11 @@
 //!     - `log-level-off`: Disable all logging.
 //!     - `log-level-error`, `log-level-warn`, `log-level-info`, `log-level-debug`,
 //!       `log-level-trace`: Keep logging only at the specified level or higher.
+//!     - `log-buffered`: Buffer the log records and print them in a
+//!       low-priority task.
+//! - Tracing
+//!     - `trace`: Enable the tracepoints, whose statistics are printed at
+//!       shutdown, and can be read from `/dev/trace` with `fs`.
 //! - Platform
 //!     - `platform-pc-x86`: Specify for use on the corresponding platform.
 //!     - `platform-qemu-virt-riscv`: Specify for use on the corresponding platform.
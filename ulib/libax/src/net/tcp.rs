@@ -34,6 +34,28 @@ impl TcpStream {
     pub fn shutdown(&self) -> io::Result {
         self.socket.shutdown()
     }
+
+    /// Reads data by passing the received bytes to `f` in place, which
+    /// returns how many of them are consumed.
+    ///
+    /// See [`TcpSocket::recv_with`] for details.
+    pub fn read_with<F>(&mut self, f: F) -> io::Result<usize>
+    where
+        F: FnMut(&[u8]) -> io::Result<usize>,
+    {
+        self.socket.recv_with(f)
+    }
+
+    /// Writes data by letting `f` fill the free space in the transmit buffer
+    /// in place, which returns how many bytes are filled.
+    ///
+    /// See [`TcpSocket::send_with`] for details.
+    pub fn write_with<F>(&mut self, f: F) -> io::Result<usize>
+    where
+        F: FnMut(&mut [u8]) -> io::Result<usize>,
+    {
+        self.socket.send_with(f)
+    }
 }
 
 impl Read for TcpStream {
@@ -1,7 +1,7 @@
 //! Useful synchronization primitives.
 
 #[cfg(feature = "multitask")]
-pub use axsync::{Mutex, MutexGuard};
+pub use axsync::{mutex_stats, Mutex, MutexGuard, MutexStats};
 
 #[cfg(feature = "multitask")]
 pub use axtask::WaitQueue;